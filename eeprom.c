@@ -0,0 +1,2143 @@
+/*
+ * eeprom.c
+ *
+ *      Purpose:
+ *
+ *      ATMEL 27C256 32Kx8 eeprom programmer library
+ *      using IEEE-1284 parallel port interface
+ *      using libieee1284 library version: 0.2.11-10build1 (precise)
+ *      	/usr/include/ieee1284.h
+ *      	/usr/lib/i386-linux-gnu/libieee1284.so
+ *
+ *      port bit assignments:
+ *
+ *      data	b7 b6 b5 b4 b3 b2 b1 b0
+ *
+ *      contol	b7 b6 b5 b4 b3 b2 b1 b0
+ *      		 |  |  |  |  |  |  |  |
+ *      		 |  |  |  |  |  |  |  +- Strobe
+ *      		 |  |  |  |  |  |  +---- F0
+ *      		 |  |  |  |  |  +------- F1
+ *      		 |  |  |  |  +---------- F2
+ *      		 |  |  |  +------------- n.c
+ *      		 |  |  +---------------- n.c
+ *      		 |  +------------------- n.c
+ *      		 +---------------------- n.c
+ *
+ *      		F2 F1 F0
+ *      		0  0  0	... A0 - A7 register clk
+ *      		0  0  1 ... A8 - A14, /CS register clk
+ *      		0  1  0 ... /WE
+ *      		0  1  1 ... /OE
+ *      		1  1  1 ... sys present test (sense on status register b7)
+ *
+ *      status	b7 b6 b5 b4 b3 b2 b1 b0
+ *      		 |  |  |  |  |  |  |  |
+ *      		 |  |  |  |  |  |  |  +- n.c
+ *      		 |  |  |  |  |  |  +---- n.c
+ *      		 |  |  |  |  |  +------- n.c
+ *      		 |  |  |  |  +---------- n.c
+ *      		 |  |  |  +------------- n.c
+ *      		 |  |  +---------------- n.c
+ *      		 |  +------------------- n.c
+ *      		 +---------------------- sys present loopback test
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "eeprom.h"
+#include "trace.h"
+#include "emu.h"
+#include "station.h"
+#include "wear.h"
+
+/*
+ * local function prototypes
+ */
+static void	eepromError(struct eeprom*, int, const char*, ...);	// format and report an error
+static void	eepromProgress(struct eeprom*, const char*, long, long);	// report progress
+static void	rtUnlock(void);				// drop process memory lock reference
+static void	portWriteData(struct eeprom*, t_byte);	// port access with trace recording
+static void	portWriteControl(struct eeprom*, t_byte);
+static t_byte	portReadControl(struct eeprom*);
+static t_byte	portReadData(struct eeprom*);
+static t_byte	portReadStatus(struct eeprom*);
+static void	portDataDir(struct eeprom*, int);
+static void	portDelay(struct eeprom*, unsigned int);
+static int	compareNs(const void*, const void*);	// qsort() compare of nano-second samples
+
+/*
+ * local definitions
+ */
+#define DATA_INIT	0xff		// initialize data port
+#define CNTRL_INIT	0x0f		// initialize control port
+
+#define	SET_STROBE	0x01		// set strobe bit
+#define CLR_STROBE	0xfe		// clear strobe bit
+
+#define CLR_FUNC	0xf1		// clear function bits
+#define FUNC_LOADD	0x00		// select low address register
+#define FUNC_HIADD	0x02		// select hi address register
+#define FUNC_CS		0x02		// select /CS register
+#define FUNC_WE		0x04		// select /WE
+#define FUNC_OE		0x06		// select /OE
+#define FUNC_LOOP	0x0e		// select programmer loop test
+
+#define TEST		0x80		// loopback test mask
+
+#define CS_SET		0x80		// 'or' and 'and' masks for /CS
+#define CS_CLR		0x7f
+
+#define DIR_READ	-1			// for use with ieee1284_data_dir()
+#define DIR_WRITE	0
+
+#define SLEEP_SAMPLES	20		// 1ms delays timed by portBenchmark()
+#define SPIN_MAX		50		// longest delay in micro-seconds done by spinning instead of sleeping
+#define WRITE_TIMEOUT	10000000LL	// DATA polling time-out in nano-seconds, data sheet maximum write cycle
+
+#define LIST_SPACE	" \t,"		// planList() word separators
+
+#define SAMPLE_RANGES	32		// checkPlan() sample: first and last byte of up to this many ranges,
+#define SAMPLE_SPREAD	32		// bytes evenly spread over the planned bytes
+#define SAMPLE_HASH		32		// and bytes at positions picked by the image digest
+
+#define FNV_BASIS	0xcbf29ce484222325ULL	// FNV-1a 64 bit digest
+#define FNV_PRIME	0x100000001b3ULL
+#define FNV(h, b)	(((h) ^ (b)) * FNV_PRIME)
+
+#define RT_CPU_SEC	10			// RLIMIT_RTTIME soft limit, bus loop sleeps often so this only catches a runaway
+#define RT_STACK	(64*1024)	// stack pre-fault size after mlockall()
+
+/*
+ * locals
+ */
+static pthread_mutex_t	rtLock = PTHREAD_MUTEX_INITIALIZER;	// memory locking and RLIMIT_RTTIME are process wide,
+static int				nRtUsers = 0;						// count contexts in real-time mode
+static struct rlimit	rtSavedLimit;						// RLIMIT_RTTIME before the first context entered
+
+/*
+ * -----------------------------------------
+ * ----------  context functions  ----------
+ * -----------------------------------------
+ */
+
+/*
+ * eepromInit()
+ *
+ * set context defaults: no port, no callbacks,
+ * real-time mode and latency statistics disabled,
+ * page mode writes without page fill
+ *
+ */
+void eepromInit(struct eeprom *ctx)
+{
+	memset(ctx, 0, sizeof(struct eeprom));
+
+	ctx->nRtCpu = -1;
+	ctx->nRtPriority = RT_PRIO_DEF;
+	ctx->nPageMode = 1;
+	ctx->nFill = -1;
+	ctx->nForce = 0;
+	ctx->nLatchLo = -1;
+	ctx->nLatchHi = -1;
+	ctx->nSettleUs = DEF_SETTLE_US;
+	ctx->nWriteUs = DEF_WRITE_US;
+	ctx->nEraseUs = DEF_ERASE_US;
+}
+
+/*
+ * eepromOpen()
+ *
+ * open and claim ieee1284 port 'port' for raw access
+ * and initialize the programer.
+ * port usage sequence:
+ * 1. open		ieee1284_open()
+ * 2. claim		ieee1284_claim()
+ * 3. do IO work
+ * 4. release	ieee1284_release()	by eepromClose()
+ * 5. close		ieee1284_close()	by eepromClose()
+ * return '0' on success, EEPROM_EPORT on failure
+ *
+ */
+int eepromOpen(struct eeprom *ctx, struct parport *port)
+{
+	int		nFlags = 0;								// not exclusive use of the port
+	int		nCapabilities = CAP1284_RAW;			// use raw manipulation option
+
+	switch ( ieee1284_open(port, nFlags, &nCapabilities) )
+	{
+		case E1284_OK:
+			break;
+
+		case E1284_INIT:
+			eepromError(ctx, EEPROM_EPORT, "ieee1284_open() could not initialize or busy");
+			return EEPROM_EPORT;
+
+		case E1284_NOTAVAIL:
+			eepromError(ctx, EEPROM_EPORT, "ieee1284_open() capability not available");
+			return EEPROM_EPORT;
+
+		case E1284_INVALIDPORT:
+			eepromError(ctx, EEPROM_EPORT, "ieee1284_open() invalid port ID in open");
+			return EEPROM_EPORT;
+
+		case E1284_NOMEM:
+		case E1284_SYS:
+			eepromError(ctx, EEPROM_EPORT, "ieee1284_open() system error on out of memory");
+			return EEPROM_EPORT;
+
+		default:
+			eepromError(ctx, EEPROM_EPORT, "ieee1284_open() unspecified error");
+			return EEPROM_EPORT;
+	}
+
+	switch ( ieee1284_claim(port) )
+	{
+		case E1284_OK:
+			break;
+
+		case E1284_NOMEM:
+		case E1284_SYS:
+			eepromError(ctx, EEPROM_EPORT, "ieee1284_claim() system error on out of memory");
+			ieee1284_close(port);
+			return EEPROM_EPORT;
+
+		case E1284_INVALIDPORT:
+			eepromError(ctx, EEPROM_EPORT, "ieee1284_claim() invalid port ID in open");
+			ieee1284_close(port);
+			return EEPROM_EPORT;
+
+		default:
+			eepromError(ctx, EEPROM_EPORT, "ieee1284_claim() unspecified error");
+			ieee1284_close(port);
+			return EEPROM_EPORT;
+	}
+
+	ctx->port = port;
+	ctx->nLatchLo = -1;								// address register contents unknown
+	ctx->nLatchHi = -1;
+
+	portWriteData(ctx, DATA_INIT);					// initialize programmer
+	portWriteControl(ctx, CNTRL_INIT);
+	setAddress(ctx, 0, CS_SET);
+
+	return EEPROM_OK;
+}
+
+/*
+ * eepromEmulate()
+ *
+ * initialize the emulated programer 'emu' and use it instead
+ * of a port. every port access advances the context virtual
+ * 'clock' by its cost in latency model 'model' and delays advance
+ * it by their length plus the model's overrun, so 'clock'
+ * predicts the wall time of the same actions on the station.
+ * return '0'
+ *
+ */
+int eepromEmulate(struct eeprom *ctx, struct emu *emu, struct station *model)
+{
+	emuInit(emu, 1);
+	emu->writeNs = model->writeCycleNs;
+
+	ctx->emu = emu;
+	ctx->model = model;
+	ctx->clock = 0;
+	ctx->nLatchLo = -1;
+	ctx->nLatchHi = -1;
+	memset(ctx->nPortOps, 0, sizeof(ctx->nPortOps));
+	ctx->nDelays = 0;
+	ctx->delayUs = 0;
+
+	portWriteData(ctx, DATA_INIT);					// initialize programmer
+	portWriteControl(ctx, CNTRL_INIT);
+	setAddress(ctx, 0, CS_SET);
+
+	return EEPROM_OK;
+}
+
+/*
+ * eepromClose()
+ *
+ * park the programer on its loop test function,
+ * release and close the context port
+ *
+ */
+void eepromClose(struct eeprom *ctx)
+{
+	if ( ctx->emu )
+	{
+		selectFunc(ctx, FUNC_LOOP);
+		ctx->emu = NULL;
+		ctx->model = NULL;
+		return;
+	}
+
+	if ( ctx->port == NULL )
+		return;
+
+	selectFunc(ctx, FUNC_LOOP);
+	ieee1284_release(ctx->port);
+	ieee1284_close(ctx->port);
+
+	ctx->port = NULL;
+}
+
+/*
+ * eepromMessage()
+ *
+ * image library message callback for loadInput() and struct convert,
+ * 'arg' is the context. the IMAGE_* code is mapped to an EEPROM_*
+ * code and the message passed to the context error callback,
+ * notes with EEPROM_OK
+ *
+ */
+void eepromMessage(void *arg, int nCode, const char *sMessage)
+{
+	struct eeprom	*ctx = arg;
+	int				nError;
+
+	if ( ctx->error == NULL )
+		return;
+
+	switch ( nCode )
+	{
+		case IMAGE_NOTE:
+			nError = EEPROM_OK;
+			break;
+
+		case IMAGE_EFORMAT:
+			nError = EEPROM_EFORMAT;
+			break;
+
+		case IMAGE_ERANGE:
+			nError = EEPROM_ERANGE;
+			break;
+
+		default:
+			nError = EEPROM_EFILE;
+			break;
+	}
+
+	ctx->error(ctx, nError, sMessage);
+}
+
+/*
+ * eepromError()
+ *
+ * format an error message and pass it with its
+ * error code to the context error callback
+ *
+ */
+static void eepromError(struct eeprom *ctx, int nError, const char *sFormat, ...)
+{
+	char	sMessage[TEXT_LEN * 2];
+	va_list	args;
+
+	if ( ctx->error == NULL )
+		return;
+
+	va_start(args, sFormat);
+	vsnprintf(sMessage, sizeof(sMessage), sFormat, args);
+	va_end(args);
+
+	ctx->error(ctx, nError, sMessage);
+}
+
+/*
+ * eepromProgress()
+ *
+ * pass progress of action 'sAction' to the context progress callback
+ *
+ */
+static void eepromProgress(struct eeprom *ctx, const char *sAction, long nDone, long nTotal)
+{
+	if ( ctx->progress )
+		ctx->progress(ctx, sAction, nDone, nTotal);
+}
+
+/*
+ * -----------------------------------------
+ * ---------  programer functions  ---------
+ * -----------------------------------------
+ */
+
+/*
+ * readEEPROM()
+ *
+ * this function will read eeprom data from
+ * 'startAddress' to 'endAddress' into 'data'
+ * return '0' on success or error code
+ *
+ */
+int readEEPROM(struct eeprom *ctx, t_word startAddress, t_word endAddress, t_byte *data)
+{
+	long	i;
+	int		nCount;
+	int		nRead;
+	long	nTotal;
+
+	if ( startAddress > endAddress || endAddress >= EEPROM_SIZE )	// validate address range
+	{
+		eepromError(ctx, EEPROM_ERANGE, "readEEPROM() invalid address range 0x%04hx to 0x%04hx", startAddress, endAddress);
+		return EEPROM_ERANGE;
+	}
+
+	nTotal = (long) endAddress - startAddress + 1;
+	eepromProgress(ctx, "read", 0, nTotal);
+
+	for ( i = 0; i < nTotal; i += nRead )
+	{
+		if ( (nTotal - i) > DATA_BUFFER )
+			nCount = DATA_BUFFER;
+		else
+			nCount = (int) (nTotal - i);
+
+		nRead = readBlock(ctx, (t_word) (startAddress + i), &data[i], nCount);	// read a block of data from eeprom
+
+		if ( nRead != nCount )					// test for address over eeprom size
+		{
+			eepromError(ctx, EEPROM_ERANGE, "readEEPROM() read over EEPROM address range");
+			return EEPROM_ERANGE;
+		}
+
+		eepromProgress(ctx, "read", i + nRead, nTotal);
+	}
+
+	return EEPROM_OK;
+}
+
+/*
+ * readRanges()
+ *
+ * read every address marked in 'want' into the same offset of 'data'.
+ * addresses are read in ascending order, so overlapping and adjacent
+ * ranges are read once as one run and the high address latch is
+ * only reloaded when a run crosses into the next 256 byte block
+ * return '0' on success
+ *
+ */
+int readRanges(struct eeprom *ctx, t_byte *want, t_byte *data)
+{
+	long	a;
+	long	nEnd;
+	long	nTotal = 0;
+	long	nDone = 0;
+	long	nReported = 0;
+
+	for ( a = 0; a < EEPROM_SIZE; a++ )
+		nTotal += (want[a] != 0);
+
+	eepromProgress(ctx, "read", 0, nTotal);
+
+	for ( a = 0; a < EEPROM_SIZE; a = nEnd )
+	{
+		if ( !want[a] )
+		{
+			nEnd = a + 1;
+			continue;
+		}
+
+		for ( nEnd = a; nEnd < EEPROM_SIZE && want[nEnd] && (nEnd - a) < DATA_BUFFER; nEnd++ )
+			;
+
+		readBlock(ctx, (t_word) a, &data[a], (int) (nEnd - a));
+		nDone += nEnd - a;
+
+		if ( (nDone - nReported) >= DATA_BUFFER || nDone == nTotal )	// report progress
+		{
+			eepromProgress(ctx, "read", nDone, nTotal);
+			nReported = nDone;
+		}
+	}
+
+	return EEPROM_OK;
+}
+
+/*
+ * writeEEPROM()
+ *
+ * this function will write an image of 'nLength' bytes to eeprom.
+ * the image format is the context 'nFormat' or detected from the first bytes,
+ * either a binary image, an S-record or an Intel HEX file:
+ * (1) S-record or Intel HEX images carry their eeprom addresses and
+ * 'startAddress' is ignored.
+ * (2) binary images will be written starting at 'startAddress'
+ * the image is planned first, see planImage(), and then written in address order
+ * return '0' on success or error code
+ *
+ */
+int writeEEPROM(struct eeprom *ctx, t_byte *data, int nLength, t_word startAddress)
+{
+	struct plan	*plan;
+	int			nResult;
+
+	if ( (plan = malloc(sizeof(struct plan))) == NULL )
+	{
+		eepromError(ctx, EEPROM_EFILE, "writeEEPROM() out of memory");
+		return EEPROM_EFILE;
+	}
+
+	planInit(plan);
+
+	if ( (nResult = planImage(ctx, plan, data, nLength, startAddress)) == EEPROM_OK )
+	{
+		planBuild(plan, ctx->nFill);
+		nResult = writePlan(ctx, plan);
+	}
+
+	free(plan);
+
+	return nResult;
+}
+
+/*
+ * eraseBlock()
+ *
+ * write blank data pattern to the 64 byte block at 'address'
+ * in one burst and wait 'nEraseUs' for its write cycle
+ *
+ */
+void eraseBlock(struct eeprom *ctx, t_word address)
+{
+	int		i;
+
+	for ( i = 0; i < 64; i++ )
+		fastByteWrite(ctx, (t_word) (address + i), 0xff);
+
+	portDelay(ctx, ctx->nEraseUs);						// delay at end of 64 byte block
+}
+
+/*
+ * waitWrite()
+ *
+ * wait out a write cycle that may still run, for the data sheet
+ * maximum write cycle time. used where the last written byte is
+ * not known and DATA polling cannot tell when the chip is idle
+ *
+ */
+void waitWrite(struct eeprom *ctx)
+{
+	portDelay(ctx, (unsigned int) (WRITE_TIMEOUT / 1000));
+}
+
+/*
+ * eraseEEPROM()
+ *
+ * this function will erase the eeprom device.
+ *
+ */
+int eraseEEPROM(struct eeprom *ctx)
+{
+	long	address;
+
+	eepromProgress(ctx, "erase", 0, EEPROM_SIZE);
+
+	for (address = 0; address < EEPROM_SIZE; address += 64)
+	{
+		eraseBlock(ctx, (t_word) address);
+
+		if ( ((address + 64) % DATA_BUFFER) == 0 )		// report progress
+			eepromProgress(ctx, "erase", address + 64, EEPROM_SIZE);
+	}
+
+	setAddress(ctx, 0, CS_SET);							// negate CS
+
+	return EEPROM_OK;
+}
+
+/*
+ * -----------------------------------------
+ * ----------  planner functions  ----------
+ * -----------------------------------------
+ */
+
+/*
+ * planInit()
+ *
+ * clear a write plan
+ *
+ */
+void planInit(struct plan *plan)
+{
+	memset(plan, 0, sizeof(struct plan));
+}
+
+/*
+ * planImage()
+ *
+ * add an image of 'nLength' bytes to the write plan,
+ * the image is parsed in the 'nFormat' context format, or in the format
+ * detected from its first record when no format was set.
+ * binary images are placed at 'startAddress', S-record and
+ * Intel HEX images carry their addresses.
+ * records may come in any order, overlap and repeat bytes
+ * as long as overlapping bytes agree.
+ * return '0' on success or error code
+ *
+ */
+int planImage(struct eeprom *ctx, struct plan *plan, t_byte *data, int nLength, t_word startAddress)
+{
+	int		nResult = EEPROM_OK;
+
+	switch ( ctx->nFormat ? ctx->nFormat : detectFormat(data, nLength) )
+	{
+		case 0:
+			eepromError(ctx, EEPROM_EFORMAT, "planImage() first record is not a valid S-record or Intel HEX record");
+			nResult = EEPROM_EFORMAT;
+			break;
+
+		case BINARY:
+			nResult = planBin(ctx, plan, data, nLength, startAddress);
+			break;
+
+		case S_RECORD:
+			nResult = planSrec(ctx, plan, data, nLength);
+			break;
+
+		case INTEL_HEX:
+			nResult = planIhex(ctx, plan, data, nLength);
+			break;
+	}
+
+	return nResult;
+}
+
+/*
+ * planAdd()
+ *
+ * add 'nCount' bytes at 'address' to the write plan
+ * return '0' on success, EEPROM_ERANGE if the bytes run past the
+ * end of the eeprom or EEPROM_EFORMAT if a byte conflicts with a
+ * different byte already planned at the same address
+ *
+ */
+int planAdd(struct eeprom *ctx, struct plan *plan, t_word address, t_byte *data, int nCount)
+{
+	int		i;
+	long	a;
+
+	if ( ((long) address + nCount) > EEPROM_SIZE )
+	{
+		eepromError(ctx, EEPROM_ERANGE, "planAdd() 0x%04hx + %d bytes out of range", address, nCount);
+		return EEPROM_ERANGE;
+	}
+
+	for ( i = 0; i < nCount; i++ )
+	{
+		a = (long) address + i;
+
+		if ( plan->used[a] )
+		{
+			if ( plan->data[a] != data[i] )
+			{
+				eepromError(ctx, EEPROM_EFORMAT, "planAdd() conflicting data at 0x%04lx: 0x%02x and 0x%02x",
+							a, plan->data[a], data[i]);
+				return EEPROM_EFORMAT;
+			}
+
+			plan->nDuplicates++;
+			continue;
+		}
+
+		plan->data[a] = data[i];
+		plan->used[a] = 1;
+		plan->nBytes++;
+	}
+
+	return EEPROM_OK;
+}
+
+/*
+ * planBuild()
+ *
+ * list the pages holding planned bytes in address order.
+ * with 'nFill' 0 to 0xff the unused bytes of those pages are planned
+ * with the fill byte, so every listed page is written whole,
+ * '-1' leaves them untouched
+ *
+ */
+void planBuild(struct plan *plan, int nFill)
+{
+	int		nPage;
+	int		i;
+	int		nUsed;
+	t_byte	*used;
+
+	plan->nPages = 0;
+
+	for ( nPage = 0; nPage < PAGES; nPage++ )
+	{
+		used = &plan->used[nPage * PAGE_SIZE];
+
+		for ( i = 0, nUsed = 0; i < PAGE_SIZE; i++ )
+			nUsed += used[i];
+
+		if ( nUsed == 0 )
+			continue;
+
+		if ( nFill >= 0 && nUsed < PAGE_SIZE )
+		{
+			for ( i = 0; i < PAGE_SIZE; i++ )
+			{
+				if ( used[i] == 0 )
+				{
+					plan->data[nPage * PAGE_SIZE + i] = (t_byte) nFill;
+					used[i] = 1;
+					plan->nFilled++;
+					plan->nBytes++;
+				}
+			}
+		}
+
+		plan->pages[plan->nPages++] = (t_word) (nPage * PAGE_SIZE);
+	}
+}
+
+/*
+ * writePlan()
+ *
+ * write the planned pages in address order.
+ * unless 'ctx->nForce' is set the eeprom is checked first, see checkPlan(),
+ * and nothing is written if it already holds the plan.
+ * in page mode each page is loaded in one write cycle, a page
+ * that fails verification is rewritten one byte at a time.
+ * without page mode every byte gets its own write cycle.
+ * return '0' on success or error code
+ *
+ */
+int writePlan(struct eeprom *ctx, struct plan *plan)
+{
+	int		i;
+	int		j;
+	t_word	address;
+	long	nWritten = 0;
+	long	nReported = 0;
+	int		nResult;
+
+	plan->nCurrent = 0;
+	if ( !ctx->nForce && plan->nBytes && checkPlan(ctx, plan) )
+	{
+		plan->nCurrent = 1;
+		return EEPROM_OK;
+	}
+
+	eepromProgress(ctx, "write", 0, plan->nBytes);
+
+	for ( i = 0; i < plan->nPages; i++ )
+	{
+		address = plan->pages[i];
+
+		if ( ctx->nPageMode && writePage(ctx, address, &plan->data[address], &plan->used[address]) == WRITEOK )
+		{
+			for ( j = 0; j < PAGE_SIZE; j++ )
+				nWritten += plan->used[address + j];
+		}
+		else
+		{
+			if ( ctx->nPageMode )
+			{
+				plan->nFallbacks++;
+				if ( ctx->wear )
+					wearRetry(ctx->wear, address);
+			}
+
+			for ( j = 0; j < PAGE_SIZE; j++ )
+			{
+				if ( plan->used[address + j] == 0 )
+					continue;
+
+				if ( ctx->nPageMode && readByte(ctx, (t_word) (address + j)) == plan->data[address + j] )
+					nResult = WRITEOK;					// page write got this one
+				else
+					nResult = writeByte(ctx, (t_word) (address + j), plan->data[address + j]);
+
+				if ( nResult )
+				{
+					eepromError(ctx, EEPROM_EWRITE, "eeprom write error %d at 0x%04x (data=0x%x)", nResult, address + j, plan->data[address + j]);
+					return EEPROM_EWRITE;
+				}
+
+				nWritten++;
+			}
+		}
+
+		if ( (nWritten - nReported) >= DATA_BUFFER || i == (plan->nPages - 1) )	// report progress
+		{
+			eepromProgress(ctx, "write", nWritten, plan->nBytes);
+			nReported = nWritten;
+		}
+	}
+
+	return EEPROM_OK;
+}
+
+/*
+ * checkPlan()
+ *
+ * check whether the eeprom already holds the plan, cheapest test first:
+ * (1) read a deterministic sample, the first and last byte of the
+ * planned ranges, bytes spread evenly over the planned bytes and bytes
+ * at positions picked by the plan digest, stop on the first difference.
+ * (2) read back all planned bytes, stop on the first difference.
+ * 'plan->digest' holds the plan digest on return.
+ * return '1' if the eeprom holds the plan, '0' if it does not
+ *
+ */
+int checkPlan(struct eeprom *ctx, struct plan *plan)
+{
+	t_word				*index;				// addresses of planned bytes, in order
+	long				nIndex = 0;
+	long				nRanges = 0;
+	long				i;
+	unsigned long long	x;
+	t_word				address;
+	int					nResult = 0;
+
+	plan->digest = planDigest(plan);
+
+	if ( (index = malloc(EEPROM_SIZE * sizeof(t_word))) == NULL )
+		return 0;
+
+	for ( i = 0; i < EEPROM_SIZE; i++ )
+	{
+		if ( plan->used[i] )
+			index[nIndex++] = (t_word) i;
+	}
+
+	if ( nIndex == 0 )
+		goto EXIT;
+
+	/*
+	 * sample
+	 */
+	for ( i = 0; i < nIndex && nRanges < SAMPLE_RANGES; i++ )		// range ends
+	{
+		address = index[i];
+		if ( i == 0 || index[i - 1] != address - 1 )
+		{
+			nRanges++;
+			if ( readByte(ctx, address) != plan->data[address] )
+				goto EXIT;
+		}
+		if ( i == nIndex - 1 || index[i + 1] != address + 1 )
+		{
+			if ( readByte(ctx, address) != plan->data[address] )
+				goto EXIT;
+		}
+	}
+
+	for ( i = 0; i < SAMPLE_SPREAD; i++ )							// evenly spread
+	{
+		address = index[i * nIndex / SAMPLE_SPREAD];
+		if ( readByte(ctx, address) != plan->data[address] )
+			goto EXIT;
+	}
+
+	x = plan->digest | 1;
+	for ( i = 0; i < SAMPLE_HASH; i++ )								// digest picked, xorshift64
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		address = index[x % nIndex];
+		if ( readByte(ctx, address) != plan->data[address] )
+			goto EXIT;
+	}
+
+	/*
+	 * full verify
+	 */
+	eepromProgress(ctx, "verify", 0, nIndex);
+
+	for ( i = 0; i < nIndex; i++ )
+	{
+		address = index[i];
+		if ( readByte(ctx, address) != plan->data[address] )
+			goto EXIT;
+
+		if ( ((i + 1) % DATA_BUFFER) == 0 || i == (nIndex - 1) )
+			eepromProgress(ctx, "verify", i + 1, nIndex);
+	}
+
+	nResult = 1;
+
+EXIT:
+	free(index);
+
+	return nResult;
+}
+
+/*
+ * planDigest()
+ *
+ * return FNV-1a 64 bit digest of the planned
+ * address and data bytes in address order
+ *
+ */
+unsigned long long planDigest(struct plan *plan)
+{
+	unsigned long long	digest = FNV_BASIS;
+	long				i;
+
+	for ( i = 0; i < EEPROM_SIZE; i++ )
+	{
+		if ( plan->used[i] )
+		{
+			digest = FNV(digest, i & 0xff);
+			digest = FNV(digest, i >> 8);
+			digest = FNV(digest, plan->data[i]);
+		}
+	}
+
+	return digest;
+}
+
+/*
+ * verifyPlan()
+ *
+ * read back all planned bytes
+ * return number of bytes that differ from the plan
+ *
+ */
+long verifyPlan(struct eeprom *ctx, struct plan *plan)
+{
+	int		i;
+	int		j;
+	t_word	address;
+	long	nDiffer = 0;
+
+	for ( i = 0; i < plan->nPages; i++ )
+	{
+		address = plan->pages[i];
+
+		for ( j = 0; j < PAGE_SIZE; j++ )
+		{
+			if ( plan->used[address + j] && readByte(ctx, (t_word) (address + j)) != plan->data[address + j] )
+				nDiffer++;
+		}
+	}
+
+	return nDiffer;
+}
+
+/*
+ * planBin()
+ *
+ * add binary image of 'nLength' bytes to write plan,
+ * start address used to deterine start offset into device
+ *
+ */
+int planBin(struct eeprom *ctx, struct plan *plan, t_byte *data, int nLength, t_word startAddress)
+{
+	if ( startAddress >= EEPROM_SIZE )				// validate address range
+	{
+		eepromError(ctx, EEPROM_ERANGE, "planBin() invalid start address 0x%04hx", startAddress);
+		return EEPROM_ERANGE;
+	}
+
+	if ( nLength > (EEPROM_SIZE - startAddress) )
+	{
+		eepromError(ctx, EEPROM_ERANGE, "planBin() file too large to fit in eeprom device");
+		return EEPROM_ERANGE;
+	}
+
+	if ( nLength == 0 )
+	{
+		eepromError(ctx, EEPROM_EFORMAT, "planBin() file is empty");
+		return EEPROM_EFORMAT;
+	}
+
+	return planAdd(ctx, plan, startAddress, data, nLength);
+}
+
+/*
+ * planSrec()
+ *
+ * add S-rec image of 'nLength' bytes to write plan
+ * device offsets are based on S-rec file
+ *
+ */
+int planSrec(struct eeprom *ctx, struct plan *plan, t_byte *data, int nLength)
+{
+	/*
+	 * 1. read image one record at a time
+	 * 2. extract and validate: byte count, start address, data, checksum
+	 * 3. add data bytes to plan at start address
+	 * 4. repeat until end of S-record image
+	 *
+	 * S0 : Record data sequence contains vendor specific data rather than program data.
+	 *      String with file name and possibly version info.
+	 * S1, S2, S3: Data sequence, depending on size of address needed.
+	 *             16-bit/64K system uses S1, 24-bit address uses S2 and full 32-bit uses S3.
+	 * S5: Count of S1, S2 and S3 records previously appearing in the file or transmission.
+	 *              The record count is stored in the 2-byte address field.
+	 *              There is no data associated with this record type.
+	 * S7, S8, S9: The address field of the S7, S8, or S9 records may contain a starting address for the program.
+	 *             S7 4-byte address, S8 3-byte address, S9 2 byte address.
+	 *
+	 */
+	char	textLine[RECORD_LEN];
+	int		nPos = 0;
+	int		nLine = 0;
+	int		nType;
+	unsigned long	address;
+	t_byte	record[256];
+	int		nByteCount;
+	int		nResult;
+
+	while ( getRecord(data, nLength, &nPos, textLine) != -1 )	// read record from image
+	{
+		nLine++;
+
+		if ( textLine[0] == '\0' )								// skip blank lines
+			continue;
+
+		if ( (nByteCount = parseSrec(textLine, &nType, &address, record)) < 0 )
+		{
+			eepromError(ctx, EEPROM_EFORMAT, "planSrec() bad record or checksum in line %d", nLine);
+			return EEPROM_EFORMAT;
+		}
+
+		if ( nType < 1 || nType > 3 )							// process data records 'S1', 'S2', 'S3' only
+			continue;
+
+		if ( (address + nByteCount) > EEPROM_SIZE )
+		{
+			eepromError(ctx, EEPROM_ERANGE, "planSrec() record address 0x%lx out of range in line %d", address, nLine);
+			return EEPROM_ERANGE;
+		}
+
+		if ( (nResult = planAdd(ctx, plan, (t_word) address, record, nByteCount)) )
+			return nResult;
+	}
+
+	return EEPROM_OK;
+}
+
+/*
+ * planIhex()
+ *
+ * add Intel HEX image of 'nLength' bytes to write plan
+ * device offsets are based on HEX file
+ *
+ */
+int planIhex(struct eeprom *ctx, struct plan *plan, t_byte *data, int nLength)
+{
+	/*
+	 * 00: data record, 'AAAA' is offset from current base address
+	 * 01: end of file
+	 * 02: extended segment address, base address is data * 16
+	 * 03: start segment address, ignored
+	 * 04: extended linear address, base address is data * 65536
+	 * 05: start linear address, ignored
+	 *
+	 */
+	char	textLine[RECORD_LEN];
+	int		nPos = 0;
+	int		nLine = 0;
+	int		nType;
+	unsigned long	address;
+	unsigned long	base = 0;
+	t_byte	record[256];
+	int		nByteCount;
+	int		nResult;
+
+	while ( getRecord(data, nLength, &nPos, textLine) != -1 )
+	{
+		nLine++;
+
+		if ( textLine[0] == '\0' )
+			continue;
+
+		if ( (nByteCount = parseIhex(textLine, &nType, &address, record)) < 0 )
+		{
+			eepromError(ctx, EEPROM_EFORMAT, "planIhex() bad record or checksum in line %d", nLine);
+			return EEPROM_EFORMAT;
+		}
+
+		if ( nType == 1 )										// end of file record
+			break;
+
+		if ( nType == 2 && nByteCount == 2 )
+			base = ((unsigned long) record[0] << 12) | ((unsigned long) record[1] << 4);
+		else if ( nType == 4 && nByteCount == 2 )
+			base = ((unsigned long) record[0] << 24) | ((unsigned long) record[1] << 16);
+
+		if ( nType != 0 )
+			continue;
+
+		address += base;
+		if ( (address + nByteCount) > EEPROM_SIZE )
+		{
+			eepromError(ctx, EEPROM_ERANGE, "planIhex() record address 0x%lx out of range in line %d", address, nLine);
+			return EEPROM_ERANGE;
+		}
+
+		if ( (nResult = planAdd(ctx, plan, (t_word) address, record, nByteCount)) )
+			return nResult;
+	}
+
+	return EEPROM_OK;
+}
+
+/*
+ * planPatch()
+ *
+ * add patch of 'nLength' bytes to write plan, an IPS patch or an
+ * offset/bytes list, see planIps() and planList(). patch offsets
+ * are relative to 'base'. expected before values of a list are
+ * added to plan 'before' when it is not NULL
+ *
+ */
+int planPatch(struct eeprom *ctx, struct plan *plan, struct plan *before, t_byte *data, int nLength, t_word base)
+{
+	if ( nLength >= IPS_MAGIC_LEN && memcmp(data, IPS_MAGIC, IPS_MAGIC_LEN) == 0 )
+		return planIps(ctx, plan, data, nLength, base);
+
+	return planList(ctx, plan, data, nLength, base, before);
+}
+
+/*
+ * planIps()
+ *
+ * add IPS patch of 'nLength' bytes to write plan
+ *
+ */
+int planIps(struct eeprom *ctx, struct plan *plan, t_byte *data, int nLength, t_word base)
+{
+	/*
+	 * 'PATCH' header, then records until the 'EOF' offset:
+	 * 3 byte offset, 2 byte size and 'size' data bytes, big endian.
+	 * size '0' is a run: 2 byte count and the byte to repeat.
+	 * a 3 byte truncate length after 'EOF' is ignored
+	 *
+	 */
+	t_byte	run[PAGE_SIZE];							// run record bytes, added a page at a time
+	t_byte	*bytes;
+	int		nPos = IPS_MAGIC_LEN;
+	int		nRecord = 0;
+	long	offset;
+	long	nSize;
+	long	i;
+	int		nResult;
+
+	for (;;)
+	{
+		if ( (nPos + 3) > nLength )
+		{
+			eepromError(ctx, EEPROM_EFORMAT, "planIps() patch ends without EOF marker");
+			return EEPROM_EFORMAT;
+		}
+
+		offset = ((long) data[nPos] << 16) | ((long) data[nPos + 1] << 8) | data[nPos + 2];
+		nPos += 3;
+
+		if ( offset == IPS_EOF )
+			break;
+
+		nRecord++;
+
+		if ( (nPos + 2) > nLength )
+			nSize = -1;
+		else
+		{
+			nSize = ((long) data[nPos] << 8) | data[nPos + 1];
+			nPos += 2;
+
+			if ( nSize == 0 )									// run record
+			{
+				if ( (nPos + 3) > nLength )
+					nSize = -1;
+				else
+				{
+					nSize = ((long) data[nPos] << 8) | data[nPos + 1];
+					memset(run, data[nPos + 2], PAGE_SIZE);
+					bytes = NULL;
+					nPos += 3;
+				}
+			}
+			else if ( (nPos + nSize) > nLength )
+				nSize = -1;
+			else
+			{
+				bytes = &data[nPos];
+				nPos += nSize;
+			}
+		}
+
+		if ( nSize < 0 )
+		{
+			eepromError(ctx, EEPROM_EFORMAT, "planIps() record %d truncated", nRecord);
+			return EEPROM_EFORMAT;
+		}
+
+		if ( (base + offset + nSize) > EEPROM_SIZE )
+		{
+			eepromError(ctx, EEPROM_ERANGE, "planIps() record %d offset 0x%lx out of range", nRecord, offset);
+			return EEPROM_ERANGE;
+		}
+
+		if ( bytes )
+		{
+			if ( (nResult = planAdd(ctx, plan, (t_word) (base + offset), bytes, (int) nSize)) )
+				return nResult;
+			continue;
+		}
+
+		for ( i = 0; i < nSize; i += PAGE_SIZE )
+		{
+			if ( (nResult = planAdd(ctx, plan, (t_word) (base + offset + i), run, (int) ((nSize - i) < PAGE_SIZE ? (nSize - i) : PAGE_SIZE))) )
+				return nResult;
+		}
+	}
+
+	return EEPROM_OK;
+}
+
+/*
+ * planList()
+ *
+ * add offset/bytes list patch of 'nLength' bytes to write plan.
+ * one hex offset and its hex bytes per line, optionally the
+ * expected before bytes and '->' ahead of the new bytes:
+ *     1ff0: 12 34 56 78
+ *     7ffc: ff ff -> 00 80
+ * bytes may run together, '#' starts a comment. before bytes
+ * are added to plan 'before' when it is not NULL
+ *
+ */
+int planList(struct eeprom *ctx, struct plan *plan, t_byte *data, int nLength, t_word base, struct plan *before)
+{
+	char	textLine[RECORD_LEN];
+	t_byte	bytes[2][RECORD_LEN / 2];
+	int		nCount[2];
+	int		nSide;
+	int		nPos = 0;
+	int		nLine = 0;
+	int		nByte;
+	char	*s;
+	char	*sEnd;
+	unsigned long	offset;
+	int		nResult;
+
+	while ( getRecord(data, nLength, &nPos, textLine) != -1 )
+	{
+		nLine++;
+
+		if ( (s = strchr(textLine, '#')) != NULL )				// strip comment
+			*s = '\0';
+
+		s = textLine + strspn(textLine, LIST_SPACE);
+		if ( *s == '\0' )										// skip blank lines
+			continue;
+
+		offset = strtoul(s, &sEnd, 16);
+		if ( sEnd == s || (*sEnd != ':' && *sEnd != '\0' && strchr(LIST_SPACE, *sEnd) == NULL) )
+		{
+			eepromError(ctx, EEPROM_EFORMAT, "planList() bad offset in line %d", nLine);
+			return EEPROM_EFORMAT;
+		}
+		s = sEnd + (*sEnd == ':');
+
+		nSide = 0;
+		nCount[0] = nCount[1] = 0;
+		for ( s += strspn(s, LIST_SPACE); *s; s += strspn(s, LIST_SPACE) )	// one word at a time
+		{
+			if ( strncmp(s, "->", 2) == 0 && nSide == 0 )
+			{
+				nSide = 1;
+				s += 2;
+				continue;
+			}
+
+			for ( ; *s && strchr(LIST_SPACE, *s) == NULL; s += 2 )
+			{
+				if ( (nByte = hexByte(s)) < 0 )
+				{
+					eepromError(ctx, EEPROM_EFORMAT, "planList() bad byte in line %d", nLine);
+					return EEPROM_EFORMAT;
+				}
+				bytes[nSide][nCount[nSide]++] = (t_byte) nByte;
+			}
+		}
+
+		if ( nCount[nSide] == 0 || (nSide && nCount[0] != nCount[1]) )
+		{
+			eepromError(ctx, EEPROM_EFORMAT, "planList() %s in line %d", nSide ? "before and new byte counts differ" : "no bytes", nLine);
+			return EEPROM_EFORMAT;
+		}
+
+		if ( (base + offset + nCount[nSide]) > EEPROM_SIZE )
+		{
+			eepromError(ctx, EEPROM_ERANGE, "planList() offset 0x%lx out of range in line %d", offset, nLine);
+			return EEPROM_ERANGE;
+		}
+
+		if ( (nResult = planAdd(ctx, plan, (t_word) (base + offset), bytes[nSide], nCount[nSide])) )
+			return nResult;
+
+		if ( nSide && before && (nResult = planAdd(ctx, before, (t_word) (base + offset), bytes[0], nCount[0])) )
+			return nResult;
+	}
+
+	return EEPROM_OK;
+}
+
+/*
+ * -----------------------------------------
+ * ----------  general functions  ----------
+ * -----------------------------------------
+ */
+
+/*
+ * readBlock()
+ *
+ * read a block of data of length 'nCount' from eeprom
+ * starting at 'address' into 'data'.
+ * return number of bytes read from eeprom.
+ *
+ */
+int readBlock(struct eeprom *ctx, t_word address, t_byte *data, int nCount)
+{
+	int	i;
+
+	for (i = 0; i < nCount; i++)
+	{
+		if ( (i + address) > (EEPROM_SIZE - 1) )	// test address for out of eeprom size range
+			break;
+
+		data[i] = readByte(ctx, (t_word) (i + address));	// read a byte from eeprom
+	}
+
+	return i;
+}
+
+/*
+ * writeBlock()
+ *
+ * write block of 'nCount' bytes from 'data' to eeprom
+ * starting at 'address'.
+ * return number of bytes written to eeprom.
+ *
+ */
+int writeBlock(struct eeprom *ctx, t_word address, t_byte *data, int nCount)
+{
+	int	i;
+	int nWriteResult;
+
+	for (i = 0; i < nCount; i++)
+	{
+		if ( (i + address) > (EEPROM_SIZE - 1) )				// test address for out of eeprom size range
+			break;
+
+		nWriteResult = writeByte(ctx, (t_word) (i + address), data[i]);	// write byte to eeprom
+
+		if ( nWriteResult )
+		{
+			eepromError(ctx, EEPROM_EWRITE, "eeprom write error %d at 0x%04x (data=0x%x)", nWriteResult, i + address, data[i]);
+			break;
+		}
+	}
+
+	return i;
+}
+
+/*
+ * writePage()
+ *
+ * load the bytes of page 'address' marked in 'used' within one
+ * byte load cycle window, DATA poll the last loaded byte until the
+ * page write cycle ends, then read back and verify all loaded bytes.
+ * return error code on write time-out or verify error, otherwise '0'
+ *
+ */
+int writePage(struct eeprom *ctx, t_word address, t_byte *data, t_byte *used)
+{
+	int		i;
+	int		nLast = -1;
+	int		nResult = WRITEOK;
+	long long	start = 0;
+	long long	cycle;
+	long long	timeout;
+
+	for ( i = 0; i < PAGE_SIZE; i++ )
+	{
+		if ( used[i] )
+			nLast = i;
+	}
+
+	if ( nLast < 0 )
+		return WRITEOK;
+
+	if ( ctx->nLatencyFlag )
+		start = getTimeNs();
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_PAGE, (t_word) (address + nLast), data[nLast]);
+
+	for ( i = 0; i <= nLast; i++ )						// load page, no delays between bytes
+	{
+		if ( used[i] )
+			fastByteWrite(ctx, (t_word) (address + i), data[i]);
+	}
+
+	cycle = portTime(ctx);
+	portDelay(ctx, ctx->nWriteUs);
+
+	timeout = cycle + WRITE_TIMEOUT;
+	while ( (readByte(ctx, (t_word) (address + nLast)) ^ data[nLast]) & 0x80 )	// DATA polling on last byte
+	{
+		if ( portTime(ctx) > timeout )
+		{
+			nResult = WRITETOV;
+			break;
+		}
+	}
+
+	cycle = portTime(ctx) - cycle;
+
+	for ( i = 0; i <= nLast && nResult == WRITEOK; i++ )	// verify
+	{
+		if ( used[i] && readByte(ctx, (t_word) (address + i)) != data[i] )
+			nResult = WRITEVER;
+	}
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_END, address, (t_byte) nResult);
+
+	if ( ctx->wear )
+		wearRecord(ctx->wear, address, cycle, nResult);
+
+	if ( ctx->nLatencyFlag )
+		latencyRecord(ctx, OP_PAGE, getTimeNs() - start);
+
+	return nResult;
+}
+
+/*
+ * isProgReady()
+ *
+ * performe loopback test through parallel port to
+ * check presence of programmer.
+ * loopback test selects Q7 on 74ls138 and tests state through
+ * bit 7 of parallel port's status register.
+ *
+ */
+int isProgReady(struct eeprom *ctx)
+{
+	t_byte	byte;
+	int		nData;
+	int		nResult = 0;
+
+	byte = portReadControl(ctx);			// make sure loopback test function is set
+	byte &= CLR_FUNC;
+	byte |= FUNC_LOOP;
+	byte |= SET_STROBE;
+	portWriteControl(ctx, byte);
+
+	nData = portReadStatus(ctx);			// read status
+	if ( nData & TEST )						// loopback bit is '1' then ok
+	{
+		byte &= CLR_STROBE;
+		portWriteControl(ctx, byte);		// set loopback bit to '0'
+		nData = portReadStatus(ctx);
+		if ( (nData & TEST) == 0 )			// loopback bit is '0' then ok
+			nResult = 1;
+	}
+
+	portWriteControl(ctx, CNTRL_INIT);
+
+	return nResult;
+}
+
+/*
+ * setAddress()
+ *
+ * set read/write address registers.
+ * a register already holding the needed value is not reloaded,
+ * consecutive addresses in a page only reload the low address register
+ * return '1' if address is out of range
+ *
+ */
+int setAddress(struct eeprom *ctx, t_word address, int nCS)
+{
+	t_byte byte;
+
+	if ( address >= EEPROM_SIZE )
+		return 1;								// exit if address is out of range
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_SETADDR, address, (nCS == CS_CLR));
+
+	byte = (t_byte) (address & 0x00ff);			// extract low address byte
+	if ( byte != ctx->nLatchLo )
+	{
+		portWriteData(ctx, byte);
+		selectFunc(ctx, FUNC_LOADD);
+		pulseStrobe(ctx);
+		ctx->nLatchLo = byte;
+	}
+
+	byte = (t_byte) ((address & 0xff00) >> 8);	// extract high address byte
+	if ( nCS == CS_CLR )						// CS state
+		byte &= CS_CLR;
+	else
+		byte |= CS_SET;
+	if ( byte != ctx->nLatchHi )
+	{
+		portWriteData(ctx, byte);
+		selectFunc(ctx, FUNC_HIADD);
+		pulseStrobe(ctx);
+		ctx->nLatchHi = byte;
+	}
+
+	return 0;
+}
+
+/*
+ * fastByteWrite()
+ *
+ * write 'byte' to 'address' without write verification
+ * use to load special eeprom commands
+ *
+ */
+void fastByteWrite(struct eeprom *ctx, t_word address, t_byte byte)
+{
+	long long	start = 0;
+
+	if ( ctx->nLatencyFlag )
+		start = getTimeNs();
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_FAST, address, byte);
+
+	setAddress(ctx, address, CS_CLR);						// setup write address and assert CS
+
+	selectFunc(ctx, FUNC_WE);								// select eeprom /WE function
+	portWriteData(ctx, byte);								// write data
+	pulseStrobe(ctx);										// pulse /WE line to program
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_END, address, 0);
+
+	if ( ctx->nLatencyFlag )
+		latencyRecord(ctx, OP_FAST, getTimeNs() - start);
+}
+
+/*
+ * void	writeByte(int);
+ *
+ * write a byte to the eeprom at 'address'
+ * return error code on write time-out of verify error, otherwise
+ * returns '0'
+ *
+ */
+int writeByte(struct eeprom *ctx, t_word address, t_byte byte)
+{
+	t_byte readTest = 1;
+	t_byte readBack;
+	int nResult = WRITEOK;
+	long long	start = 0;
+	long long	cycle;
+	long long	timeout;
+
+	if ( ctx->nLatencyFlag )
+		start = getTimeNs();
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_WRITE, address, byte);
+
+	setAddress(ctx, address, CS_CLR);						// setup write address and assert CS
+
+	selectFunc(ctx, FUNC_WE);								// select eeprom /WE function
+	portWriteData(ctx, byte);								// write data
+	pulseStrobe(ctx);										// pulse /WE line to program
+
+	cycle = portTime(ctx);									// write cycle starts
+	portDelay(ctx, ctx->nWriteUs);
+
+	setAddress(ctx, address, CS_SET);						// negate CS
+
+	timeout = cycle + WRITE_TIMEOUT;
+	while ( readTest )									// read-test for inverted I/O7 bit
+	{
+		readBack = readByte(ctx, address);					// read back the byte
+		
+		readTest = readBack;							// isolate bit.7
+		readTest ^= byte;
+		readTest &= 0x80;
+
+		//printf("readBack %x, readTest %x\n", readBack, readTest);
+
+		if ( portTime(ctx) > timeout )					// typical write time is about 3mSec
+		{
+			nResult = WRITETOV;							// timed out while waiting for bit.7 to negate
+			break;
+		}
+	}
+
+	if ( (nResult == WRITEOK) && (readBack != byte) )	// check if write is good and verified
+		nResult = WRITEVER;
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_END, address, (t_byte) nResult);
+
+	if ( ctx->wear )
+		wearRecord(ctx->wear, address, portTime(ctx) - cycle, nResult);
+
+	if ( ctx->nLatencyFlag )
+		latencyRecord(ctx, OP_WRITE, getTimeNs() - start);
+
+	return nResult;
+}
+
+/*
+ * readByte()
+ *
+ * read a byte from the eeprom at 'address'
+ *
+ */
+t_byte readByte(struct eeprom *ctx, t_word address)
+{
+	t_byte byte;
+	long long	start = 0;
+
+	if ( ctx->nLatencyFlag )
+		start = getTimeNs();
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_READ, address, 0);
+
+	setAddress(ctx, address, CS_CLR);				// setup read address and assert CS
+
+	portDataDir(ctx, DIR_READ);						// disable port line drivers
+
+	selectFunc(ctx, FUNC_OE);						// select eeprom /OE function
+	clrStrobe(ctx);								// activate /OE
+	portDelay(ctx, ctx->nSettleUs);
+	byte = portReadData(ctx);						// read data
+	setStrobe(ctx);								// deactivate /OE
+
+	portDataDir(ctx, DIR_WRITE);					// enable port line drivers
+
+	setAddress(ctx, address, CS_SET);				// negate CS
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_END, address, byte);
+
+	if ( ctx->nLatencyFlag )
+		latencyRecord(ctx, OP_READ, getTimeNs() - start);
+
+	return byte;
+}
+
+/*
+ * setStrobe()
+ *
+ * set strobe line high
+ *
+ */
+void setStrobe(struct eeprom *ctx)
+{
+	unsigned char byte;
+
+	byte = portReadControl(ctx);
+
+	byte |= SET_STROBE;
+	portWriteControl(ctx, byte);
+}
+
+/*
+ * clrStrobe()
+ *
+ * set strobe line low
+ *
+ */
+void clrStrobe(struct eeprom *ctx)
+{
+	unsigned char byte;
+
+	byte = portReadControl(ctx);
+
+	byte &= CLR_STROBE;
+	portWriteControl(ctx, byte);
+}
+
+/*
+ * pulseStrobe()
+ *
+ * pulse the strobe line
+ *
+ */
+void pulseStrobe(struct eeprom *ctx)
+{
+	setStrobe(ctx);
+	clrStrobe(ctx);
+	setStrobe(ctx);
+}
+
+/*
+ * selectFunc()
+ *
+ * select programer function
+ *
+ */
+void selectFunc(struct eeprom *ctx, int nFunc)
+{
+	t_byte byte;
+
+	byte = portReadControl(ctx);
+	byte &= CLR_FUNC;
+	byte |= (t_byte) nFunc;
+	portWriteControl(ctx, byte);
+}
+
+/*
+ * -----------------------------------------
+ * --------  port access functions  --------
+ * -----------------------------------------
+ */
+
+/*
+ * portWriteData()
+ *
+ * all programer port accesses go through these functions,
+ * they are counted, recorded when the context has a trace recorder
+ * and go to the emulated programer when the context has one
+ *
+ */
+static void portWriteData(struct eeprom *ctx, t_byte byte)
+{
+	ctx->nPortOps[PORT_WDATA]++;
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_DATA, 0, byte);
+
+	if ( ctx->emu )
+	{
+		ctx->clock += ctx->model->portNs[PORT_WDATA];
+		emuWriteData(ctx->emu, byte);
+	}
+	else
+		ieee1284_write_data(ctx->port, (unsigned char) byte);
+}
+
+/*
+ * portWriteControl()
+ *
+ */
+static void portWriteControl(struct eeprom *ctx, t_byte byte)
+{
+	ctx->nPortOps[PORT_WCONTROL]++;
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_CONTROL, 0, byte);
+
+	if ( ctx->emu )
+	{
+		ctx->clock += ctx->model->portNs[PORT_WCONTROL];
+		emuWriteControl(ctx->emu, byte, ctx->clock);
+	}
+	else
+		ieee1284_write_control(ctx->port, (unsigned char) byte);
+}
+
+/*
+ * portReadControl()
+ *
+ * control register read back is not a bus event and is not recorded
+ *
+ */
+static t_byte portReadControl(struct eeprom *ctx)
+{
+	ctx->nPortOps[PORT_RCONTROL]++;
+
+	if ( ctx->emu )
+	{
+		ctx->clock += ctx->model->portNs[PORT_RCONTROL];
+		return ctx->emu->control;
+	}
+
+	return (t_byte) ieee1284_read_control(ctx->port);
+}
+
+/*
+ * portReadData()
+ *
+ */
+static t_byte portReadData(struct eeprom *ctx)
+{
+	t_byte	byte;
+
+	ctx->nPortOps[PORT_RDATA]++;
+
+	if ( ctx->emu )
+	{
+		ctx->clock += ctx->model->portNs[PORT_RDATA];
+		byte = (t_byte) emuReadData(ctx->emu, ctx->clock);
+	}
+	else
+		byte = (t_byte) ieee1284_read_data(ctx->port);
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_RDATA, 0, byte);
+
+	return byte;
+}
+
+/*
+ * portReadStatus()
+ *
+ */
+static t_byte portReadStatus(struct eeprom *ctx)
+{
+	t_byte	byte;
+
+	ctx->nPortOps[PORT_RSTATUS]++;
+
+	if ( ctx->emu )
+	{
+		ctx->clock += ctx->model->portNs[PORT_RSTATUS];
+		byte = (t_byte) emuReadStatus(ctx->emu);
+	}
+	else
+		byte = (t_byte) ieee1284_read_status(ctx->port);
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_STATUS, 0, byte);
+
+	return byte;
+}
+
+/*
+ * portDataDir()
+ *
+ */
+static void portDataDir(struct eeprom *ctx, int nDir)
+{
+	ctx->nPortOps[PORT_DIR]++;
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_DIR, 0, (nDir != DIR_WRITE));
+
+	if ( ctx->emu )
+	{
+		ctx->clock += ctx->model->portNs[PORT_DIR];
+		emuDataDir(ctx->emu, nDir != DIR_WRITE);
+	}
+	else
+		ieee1284_data_dir(ctx->port, nDir);
+}
+
+/*
+ * portTime()
+ *
+ * return bus time in nano-seconds: the emulated clock when
+ * emulating, so time-outs follow the latency model, otherwise host time
+ *
+ */
+long long portTime(struct eeprom *ctx)
+{
+	if ( ctx->emu )
+		return ctx->clock;
+
+	return getTimeNs();
+}
+
+/*
+ * portDelay()
+ *
+ * wait 'nMicroSec' micro-seconds. short delays spin on the clock,
+ * a sleep that short would overrun several times over on timer slack
+ * and wake up latency
+ *
+ */
+static void portDelay(struct eeprom *ctx, unsigned int nMicroSec)
+{
+	long long	end;
+
+	ctx->nDelays++;
+	ctx->delayUs += nMicroSec;
+
+	if ( ctx->trace )
+		traceEvent(ctx->trace, TRACE_DELAY, (t_word) nMicroSec, 0);
+
+	if ( ctx->emu )
+	{
+		ctx->clock += (long long) nMicroSec * 1000;
+		if ( nMicroSec > SPIN_MAX )
+			ctx->clock += ctx->model->sleepNs;
+	}
+	else if ( nMicroSec <= SPIN_MAX )
+	{
+		end = getTimeNs() + (long long) nMicroSec * 1000;
+		while ( getTimeNs() < end )
+			;
+	}
+	else
+		usleep(nMicroSec);
+}
+
+/*
+ * portBenchmark()
+ *
+ * time 'nSamples' calls of each port access type on the claimed
+ * port and the overrun of a 1ms delay, store median and 99th percentile
+ * latency into the port and sleep fields of 'median' and 'p99'.
+ * the programer is parked on its loop test function with strobe
+ * inactive and control writes repeat that value, so no register
+ * is clocked and the eeprom is not accessed.
+ * return '0' on success
+ *
+ */
+int portBenchmark(struct eeprom *ctx, int nSamples, struct station *median, struct station *p99)
+{
+	long long	*samples;
+	long long	start;
+	long long	clockNs;
+	int			nOp;
+	int			i;
+
+	if ( nSamples < SLEEP_SAMPLES || (samples = malloc(nSamples * sizeof(long long))) == NULL )
+		return 1;
+
+	portWriteControl(ctx, CNTRL_INIT);					// park programer
+
+	for ( i = 0; i < nSamples; i++ )					// cost of reading the clock
+	{
+		start = getTimeNs();
+		samples[i] = getTimeNs() - start;
+	}
+	qsort(samples, nSamples, sizeof(long long), compareNs);
+	clockNs = samples[nSamples / 2];
+
+	for ( nOp = 0; nOp < PORT_OPS; nOp++ )
+	{
+		for ( i = 0; i < nSamples; i++ )
+		{
+			start = getTimeNs();
+			switch ( nOp )
+			{
+				case PORT_WDATA:
+					portWriteData(ctx, DATA_INIT);
+					break;
+
+				case PORT_WCONTROL:
+					portWriteControl(ctx, CNTRL_INIT);
+					break;
+
+				case PORT_RCONTROL:
+					portReadControl(ctx);
+					break;
+
+				case PORT_RDATA:
+					portReadData(ctx);
+					break;
+
+				case PORT_RSTATUS:
+					portReadStatus(ctx);
+					break;
+
+				case PORT_DIR:
+					portDataDir(ctx, (i & 1) ? DIR_WRITE : DIR_READ);
+					break;
+			}
+			samples[i] = getTimeNs() - start - clockNs;
+		}
+
+		qsort(samples, nSamples, sizeof(long long), compareNs);
+		median->portNs[nOp] = (samples[nSamples / 2] > 0) ? samples[nSamples / 2] : 0;
+		p99->portNs[nOp] = (samples[nSamples * 99 / 100] > 0) ? samples[nSamples * 99 / 100] : 0;
+	}
+
+	portDataDir(ctx, DIR_WRITE);
+
+	for ( i = 0; i < SLEEP_SAMPLES; i++ )
+	{
+		start = getTimeNs();
+		portDelay(ctx, 1000);
+		samples[i] = getTimeNs() - start - 1000000 - clockNs;
+	}
+
+	qsort(samples, SLEEP_SAMPLES, sizeof(long long), compareNs);
+	median->sleepNs = (samples[SLEEP_SAMPLES / 2] > 0) ? samples[SLEEP_SAMPLES / 2] : 0;
+	p99->sleepNs = (samples[SLEEP_SAMPLES - 1] > 0) ? samples[SLEEP_SAMPLES - 1] : 0;
+
+	free(samples);
+
+	return 0;
+}
+
+/*
+ * compareNs()
+ *
+ * qsort() compare function of nano-second samples
+ *
+ */
+static int compareNs(const void *a, const void *b)
+{
+	long long	x = *(const long long*) a;
+	long long	y = *(const long long*) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * -----------------------------------------
+ * ----  real-time and latency functions  --
+ * -----------------------------------------
+ */
+
+/*
+ * rtEnter()
+ *
+ * prepare the calling thread for a jitter free bus loop:
+ * lock all current and future memory, pre-fault the stack,
+ * pin the thread to CPU 'ctx->nRtCpu' and switch to SCHED_FIFO at 'ctx->nRtPriority'.
+ * a RLIMIT_RTTIME soft limit is set so a runaway real-time loop gets SIGXCPU
+ * instead of locking up the CPU, the process limit is restored when the
+ * last context leaves real-time mode.
+ * return '0' on success, EEPROM_ERT on failure with original scheduling state restored
+ *
+ */
+int rtEnter(struct eeprom *ctx)
+{
+	cpu_set_t		cpus;
+	struct	sched_param	param;
+	struct	rlimit		limit;
+	volatile t_byte	stack[RT_STACK];
+
+	ctx->nRtPolicy = sched_getscheduler(0);					// save state for rtLeave()
+	sched_getparam(0, &ctx->rtSavedParam);
+	sched_getaffinity(0, sizeof(cpu_set_t), &ctx->rtSavedCpus);
+
+	pthread_mutex_lock(&rtLock);
+	if ( nRtUsers == 0 )
+	{
+		if ( mlockall(MCL_CURRENT | MCL_FUTURE) )
+		{
+			pthread_mutex_unlock(&rtLock);
+			eepromError(ctx, EEPROM_ERT, "rtEnter() mlockall() failed (errno=%d)", errno);
+			return EEPROM_ERT;
+		}
+
+		getrlimit(RLIMIT_RTTIME, &rtSavedLimit);			// bound real-time CPU time without a blocking call
+		limit = rtSavedLimit;
+		limit.rlim_cur = (rlim_t) RT_CPU_SEC * 1000000;
+		if ( limit.rlim_max != RLIM_INFINITY && limit.rlim_cur > limit.rlim_max )
+			limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_RTTIME, &limit);
+	}
+	nRtUsers++;
+	pthread_mutex_unlock(&rtLock);
+
+	memset((void*) stack, 0, RT_STACK);					// pre-fault stack pages while locked
+
+	CPU_ZERO(&cpus);
+	CPU_SET(ctx->nRtCpu, &cpus);
+	if ( sched_setaffinity(0, sizeof(cpu_set_t), &cpus) )
+	{
+		eepromError(ctx, EEPROM_ERT, "rtEnter() sched_setaffinity() failed (errno=%d)", errno);
+		rtUnlock();
+		return EEPROM_ERT;
+	}
+
+	param.sched_priority = ctx->nRtPriority;
+	if ( sched_setscheduler(0, SCHED_FIFO, &param) )
+	{
+		eepromError(ctx, EEPROM_ERT, "rtEnter() sched_setscheduler() failed (errno=%d)", errno);
+		sched_setaffinity(0, sizeof(cpu_set_t), &ctx->rtSavedCpus);
+		rtUnlock();
+		return EEPROM_ERT;
+	}
+
+	return 0;
+}
+
+/*
+ * rtLeave()
+ *
+ * restore scheduling policy, priority, CPU affinity
+ * saved by rtEnter() for the calling thread, memory locking
+ * and RLIMIT_RTTIME when it is the last real-time context
+ *
+ */
+void rtLeave(struct eeprom *ctx)
+{
+	sched_setscheduler(0, ctx->nRtPolicy, &ctx->rtSavedParam);
+	sched_setaffinity(0, sizeof(cpu_set_t), &ctx->rtSavedCpus);
+	rtUnlock();
+}
+
+/*
+ * rtUnlock()
+ *
+ * unlock process memory and restore the RLIMIT_RTTIME limit
+ * when the last context leaves real-time mode
+ *
+ */
+static void rtUnlock(void)
+{
+	pthread_mutex_lock(&rtLock);
+	if ( --nRtUsers == 0 )
+	{
+		setrlimit(RLIMIT_RTTIME, &rtSavedLimit);
+		munlockall();
+	}
+	pthread_mutex_unlock(&rtLock);
+}
+
+/*
+ * getTimeNs()
+ *
+ * return monotonic clock time stamp in nano-seconds
+ *
+ */
+long long getTimeNs(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long long) ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+/*
+ * latencyRecord()
+ *
+ * add an operation latency in nano-seconds to the operation type's
+ * histogram. bin 0 holds latencies below 1us, bin 'n' holds
+ * latencies between 2^(n-1)us and 2^n us, last bin collects the rest
+ *
+ */
+void latencyRecord(struct eeprom *ctx, int nOp, long long nLatency)
+{
+	struct latency	*lat = &ctx->latency[nOp];
+	long long		us;
+	int				bin = 0;
+
+	for ( us = nLatency / 1000; us > 0 && bin < (HIST_BINS - 1); us >>= 1 )
+		bin++;
+
+	lat->bins[bin]++;
+	lat->total += nLatency;
+	if ( lat->count == 0 || nLatency < lat->min )
+		lat->min = nLatency;
+	if ( nLatency > lat->max )
+		lat->max = nLatency;
+	lat->count++;
+}
@@ -0,0 +1,213 @@
+/*
+ * eeprom.h
+ *
+ *      Purpose:
+ *
+ *      ATMEL 27C256 32Kx8 eeprom programmer library
+ *      using IEEE-1284 parallel port interface
+ *
+ *      all programer state lives in a 'struct eeprom' context, one per
+ *      programer, so several programers can be driven from one process.
+ *      a context must only be used by one thread at a time.
+ *
+ *      context usage sequence:
+ *      1. eepromInit()		set defaults, then set callbacks and options
+ *      2. eepromOpen()		open, claim and initialize the programer port
+ *      3. isProgReady(), readEEPROM(), writeEEPROM(), eraseEEPROM() ...
+ *      4. eepromClose()	release and close the port
+ *
+ *      eepromEmulate() replaces step 2 for a dry run: the port accesses
+ *      go to an emulated programer on a virtual clock advanced by the
+ *      station latency model, delays do not sleep.
+ *
+ */
+
+#ifndef __EEPROM_H__
+#define __EEPROM_H__
+
+#include <sched.h>
+
+#include <ieee1284.h>
+
+#include "image.h"
+
+/*
+ * definitions
+ */
+#define EEPROM_SIZE	0x8000		// ATMEL 27C256 eeprom size 32Kx8
+#define DATA_BUFFER 1024		// block size for progress reporting
+#define PAGE_SIZE	64			// eeprom page write size
+#define PAGES		(EEPROM_SIZE / PAGE_SIZE)
+
+#define IPS_MAGIC		"PATCH"	// IPS patch header
+#define IPS_MAGIC_LEN	5
+#define IPS_EOF			0x454f46	// IPS end of patch offset, 'EOF'
+
+#define EEPROM_OK		0		// library function return codes
+#define EEPROM_ERANGE	1		// address out of eeprom range
+#define EEPROM_EWRITE	2		// write time-out or verify error
+#define EEPROM_EFORMAT	3		// bad image record or checksum
+#define EEPROM_EPORT	4		// port open, claim or programer test failed
+#define EEPROM_ERT		5		// real-time mode setup failed
+#define EEPROM_EFILE	6		// image file error or out of memory
+
+#define DEF_SETTLE_US	10		// default bus delays in micro-seconds, worst case for any station and chip:
+#define DEF_WRITE_US	1000	// /OE settle before a read, wait after a write pulse before DATA polling
+#define DEF_ERASE_US	20000	// and wait after each 64 byte erase burst
+
+#define WRITEOK		0			// eeprom write byte with no error
+#define WRITETOV	1			// eeprom waiting for bit.7 negate time out
+#define WRITEVER	2			// eeprom write/verify miscompare
+
+#define RT_PRIO_DEF	50			// default SCHED_FIFO priority of the bus loop
+#define RT_PRIO_MAX	80			// priority bound, stay below kernel IRQ threads (default 50..99 range)
+
+#define OP_READ		0			// latency histogram operation types
+#define OP_WRITE	1
+#define OP_FAST		2
+#define OP_PAGE		3
+#define OP_TYPES	4
+
+#define PORT_WDATA		0		// port access types, counted per context
+#define PORT_WCONTROL	1
+#define PORT_RCONTROL	2
+#define PORT_RDATA		3
+#define PORT_RSTATUS	4
+#define PORT_DIR		5
+#define PORT_OPS		6
+
+#define HIST_BINS	20			// log2 latency bins: <1us, 1-2us, 2-4us ... >=256ms
+
+/*
+ * type definitions
+ */
+struct eeprom;
+struct trace;
+struct wear;
+struct emu;
+struct station;
+
+typedef void (*t_progress)(struct eeprom*, const char*, long, long);	// action name, bytes done, bytes total
+typedef void (*t_error)(struct eeprom*, int, const char*);			// error code, EEPROM_OK for a note, and message text
+
+struct latency								// per-operation latency histogram
+{
+	long		count;
+	long long	total;
+	long long	min;
+	long long	max;
+	long		bins[HIST_BINS];
+};
+
+struct eeprom								// programer context
+{
+	struct parport	*port;					// claimed ieee1284 programer interface port
+
+	t_progress		progress;				// optional progress callback
+	t_error			error;					// optional error callback
+	void			*user;					// caller data for callbacks
+
+	int				nRtCpu;					// real-time mode CPU, -1 real-time mode disabled
+	int				nRtPriority;			// real-time mode SCHED_FIFO priority
+	int				nRtPolicy;				// scheduling state saved by rtEnter()
+	struct sched_param	rtSavedParam;
+	cpu_set_t		rtSavedCpus;
+
+	int				nLatencyFlag;			// collect per-operation latency statistics
+	struct latency	latency[OP_TYPES];
+
+	struct trace	*trace;					// optional bus trace recorder, see trace.h
+	struct wear		*wear;					// optional write cycle wear map, see wear.h
+
+	int				nPageMode;				// write a page per write cycle, '0' a byte per write cycle
+	int				nFill;					// fill byte for unused bytes of written pages, '-1' no fill
+	int				nForce;					// write even if the eeprom already holds the image
+	int				nFormat;				// image format of planned input, '0' detect it from the first record
+	int				nLatchLo;				// address register contents, '-1' unknown
+	int				nLatchHi;
+
+	unsigned int	nSettleUs;				// bus delays in micro-seconds, station profile or tuned
+	unsigned int	nWriteUs;
+	unsigned int	nEraseUs;
+
+	long			nPortOps[PORT_OPS];		// port accesses by type
+	long			nDelays;				// delays and their requested micro-seconds
+	long long		delayUs;
+
+	struct emu		*emu;					// emulated programer instead of 'port', see emu.h
+	struct station	*model;					// latency model advancing 'clock' in emulation
+	long long		clock;					// emulation virtual time in nano-seconds
+};
+
+struct plan									// address ordered write plan
+{
+	t_byte			data[EEPROM_SIZE];
+	t_byte			used[EEPROM_SIZE];		// '1' where 'data' holds a byte to write
+	long			nBytes;					// bytes to write
+	long			nDuplicates;			// repeated bytes in overlapping records
+	long			nFilled;				// bytes added by page fill
+	int				nPages;					// pages holding bytes to write
+	t_word			pages[PAGES];			// their start addresses, ascending
+	long			nFallbacks;				// pages rewritten a byte at a time after page write failed
+	int				nCurrent;				// eeprom already held the plan, nothing was written
+	unsigned long long	digest;				// plan digest, see checkPlan()
+};
+
+/*
+ * function prototypes
+ */
+
+// -- context functions --
+void	eepromInit(struct eeprom*);		// set context defaults
+int		eepromOpen(struct eeprom*, struct parport*);	// open, claim and initialize programer port
+int		eepromEmulate(struct eeprom*, struct emu*, struct station*);	// use emulated programer on a virtual clock
+void	eepromClose(struct eeprom*);	// release and close programer port
+void	eepromMessage(void*, int, const char*);	// image library message callback, 'void*' is the context
+
+// -- programer functions --
+int		readEEPROM(struct eeprom*, t_word, t_word, t_byte*);	// read eeprom address range into memory
+int		readRanges(struct eeprom*, t_byte*, t_byte*);	// read marked addresses into memory, ascending
+int		writeEEPROM(struct eeprom*, t_byte*, int, t_word);		// write binary, S-record or Intel HEX image
+int		eraseEEPROM(struct eeprom*);	// erase eeprom programer function
+void	eraseBlock(struct eeprom*, t_word);	// erase 64 byte block burst
+void	waitWrite(struct eeprom*);		// wait out a write cycle that may still run
+
+// -- planner functions --
+void	planInit(struct plan*);			// clear write plan
+int		planImage(struct eeprom*, struct plan*, t_byte*, int, t_word);	// add binary, S-record or Intel HEX image to plan
+int		planAdd(struct eeprom*, struct plan*, t_word, t_byte*, int);	// add bytes to plan, reject conflicting overlaps
+int		planBin(struct eeprom*, struct plan*, t_byte*, int, t_word);	// add binary image to plan
+int		planSrec(struct eeprom*, struct plan*, t_byte*, int);	// add S-rec image to plan
+int		planIhex(struct eeprom*, struct plan*, t_byte*, int);	// add Intel HEX image to plan
+int		planPatch(struct eeprom*, struct plan*, struct plan*, t_byte*, int, t_word);	// add IPS or offset/bytes list patch to plan
+int		planIps(struct eeprom*, struct plan*, t_byte*, int, t_word);	// add IPS patch to plan
+int		planList(struct eeprom*, struct plan*, t_byte*, int, t_word, struct plan*);	// add offset/bytes list patch to plan
+void	planBuild(struct plan*, int);	// list pages to write, optional page fill
+int		writePlan(struct eeprom*, struct plan*);	// write planned pages in address order
+long	verifyPlan(struct eeprom*, struct plan*);	// count planned bytes that differ on eeprom
+int		checkPlan(struct eeprom*, struct plan*);	// sample and full check if eeprom holds plan
+unsigned long long	planDigest(struct plan*);	// digest of planned addresses and bytes
+
+// -- general functions --
+int		readBlock(struct eeprom*, t_word, t_byte*, int);	// read a block from eeprom starting at address
+int		writeBlock(struct eeprom*, t_word, t_byte*, int);	// write block to eeprom starting at address
+int		writePage(struct eeprom*, t_word, t_byte*, t_byte*);	// write bytes of one page in one write cycle
+int		isProgReady(struct eeprom*);	// return true if programmer passes loop test
+int		setAddress(struct eeprom*, t_word, int);	// set read/write address registers
+void	fastByteWrite(struct eeprom*, t_word, t_byte);	// write byte to address without read verification
+int		writeByte(struct eeprom*, t_word, t_byte);	// write byte to address
+t_byte	readByte(struct eeprom*, t_word);	// read byte from address
+void    setStrobe(struct eeprom*);		// set strobe line
+void	clrStrobe(struct eeprom*);		// clear strobe line
+void	pulseStrobe(struct eeprom*);	// pulse the strobe line
+void	selectFunc(struct eeprom*, int);	// select programer function
+int		portBenchmark(struct eeprom*, int, struct station*, struct station*);	// measure port access latency
+
+// -- real-time and latency functions --
+int		rtEnter(struct eeprom*);		// lock memory, pin CPU and switch to SCHED_FIFO
+void	rtLeave(struct eeprom*);		// restore scheduling state saved by rtEnter()
+long long	getTimeNs(void);			// monotonic time stamp in nano-seconds
+long long	portTime(struct eeprom*);	// bus time, emulated clock or host clock
+void	latencyRecord(struct eeprom*, int, long long);	// record an operation latency into its histogram
+
+#endif /* __EEPROM_H__ */
@@ -0,0 +1,346 @@
+/*
+ * emu.c
+ *
+ *      Purpose:
+ *
+ *      emulated programmer hardware and ATMEL 27C256 32Kx8 eeprom chip.
+ *
+ *      programer model, see port bit assignments in eeprom.c:
+ *      the strobe line enables the 74ls138 function decoder, the address
+ *      registers are clocked when the decoder output goes active,
+ *      /WE and /OE follow the decoder output while it is active.
+ *
+ *      chip model:
+ *      a byte is loaded into the page buffer on the rising edge of /WE
+ *      while /CS is asserted. further bytes loaded within the byte load cycle
+ *      window join the page, all of them are written into the page of the
+ *      last loaded byte when the window expires. the page write cycle then
+ *      runs for 'writeNs', reads during the load window and the write cycle
+ *      return DATA polling (inverted bit 7 of the last loaded byte), and
+ *      byte loads during the write cycle are ignored.
+ *
+ *      fault injection, for testing the statistics of soak mode:
+ *      written bytes get a random bit flipped at a given rate, write cycles
+ *      run longer at a given rate, EMU_SLOW times by default, and one cell can have
+ *      stuck bits. faults are off after emuInit(), see emuFaults().
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "emu.h"
+
+/*
+ * local function prototypes
+ */
+static void	emuUpdate(struct emu*, long long);	// commit an expired page load window
+static long		emuRandom(struct emu*);				// next fault pseudo random number
+
+/*
+ * local definitions
+ */
+#define STROBE		0x01		// control port strobe bit
+#define FUNC(c)		(((c) >> 1) & 0x07)	// decoder function select F2 F1 F0
+
+#define F_LOADD		0			// decoder outputs
+#define F_HIADD		1
+#define F_WE		2
+#define F_OE		3
+#define F_LOOP		7
+
+#define CS_BIT		0x80		// /CS in high address register
+#define LOOP_BIT	0x80		// status loopback bit
+
+#define DATA_INIT	0xff		// power up port states
+#define CNTRL_INIT	0x0f
+
+#define FAULT_SEED	0x9e3779b97f4a7c15ULL	// default fault pseudo random seed
+
+/*
+ * emuInit()
+ *
+ * reset emulated programer and chip.
+ * 'nErased' set: chip is blank, all 0xff
+ * 'nErased' clear: chip contents are unknown until written,
+ * for use by replay which learns them from traced reads
+ *
+ */
+void emuInit(struct emu *emu, int nErased)
+{
+	memset(emu, 0, sizeof(struct emu));
+
+	emu->data = DATA_INIT;
+	emu->control = CNTRL_INIT;
+	emu->hiAddr = CS_BIT;
+	emu->blcNs = EMU_BLC_NS;
+	emu->writeNs = EMU_WRITE_NS;
+	emu->faultSeed = FAULT_SEED;
+
+	if ( nErased )
+	{
+		memset(emu->mem, 0xff, EEPROM_SIZE);
+		memset(emu->valid, 1, EEPROM_SIZE);
+	}
+}
+
+/*
+ * emuWriteData()
+ *
+ * host writes data port
+ *
+ */
+void emuWriteData(struct emu *emu, t_byte byte)
+{
+	emu->data = byte;
+}
+
+/*
+ * emuWriteControl()
+ *
+ * host writes control port at time 'now',
+ * strobe edges clock the address registers and /WE
+ *
+ */
+void emuWriteControl(struct emu *emu, t_byte byte, long long now)
+{
+	int		nActive;
+	int		nWasActive;
+	t_word	address;
+
+	emuUpdate(emu, now);
+
+	nWasActive = (emu->control & STROBE) == 0;
+	nActive = (byte & STROBE) == 0;
+
+	if ( nActive && !nWasActive )						// decoder output goes active
+	{
+		switch ( FUNC(byte) )
+		{
+			case F_LOADD:
+				emu->loAddr = emu->data;
+				break;
+
+			case F_HIADD:
+				emu->hiAddr = emu->data;
+				break;
+		}
+	}
+	else if ( nWasActive && !nActive && FUNC(emu->control) == F_WE && (emu->hiAddr & CS_BIT) == 0 )
+	{
+		address = emuAddress(emu);						// /WE rising edge loads a byte
+
+		if ( now < emu->busyUntil && emu->nPageBytes == 0 )
+		{
+			emu->nBusyWrites++;
+		}
+		else
+		{
+			emu->pageAddress = address & ~(EMU_PAGE - 1);
+			emu->page[address % EMU_PAGE] = emu->data;
+			emu->pageUsed[address % EMU_PAGE] = 1;
+			emu->nPageBytes++;
+			emu->lastByte = emu->data;
+			emu->loadTime = now;
+			emu->busyUntil = now + emu->blcNs + emu->writeNs;
+			emu->nLoads++;
+		}
+	}
+
+	emu->control = byte;
+}
+
+/*
+ * emuReadData()
+ *
+ * host reads data port at time 'now'.
+ * chip drives the data lines when /OE and /CS are active
+ * and the host drivers are off, otherwise the host reads back its own data
+ *
+ */
+int emuReadData(struct emu *emu, long long now)
+{
+	t_word	address;
+
+	emuUpdate(emu, now);
+
+	if ( !emu->nDirRead || (emu->control & STROBE) || FUNC(emu->control) != F_OE || (emu->hiAddr & CS_BIT) )
+		return emu->data;
+
+	if ( now < emu->busyUntil )							// DATA polling
+	{
+		emu->nPolls++;
+		return (~emu->lastByte & 0x80) | (emu->lastByte & 0x7f);
+	}
+
+	address = emuAddress(emu);
+
+	return emu->mem[address];
+}
+
+/*
+ * emuReadStatus()
+ *
+ * host reads status port, the loop test function
+ * reflects the strobe line on bit 7
+ *
+ */
+int emuReadStatus(struct emu *emu)
+{
+	if ( FUNC(emu->control) == F_LOOP && (emu->control & STROBE) )
+		return LOOP_BIT;
+
+	return 0;
+}
+
+/*
+ * emuDataDir()
+ *
+ * host sets data port direction, non zero 'nRead' disables host drivers
+ *
+ */
+void emuDataDir(struct emu *emu, int nRead)
+{
+	emu->nDirRead = (nRead != 0);
+}
+
+/*
+ * emuAddress()
+ *
+ * return eeprom address held in address registers
+ *
+ */
+t_word emuAddress(struct emu *emu)
+{
+	return (t_word) (((emu->hiAddr & 0x7f) << 8) | emu->loAddr);
+}
+
+/*
+ * emuBusy()
+ *
+ * return '1' if a page load window or write cycle is in progress at time 'now'
+ *
+ */
+int emuBusy(struct emu *emu, long long now)
+{
+	emuUpdate(emu, now);
+
+	return (now < emu->busyUntil);
+}
+
+/*
+ * emuUpdate()
+ *
+ * when the page load window has expired by time 'now' write
+ * the loaded bytes into the page of the last loaded byte
+ *
+ */
+static void emuUpdate(struct emu *emu, long long now)
+{
+	int		i;
+	t_byte	byte;
+
+	if ( emu->nPageBytes == 0 || now < (emu->loadTime + emu->blcNs) )
+		return;
+
+	for ( i = 0; i < EMU_PAGE; i++ )
+	{
+		if ( emu->pageUsed[i] )
+		{
+			byte = emu->page[i];
+
+			if ( emu->nFlipRate && emuRandom(emu) % emu->nFlipRate == 0 )
+			{
+				byte ^= (t_byte) (1 << (emuRandom(emu) % 8));
+				emu->nFlips++;
+			}
+
+			if ( emu->stuckMask && (emu->pageAddress + i) == emu->stuckAddress )
+				byte = (byte & ~emu->stuckMask) | (emu->stuckValue & emu->stuckMask);
+
+			emu->mem[emu->pageAddress + i] = byte;
+			emu->valid[emu->pageAddress + i] = 1;
+			emu->pageUsed[i] = 0;
+		}
+	}
+
+	if ( emu->nSlowRate && emuRandom(emu) % emu->nSlowRate == 0 )
+	{
+		emu->busyUntil += (emu->slowNs ? emu->slowNs : EMU_SLOW * emu->writeNs) - emu->writeNs;
+		emu->nSlow++;
+	}
+
+	emu->nPageBytes = 0;
+	emu->nCycles++;
+}
+
+/*
+ * emuFaults()
+ *
+ * set injected chip faults from 'sSpec', a comma separated list of
+ *     flip=<n>                          one in n written bytes gets a random bit flipped
+ *     slow=<n>[:<ns>]                   one in n write cycles takes 'ns' nano-seconds,
+ *                                       EMU_SLOW times the write cycle by default
+ *     stuck=<hex_address>:<bit>:<0|1>   data bit of one cell stuck at 0 or 1
+ *     seed=<n>                          fault pseudo random seed
+ * return '0' on success or '1' if the list is malformed
+ *
+ */
+int emuFaults(struct emu *emu, const char *sSpec)
+{
+	const char		*s = sSpec;
+	unsigned int	address;
+	unsigned int	nBit;
+	unsigned int	nValue;
+	long			n;
+	long long		ns;
+	int				nUsed;
+
+	while ( *s )
+	{
+		nUsed = 0;
+		if ( sscanf(s, "flip=%ld%n", &n, &nUsed) == 1 && nUsed && n > 0 )
+			emu->nFlipRate = n;
+		else if ( sscanf(s, "slow=%ld:%lld%n", &n, &ns, &nUsed) == 2 && nUsed && n > 0 && ns > 0 )
+		{
+			emu->nSlowRate = n;
+			emu->slowNs = ns;
+		}
+		else if ( sscanf(s, "slow=%ld%n", &n, &nUsed) == 1 && nUsed && n > 0 )
+			emu->nSlowRate = n;
+		else if ( sscanf(s, "seed=%ld%n", &n, &nUsed) == 1 && nUsed )
+			emu->faultSeed = (unsigned long long) n ^ FAULT_SEED;
+		else if ( sscanf(s, "stuck=%x:%u:%u%n", &address, &nBit, &nValue, &nUsed) == 3 && nUsed &&
+				  address < EEPROM_SIZE && nBit < 8 && nValue < 2 )
+		{
+			emu->stuckAddress = (t_word) address;
+			emu->stuckMask = (t_byte) (1 << nBit);
+			emu->stuckValue = nValue ? emu->stuckMask : 0;
+		}
+		else
+			return 1;
+
+		s += nUsed;
+		if ( *s == ',' && s[1] )
+			s++;
+		else if ( *s )
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * emuRandom()
+ *
+ * return next non-negative fault pseudo random number, xorshift64
+ *
+ */
+static long emuRandom(struct emu *emu)
+{
+	emu->faultSeed ^= emu->faultSeed << 13;
+	emu->faultSeed ^= emu->faultSeed >> 7;
+	emu->faultSeed ^= emu->faultSeed << 17;
+
+	return (long) (emu->faultSeed >> 1);
+}
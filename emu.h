@@ -0,0 +1,84 @@
+/*
+ * emu.h
+ *
+ *      Purpose:
+ *
+ *      emulated programmer hardware and ATMEL 27C256 32Kx8 eeprom chip.
+ *      the emulator is driven with the same data, control and status
+ *      register accesses the programer library makes on the parallel port,
+ *      and models the address registers, the function decoder and the chip
+ *      page load window, write cycle and DATA polling.
+ *      all times are monotonic nano-seconds supplied by the caller, so the
+ *      emulator can run against a live clock or against trace time stamps.
+ *
+ */
+
+#ifndef __EMU_H__
+#define __EMU_H__
+
+#include "eeprom.h"
+
+/*
+ * definitions
+ */
+#define EMU_PAGE		64			// chip page size in bytes
+#define EMU_BLC_NS		150000		// byte load cycle window, page write starts when it expires
+#define EMU_WRITE_NS	3000000		// page write cycle time
+#define EMU_SLOW		3			// slow fault write cycles take this many times 'writeNs' by default,
+									// under the 10ms data sheet maximum the programer polls for
+
+/*
+ * type definitions
+ */
+struct emu										// emulated programer and eeprom state
+{
+	t_byte			data;						// data port as driven by the host
+	t_byte			control;					// control port
+	int				nDirRead;					// host data port drivers disabled
+	t_byte			loAddr;						// A0 - A7 register
+	t_byte			hiAddr;						// A8 - A14 and /CS register
+
+	t_byte			mem[EEPROM_SIZE];			// chip array
+	t_byte			valid[EEPROM_SIZE];			// '1' where 'mem' contents are known
+
+	t_byte			page[EMU_PAGE];				// page load buffer
+	t_byte			pageUsed[EMU_PAGE];
+	int				nPageBytes;					// bytes loaded in the open page window, '0' none
+	t_word			pageAddress;				// page of the last loaded byte
+	t_byte			lastByte;					// last loaded byte, DATA polling returns its inverted bit 7
+	long long		loadTime;					// time of last byte load
+	long long		busyUntil;					// end of page write cycle
+
+	long long		blcNs;						// chip timing, EMU_BLC_NS and EMU_WRITE_NS by default
+	long long		writeNs;
+
+	long			nLoads;						// statistics: bytes loaded
+	long			nCycles;					// page write cycles
+	long			nBusyWrites;				// writes ignored during a write cycle
+	long			nPolls;						// reads answered with DATA polling
+
+	long			nFlipRate;					// injected faults: one in 'nFlipRate' written bytes gets a bit flipped,
+	long			nSlowRate;					// one in 'nSlowRate' write cycles is slow, '0' no fault
+	long long		slowNs;						// slow write cycle time, '0' EMU_SLOW times 'writeNs'
+	t_word			stuckAddress;				// cell with bits 'stuckMask' stuck at 'stuckValue'
+	t_byte			stuckMask;
+	t_byte			stuckValue;
+	unsigned long long	faultSeed;				// fault pseudo random state
+	long			nFlips;						// statistics: bits flipped, slow write cycles
+	long			nSlow;
+};
+
+/*
+ * function prototypes
+ */
+void	emuInit(struct emu*, int);				// reset programer and chip, erased or unknown contents
+void	emuWriteData(struct emu*, t_byte);		// host writes data port
+void	emuWriteControl(struct emu*, t_byte, long long);	// host writes control port
+int		emuReadData(struct emu*, long long);	// host reads data port
+int		emuReadStatus(struct emu*);				// host reads status port
+void	emuDataDir(struct emu*, int);			// host sets data port direction
+t_word	emuAddress(struct emu*);				// address held in address registers
+int		emuBusy(struct emu*, long long);		// chip page load or write cycle in progress
+int		emuFaults(struct emu*, const char*);	// set injected chip faults
+
+#endif /* __EMU_H__ */
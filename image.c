@@ -0,0 +1,1356 @@
+/*
+ * image.c
+ *
+ *      Purpose:
+ *
+ *      image file formats and hardware free image handling.
+ *      all functions here are reentrant, the convert mode decode and
+ *      encode threads share nothing but read-only input.
+ *
+ *      S-record format
+ *      SnCCAAAAdddddddddd......ddXX
+ *
+ *      Intel HEX format
+ *      :CCAAAATTdddddd......ddXX
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "image.h"
+#include "stream.h"
+
+/*
+ * local type definitions
+ */
+struct record								// decoded data record
+{
+	unsigned long	address;
+	int				nOffset;				// offset of data bytes in chunk pool
+	int				nCount;
+};
+
+struct decode								// text decode thread work item
+{
+	t_byte			*text;					// chunk of text image, starts and ends on line boundary
+	int				nLength;
+	int				nFormat;
+	struct record	*records;
+	int				nRecords;
+	int				nAlloc;
+	t_byte			*pool;					// data bytes of all records
+	int				nPool;
+	int				nPoolAlloc;
+	int				nInherit;				// Intel HEX records before first base address record
+	long			lastBase;				// last Intel HEX base address in chunk, '-1' if none
+	int				nEof;					// chunk holds Intel HEX end of file record
+	int				nError;					// 1 + chunk offset of bad record, '0' if none
+};
+
+struct encode								// text encode thread work item
+{
+	struct image	*img;
+	unsigned long	start;					// chunk address range
+	unsigned long	end;
+	int				nFormat;
+	int				nSrecType;				// S1, S2 or S3 data records
+	int				nFill;					// gap fill byte, '-1' no fill
+	char			*text;
+	size_t			nLength;
+	size_t			nAlloc;
+	long			nRecords;
+	long			firstSegment;			// Intel HEX segment of the leading extended address record
+	long			lastSegment;			// and segment in effect at chunk end, '-1' none
+	size_t			nLead;					// length of the leading extended address record
+	int				nError;
+};
+
+/*
+ * local function prototypes
+ */
+static void	*decodeChunk(void*);		// thread: decode a chunk of text records
+static void	*encodeChunk(void*);		// thread: encode an address range into text records
+static long long	timeMs(void);		// monotonic time stamp in milli-seconds
+static void	imageMessage(t_message, void*, int, const char*, ...);	// format and report a message
+
+/*
+ * local definitions
+ */
+static const int	addrLen[10] = {2, 2, 3, 4, 0, 2, 3, 4, 3, 2};	// S-record address bytes per record type
+static const char	hex[] = "0123456789ABCDEF";
+
+/*
+ * -----------------------------------------
+ * -------  image format functions  --------
+ * -----------------------------------------
+ */
+
+/*
+ * loadInput()
+ *
+ * read the complete input file 'sName', or stdin if file name is '-',
+ * into a dynamically allocated memory image.
+ * gzip and zstd compressed files are decompressed while they are read.
+ * errors and notes go to the optional 'message' callback with 'arg'.
+ * return '0' on success with image and its length in 'data' and 'nLength'
+ *
+ */
+int loadInput(char *sName, t_byte **data, int *nLength, t_message message, void *arg)
+{
+	FILE	*fp;
+	FILE	*raw;
+	t_byte	*image = NULL;
+	t_byte	*temp;
+	int		nSize = 0;
+	int		nAlloc = INPUT_ALLOC;
+	int		nRead;
+	int		nCodec;
+
+	if ( strcmp(sName, STDIO_NAME) == 0 )
+		fp = stdin;
+	else if ( (fp = fopen(sName, "r")) == NULL )
+	{
+		imageMessage(message, arg, IMAGE_EFILE, "loadInput() could not open file '%s' for reading (errno=%d)", sName, errno);
+		return 1;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, IO_BUFFER);
+
+	raw = fp;
+	if ( (fp = streamOpen(raw, sName, 0, &nCodec, message, arg)) == NULL )
+	{
+		if ( raw != stdin )
+			fclose(raw);
+		return 1;
+	}
+
+	if ( nCodec != STREAM_PLAIN )
+		imageMessage(message, arg, IMAGE_NOTE, "loadInput() '%s' %s compressed", sName, streamName(nCodec));
+
+	do
+	{
+		if ( image == NULL || nSize == nAlloc )					// grow image buffer
+		{
+			if ( image != NULL )
+			{
+				if ( nAlloc > (int) (IMAGE_MAX * 2) )
+				{
+					imageMessage(message, arg, IMAGE_EFILE, "loadInput() file '%s' too large", sName);
+					free(image);
+					if ( fp != stdin )
+						fclose(fp);
+					return 1;
+				}
+				nAlloc *= 2;
+			}
+			if ( (temp = realloc(image, nAlloc)) == NULL )
+			{
+				imageMessage(message, arg, IMAGE_EMEMORY, "loadInput() out of memory");
+				free(image);
+				if ( fp != stdin )
+					fclose(fp);
+				return 1;
+			}
+			image = temp;
+		}
+
+		nRead = fread(&image[nSize], 1, nAlloc - nSize, fp);
+		nSize += nRead;
+	}
+	while ( nRead > 0 );
+
+	if ( ferror(fp) )
+	{
+		imageMessage(message, arg, IMAGE_EFILE, "loadInput() error reading '%s' (errno=%d)", sName, errno);
+		free(image);
+		if ( fp != stdin )
+			fclose(fp);
+		return 1;
+	}
+
+	if ( fp != stdin )
+		fclose(fp);
+
+	*data = image;
+	*nLength = nSize;
+
+	return 0;
+}
+
+/*
+ * detectFormat()
+ *
+ * detect input image format from its first bytes.
+ * an image is S-record or Intel HEX if its first record parses with
+ * a valid checksum. a first line of printable text that starts like
+ * a record but does not parse is a broken text image, not binary data.
+ * return S_RECORD, INTEL_HEX, BINARY or '0' for a broken text image
+ *
+ */
+int detectFormat(t_byte *data, int nLength)
+{
+	char	textLine[RECORD_LEN];
+	t_byte	record[256];
+	unsigned long	address;
+	int		nType;
+	int		nPos = 0;
+	int		i;
+
+	while ( nPos < nLength && isspace(data[nPos]) )		// text files may start with blank lines
+		nPos++;
+
+	if ( nPos == nLength || (data[nPos] != 'S' && data[nPos] != ':') )
+		return BINARY;
+
+	for ( i = nPos; i < nLength && data[i] != '\n'; i++ )	// binary data rarely holds a text line
+	{
+		if ( !isprint(data[i]) && !isspace(data[i]) )
+			return BINARY;
+	}
+
+	getRecord(data, nLength, &nPos, textLine);
+
+	if ( textLine[0] == 'S' && parseSrec(textLine, &nType, &address, record) >= 0 )
+		return S_RECORD;
+
+	if ( textLine[0] == ':' && parseIhex(textLine, &nType, &address, record) >= 0 )
+		return INTEL_HEX;
+
+	return 0;
+}
+
+/*
+ * formatName()
+ *
+ * return printable name of an image format flag
+ *
+ */
+const char *formatName(int nFormat)
+{
+	static const char	*sName[] = {"unknown", "S-record", "binary", "Intel HEX"};
+
+	if ( nFormat < S_RECORD || nFormat > INTEL_HEX )
+		return sName[0];
+
+	return sName[nFormat];
+}
+
+/*
+ * getRecord()
+ *
+ * copy the next text line starting at offset 'nPos' of the memory image
+ * into 'textLine' without line termination characters, and advance 'nPos'.
+ * lines are truncated to RECORD_LEN - 1 characters.
+ * return line length or '-1' at end of image
+ *
+ */
+int getRecord(t_byte *data, int nLength, int *nPos, char *textLine)
+{
+	int		i = 0;
+	int		c;
+
+	if ( *nPos >= nLength )
+		return -1;
+
+	while ( *nPos < nLength )
+	{
+		c = data[(*nPos)++];
+		if ( c == '\n' )
+			break;
+		if ( c != '\r' && i < (RECORD_LEN - 1) )
+			textLine[i++] = (char) c;
+	}
+
+	textLine[i] = '\0';
+
+	return i;
+}
+
+/*
+ * hexByte()
+ *
+ * convert two hex digits at 'text' to a byte value.
+ * return '-1' if the characters are not hex digits
+ *
+ */
+int hexByte(char *text)
+{
+	int		nByte = 0;
+	int		c;
+	int		i;
+
+	for ( i = 0; i < 2; i++ )
+	{
+		c = (unsigned char) text[i];
+		if ( c >= '0' && c <= '9' )
+			c -= '0';
+		else if ( (c | 0x20) >= 'a' && (c | 0x20) <= 'f' )
+			c = (c | 0x20) - 'a' + 10;
+		else
+			return -1;
+		nByte = (nByte << 4) | c;
+	}
+
+	return nByte;
+}
+
+/*
+ * parseSrec()
+ *
+ * parse and validate an S-record text line.
+ * return record type, address and data bytes in 'nType', 'address' and 'data'
+ * and the data byte count, or '-1' if the record is malformed or has a bad checksum
+ *
+ */
+int parseSrec(char *textLine, int *nType, unsigned long *address, t_byte *data)
+{
+
+	t_byte	record[256];
+	int		nCount;
+	int		nSum;
+	int		nByte;
+	int		i;
+
+	if ( textLine[0] != 'S' || !isdigit((unsigned char) textLine[1]) )
+		return -1;
+
+	*nType = textLine[1] - '0';
+	if ( addrLen[*nType] == 0 )
+		return -1;
+
+	if ( (nCount = hexByte(&textLine[2])) < (addrLen[*nType] + 1) )
+		return -1;
+
+	if ( (int) strlen(textLine) < (4 + (nCount * 2)) )
+		return -1;
+
+	nSum = nCount;
+	for ( i = 0; i < nCount; i++ )
+	{
+		if ( (nByte = hexByte(&textLine[4 + (i * 2)])) < 0 )
+			return -1;
+		record[i] = (t_byte) nByte;
+		nSum += nByte;
+	}
+
+	if ( (nSum & 0xff) != 0xff )					// one's complement checksum
+		return -1;
+
+	*address = 0;
+	for ( i = 0; i < addrLen[*nType]; i++ )
+		*address = (*address << 8) | record[i];
+
+	nCount -= (addrLen[*nType] + 1);				// adjust for address and checksum bytes
+	memcpy(data, &record[addrLen[*nType]], nCount);
+
+	return nCount;
+}
+
+/*
+ * parseIhex()
+ *
+ * parse and validate an Intel HEX text line.
+ * return record type, 16 bit offset and data bytes in 'nType', 'address' and 'data'
+ * and the data byte count, or '-1' if the record is malformed or has a bad checksum
+ *
+ */
+int parseIhex(char *textLine, int *nType, unsigned long *address, t_byte *data)
+{
+	int		nCount;
+	int		nSum;
+	int		nByte;
+	int		i;
+
+	if ( textLine[0] != ':' || (nCount = hexByte(&textLine[1])) < 0 )
+		return -1;
+
+	if ( (int) strlen(textLine) < (11 + (nCount * 2)) )
+		return -1;
+
+	nSum = 0;
+	for ( i = 0; i < (nCount + 5); i++ )			// count, address, type, data and checksum
+	{
+		if ( (nByte = hexByte(&textLine[1 + (i * 2)])) < 0 )
+			return -1;
+		if ( i >= 4 && i < (nCount + 4) )
+			data[i - 4] = (t_byte) nByte;
+		nSum += nByte;
+	}
+
+	if ( (nSum & 0xff) != 0 )						// two's complement checksum
+		return -1;
+
+	*address = (unsigned long) ((hexByte(&textLine[3]) << 8) | hexByte(&textLine[5]));
+	*nType = hexByte(&textLine[7]);
+
+	return nCount;
+}
+
+/*
+ * makeSrec()
+ *
+ * format an S-record line of type 'nType' with 'nCount' data bytes
+ * into 'textLine', terminated with a new line.
+ * return the line length
+ *
+ */
+int makeSrec(char *textLine, int nType, unsigned long address, t_byte *data, int nCount)
+{
+	int		nLen = 0;
+	int		nSum;
+	int		nByte;
+	int		i;
+
+	nSum = nCount + addrLen[nType] + 1;
+	textLine[nLen++] = 'S';
+	textLine[nLen++] = (char) ('0' + nType);
+	textLine[nLen++] = hex[nSum >> 4];
+	textLine[nLen++] = hex[nSum & 0x0f];
+
+	for ( i = addrLen[nType] - 1; i >= 0; i-- )
+	{
+		nByte = (int) ((address >> (i * 8)) & 0xff);
+		textLine[nLen++] = hex[nByte >> 4];
+		textLine[nLen++] = hex[nByte & 0x0f];
+		nSum += nByte;
+	}
+
+	for ( i = 0; i < nCount; i++ )
+	{
+		textLine[nLen++] = hex[data[i] >> 4];
+		textLine[nLen++] = hex[data[i] & 0x0f];
+		nSum += data[i];
+	}
+
+	nSum = (~nSum) & 0xff;
+	textLine[nLen++] = hex[nSum >> 4];
+	textLine[nLen++] = hex[nSum & 0x0f];
+	textLine[nLen++] = '\n';
+	textLine[nLen] = '\0';
+
+	return nLen;
+}
+
+/*
+ * makeIhex()
+ *
+ * format an Intel HEX line of type 'nType' with 'nCount' data bytes
+ * and 16 bit 'address' offset into 'textLine', terminated with a new line.
+ * return the line length
+ *
+ */
+int makeIhex(char *textLine, int nType, unsigned long address, t_byte *data, int nCount)
+{
+	t_byte	head[4];
+	int		nLen = 0;
+	int		nSum = 0;
+	int		i;
+
+	head[0] = (t_byte) nCount;
+	head[1] = (t_byte) (address >> 8);
+	head[2] = (t_byte) address;
+	head[3] = (t_byte) nType;
+
+	textLine[nLen++] = ':';
+
+	for ( i = 0; i < 4; i++ )
+	{
+		textLine[nLen++] = hex[head[i] >> 4];
+		textLine[nLen++] = hex[head[i] & 0x0f];
+		nSum += head[i];
+	}
+
+	for ( i = 0; i < nCount; i++ )
+	{
+		textLine[nLen++] = hex[data[i] >> 4];
+		textLine[nLen++] = hex[data[i] & 0x0f];
+		nSum += data[i];
+	}
+
+	nSum = (-nSum) & 0xff;
+	textLine[nLen++] = hex[nSum >> 4];
+	textLine[nLen++] = hex[nSum & 0x0f];
+	textLine[nLen++] = '\n';
+	textLine[nLen] = '\0';
+
+	return nLen;
+}
+
+/*
+ * fileHeader()
+ *
+ * write S0 header record to an S-record file of format 'nFormat'.
+ * return '0' on success
+ *
+ */
+int fileHeader(FILE *fp, int nFormat)
+{
+	char	textLine[RECORD_LEN];
+	int		nLen;
+
+	if ( nFormat != S_RECORD )
+		return 0;
+
+	nLen = makeSrec(textLine, 0, 0, (t_byte*) SREC_HEADER, strlen(SREC_HEADER));
+
+	return ( fwrite(textLine, 1, nLen, fp) != (size_t) nLen );
+}
+
+/*
+ * fileWrite()
+ *
+ * write 'nCount' bytes of 'data' to file stream.
+ * data will be writted as binary, S-record or Intel HEX
+ * records starting at eeprom 'address', per 'nFormat'
+ * the function will return the number of bytes writen to the file
+ *
+ */
+int fileWrite(FILE *fp, int nFormat, t_word address, t_byte *data, int nCount)
+{
+	char	textLine[RECORD_LEN];
+	int		nWritten = 0;
+	int		nLine;
+	int		nLen;
+
+	if ( nFormat == BINARY )
+		return fwrite(data, 1, nCount, fp);	// write data to binary file
+
+	while ( nWritten < nCount )
+	{
+		nLine = nCount - nWritten;
+
+		if ( nFormat == S_RECORD )
+		{
+			if ( nLine > SREC_BYTES )
+				nLine = SREC_BYTES;
+			nLen = makeSrec(textLine, 1, address + nWritten, &data[nWritten], nLine);
+		}
+		else
+		{
+			if ( nLine > IHEX_BYTES )
+				nLine = IHEX_BYTES;
+			nLen = makeIhex(textLine, 0, address + nWritten, &data[nWritten], nLine);
+		}
+
+		if ( fwrite(textLine, 1, nLen, fp) != (size_t) nLen )
+			break;
+
+		nWritten += nLine;
+	}
+
+	return nWritten;
+}
+
+/*
+ * fileTrailer()
+ *
+ * write S9 or Intel HEX end of file record per 'nFormat'.
+ * return '0' on success
+ *
+ */
+int fileTrailer(FILE *fp, int nFormat)
+{
+	char	textLine[RECORD_LEN];
+	int		nLen = 0;
+
+	if ( nFormat == S_RECORD )
+		nLen = makeSrec(textLine, 9, 0, NULL, 0);
+	else if ( nFormat == INTEL_HEX )
+		nLen = makeIhex(textLine, 1, 0, NULL, 0);
+
+	return ( fwrite(textLine, 1, nLen, fp) != (size_t) nLen );
+}
+
+/*
+ * -----------------------------------------
+ * ------  image conversion functions  -----
+ * -----------------------------------------
+ */
+
+/*
+ * convertImage()
+ *
+ * hardware free image conversion.
+ * merge 'nInputs' image files in command line order into one sparse memory image,
+ * a later file overrides bytes of an earlier one, and write the image to 'cv->sOutput'
+ * in the format of 'cv->nFormat':
+ * - the output range start/end crop the output, or pad it when combined with a fill byte
+ * - a fill byte fills gaps in the output range, binary output is always filled (default 0xff)
+ * - a split size splits the output range into files of equal size
+ * binary input files are placed at address 0 or at '@<hex_base>' appended to the file name.
+ * text decode and encode is spread over 'cv->nThreads' threads.
+ * return '0' on success
+ *
+ */
+int convertImage(struct convert *cv, int nInputs, char **sInputs)
+{
+	struct image	img = {0, 0, NULL, NULL};
+	unsigned long	lo, hi;
+	unsigned long	start;
+	char			sSplitName[TEXT_LEN + 16];
+	char			*ext;
+	char			sExt[TEXT_LEN];
+	char			sZip[TEXT_LEN];
+	long long		startTime;
+	int				i;
+	int				nResult = 0;
+
+	if ( nInputs == 0 )
+	{
+		imageMessage(cv->message, cv->arg, IMAGE_EFILE, "convertImage() no input files");
+		return 1;
+	}
+
+	if ( cv->nThreads == 0 )
+	{
+		cv->nThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		if ( cv->nThreads < 1 )
+			cv->nThreads = 1;
+		if ( cv->nThreads > THREAD_MAX )
+			cv->nThreads = THREAD_MAX;
+	}
+
+	startTime = timeMs();
+
+	for ( i = 0; i < nInputs && nResult == 0; i++ )		// decode and merge input files in order
+		nResult = loadImageFile(cv, sInputs[i], &img);
+
+	if ( nResult )
+		goto EXIT;
+
+	if ( img.size == 0 )
+	{
+		imageMessage(cv->message, cv->arg, IMAGE_ERANGE, "convertImage() input files hold no data");
+		nResult = 1;
+		goto EXIT;
+	}
+
+	imageMessage(cv->message, cv->arg, IMAGE_NOTE, "convertImage() image 0x%lx to 0x%lx decoded in %lldms, %d thread(s)",
+			img.base, img.base + img.size - 1, timeMs() - startTime, cv->nThreads);
+
+	lo = (cv->nRangeFlag & RANGE_START) ? cv->start : img.base;
+	hi = (cv->nRangeFlag & RANGE_END) ? cv->end : (img.base + img.size - 1);
+
+	if ( lo > hi )
+	{
+		imageMessage(cv->message, cv->arg, IMAGE_ERANGE, "convertImage() output range is empty");
+		nResult = 1;
+		goto EXIT;
+	}
+
+	if ( cv->nFormat == BINARY && ((hi - lo) >= IMAGE_MAX) )
+	{
+		imageMessage(cv->message, cv->arg, IMAGE_ERANGE, "convertImage() binary output range too large");
+		nResult = 1;
+		goto EXIT;
+	}
+
+	startTime = timeMs();
+
+	if ( cv->ulSplit == 0 )
+		nResult = writeImageFile(cv, cv->sOutput, &img, lo, hi);
+	else
+	{
+		if ( strcmp(cv->sOutput, STDIO_NAME) == 0 )
+		{
+			imageMessage(cv->message, cv->arg, IMAGE_EFILE, "convertImage() cannot split output to stdout");
+			nResult = 1;
+			goto EXIT;
+		}
+
+		for ( i = 0, start = lo; start <= hi && nResult == 0; i++, start += cv->ulSplit )
+		{
+			strncpy(sSplitName, cv->sOutput, TEXT_LEN - 1);
+			sSplitName[TEXT_LEN - 1] = '\0';				// name.bin -> name.<i>.bin
+			sZip[0] = '\0';									// name.bin.gz -> name.<i>.bin.gz
+			if ( streamCodec(sSplitName) != STREAM_PLAIN )
+			{
+				ext = strrchr(sSplitName, '.');
+				strcpy(sZip, ext);
+				*ext = '\0';
+			}
+			ext = strrchr(sSplitName, '.');
+			if ( ext == NULL || strchr(ext, '/') != NULL )
+				sprintf(&sSplitName[strlen(sSplitName)], ".%d%s", i, sZip);
+			else
+			{
+				strcpy(sExt, ext);
+				sprintf(ext, ".%d%s%s", i, sExt, sZip);
+			}
+
+			nResult = writeImageFile(cv, sSplitName, &img, start,
+									 ((hi - start) < cv->ulSplit) ? hi : (start + cv->ulSplit - 1));
+
+			if ( (start + cv->ulSplit) < start )				// address wrap around
+				break;
+		}
+	}
+
+	if ( nResult == 0 )
+		imageMessage(cv->message, cv->arg, IMAGE_NOTE, "convertImage() output encoded in %lldms", timeMs() - startTime);
+
+EXIT:
+	free(img.data);
+	free(img.used);
+
+	return nResult;
+}
+
+/*
+ * loadImageFile()
+ *
+ * load image file 'sName' (optional '@<hex_base>' suffix for binary files),
+ * detect its format, decode it and merge its data into memory image 'img'.
+ * text files are split into line aligned chunks decoded by parallel threads,
+ * chunk results are merged in file order so overlapping records resolve
+ * the same way a sequential decode would.
+ * return '0' on success
+ *
+ */
+int loadImageFile(struct convert *cv, char *sName, struct image *img)
+{
+	struct decode	chunk[THREAD_MAX];
+	pthread_t		thread[THREAD_MAX];
+	int				nStarted[THREAD_MAX];		// thread created, else its chunk runs inline
+	struct record	binRecord;
+	struct decode	*d;
+	struct record	*r;
+	char			sFile[TEXT_LEN + 16];
+	char			*at;
+	char			*end;
+	t_byte			*data;
+	t_byte			*temp;
+	unsigned long	binBase = 0;
+	unsigned long	lo = (unsigned long) -1, hi = 0;
+	unsigned long	newBase, newSize;
+	unsigned long	address;
+	long			base;
+	long			nConflicts = 0;
+	int				nLength;
+	int				nFormat;
+	int				nChunks;
+	int				nPos;
+	int				nEof;
+	int				i, j, k;
+	int				nResult = 0;
+
+	strncpy(sFile, sName, sizeof(sFile) - 1);
+	sFile[sizeof(sFile) - 1] = '\0';
+
+	if ( (at = strrchr(sFile, '@')) != NULL )				// binary base address suffix
+	{
+		binBase = strtoul(at + 1, &end, 16);
+		if ( end != (at + 1) && *end == '\0' )
+			*at = '\0';
+		else
+			binBase = 0;
+	}
+
+	if ( loadInput(sFile, &data, &nLength, cv->message, cv->arg) )
+		return 1;
+
+	if ( (nFormat = detectFormat(data, nLength)) == 0 )
+	{
+		imageMessage(cv->message, cv->arg, IMAGE_EFORMAT, "loadImageFile() '%s' first record is not a valid S-record or Intel HEX record", sFile);
+		free(data);
+		return 1;
+	}
+	imageMessage(cv->message, cv->arg, IMAGE_NOTE, "loadImageFile() '%s' %s input, %d bytes", sFile, formatName(nFormat), nLength);
+
+	memset(chunk, 0, sizeof(chunk));
+
+	if ( nFormat == BINARY )								// a binary file is one record
+	{
+		nChunks = 1;
+		binRecord.address = binBase;
+		binRecord.nOffset = 0;
+		binRecord.nCount = nLength;
+		chunk[0].records = &binRecord;
+		chunk[0].nRecords = (nLength > 0);
+		chunk[0].pool = data;
+		chunk[0].lastBase = -1;
+	}
+	else
+	{
+		nChunks = nLength / CHUNK_MIN;						// split text on line boundaries
+		if ( nChunks > cv->nThreads )
+			nChunks = cv->nThreads;
+		if ( nChunks < 1 )
+			nChunks = 1;
+
+		for ( i = 0, nPos = 0; i < nChunks; i++ )
+		{
+			chunk[i].text = &data[nPos];
+			chunk[i].nFormat = nFormat;
+			chunk[i].lastBase = -1;
+
+			j = (i == (nChunks - 1)) ? nLength : (int) (((long) nLength * (i + 1)) / nChunks);
+			if ( j < nPos )
+				j = nPos;
+			while ( j < nLength && data[j - 1] != '\n' )
+				j++;
+
+			chunk[i].nLength = j - nPos;
+			nPos = j;
+		}
+
+		for ( i = 1; i < nChunks; i++ )
+		{
+			if ( (nStarted[i] = (pthread_create(&thread[i], NULL, decodeChunk, &chunk[i]) == 0)) == 0 )
+				decodeChunk(&chunk[i]);						// out of threads, decode it here
+		}
+		decodeChunk(&chunk[0]);
+		for ( i = 1; i < nChunks; i++ )
+		{
+			if ( nStarted[i] )
+				pthread_join(thread[i], NULL);
+		}
+	}
+
+	/*
+	 * resolve Intel HEX base addresses inherited from earlier chunks,
+	 * drop chunks after the end of file record and find the address span
+	 */
+	for ( i = 0, base = 0, nEof = 0; i < nChunks; i++ )
+	{
+		d = &chunk[i];
+
+		if ( nEof )
+			d->nRecords = 0;
+
+		if ( d->nError && !nEof )
+		{
+			imageMessage(cv->message, cv->arg, IMAGE_EFORMAT, "loadImageFile() '%s' bad record or checksum at offset %ld", sFile,
+					(long) (d->text - data) + d->nError - 1);
+			nResult = 1;
+		}
+
+		for ( j = 0; j < d->nRecords; j++ )
+		{
+			r = &d->records[j];
+			if ( j < d->nInherit )
+				r->address += base;
+			if ( r->address < lo )
+				lo = r->address;
+			if ( (r->address + r->nCount - 1) > hi )
+				hi = r->address + r->nCount - 1;
+		}
+
+		if ( d->lastBase >= 0 )
+			base = d->lastBase;
+		nEof |= d->nEof;
+	}
+
+	if ( nResult || lo > hi )								// error or no data records
+		goto EXIT;
+
+	/*
+	 * grow memory image to hold the new address span
+	 */
+	newBase = lo;
+	newSize = hi - lo + 1;
+	if ( img->size )
+	{
+		if ( img->base < newBase )
+			newBase = img->base;
+		if ( (img->base + img->size - 1) > hi )
+			hi = img->base + img->size - 1;
+		newSize = hi - newBase + 1;
+	}
+
+	if ( newSize > IMAGE_MAX || newSize == 0 )
+	{
+		imageMessage(cv->message, cv->arg, IMAGE_ERANGE, "loadImageFile() image address span 0x%lx to 0x%lx too large", newBase, hi);
+		nResult = 1;
+		goto EXIT;
+	}
+
+	if ( newBase != img->base || newSize != img->size )
+	{
+		if ( (temp = malloc(newSize)) == NULL )
+		{
+			imageMessage(cv->message, cv->arg, IMAGE_EMEMORY, "loadImageFile() out of memory");
+			nResult = 1;
+			goto EXIT;
+		}
+		memset(temp, (cv->nFill < 0) ? 0xff : cv->nFill, newSize);
+		if ( img->size )
+			memcpy(&temp[img->base - newBase], img->data, img->size);
+		free(img->data);
+		img->data = temp;
+
+		if ( (temp = calloc(newSize, 1)) == NULL )
+		{
+			imageMessage(cv->message, cv->arg, IMAGE_EMEMORY, "loadImageFile() out of memory");
+			nResult = 1;
+			goto EXIT;
+		}
+		if ( img->size )
+			memcpy(&temp[img->base - newBase], img->used, img->size);
+		free(img->used);
+		img->used = temp;
+
+		img->base = newBase;
+		img->size = newSize;
+	}
+
+	/*
+	 * merge records in file order, later data wins
+	 */
+	for ( i = 0; i < nChunks; i++ )
+	{
+		d = &chunk[i];
+		for ( j = 0; j < d->nRecords; j++ )
+		{
+			r = &d->records[j];
+			address = r->address - img->base;
+			for ( k = 0; k < r->nCount; k++ )
+			{
+				if ( img->used[address + k] && img->data[address + k] != d->pool[r->nOffset + k] )
+					nConflicts++;
+				img->data[address + k] = d->pool[r->nOffset + k];
+			}
+			memset(&img->used[address], 1, r->nCount);
+		}
+	}
+
+	if ( nConflicts )
+		imageMessage(cv->message, cv->arg, IMAGE_NOTE, "loadImageFile() '%s' overrides %ld byte(s) with different data", sFile, nConflicts);
+
+EXIT:
+	if ( nFormat != BINARY )
+	{
+		for ( i = 0; i < nChunks; i++ )
+		{
+			free(chunk[i].records);
+			free(chunk[i].pool);
+		}
+	}
+	free(data);
+
+	return nResult;
+}
+
+/*
+ * decodeChunk()
+ *
+ * thread function.
+ * decode the S-record or Intel HEX text lines of a 'struct decode' chunk
+ * into a list of data records. Intel HEX data records that appear before the
+ * first base address record of the chunk are counted in 'nInherit', their
+ * base address is resolved after all chunks are decoded
+ *
+ */
+static void *decodeChunk(void *arg)
+{
+	struct decode	*d = (struct decode*) arg;
+	struct record	*r;
+	char			textLine[RECORD_LEN];
+	t_byte			record[256];
+	unsigned long	address;
+	long			base = -1;
+	void			*temp;
+	int				nLinePos;
+	int				nPos = 0;
+	int				nType;
+	int				nCount;
+
+	for ( nLinePos = 0; getRecord(d->text, d->nLength, &nPos, textLine) != -1; nLinePos = nPos )
+	{
+		if ( textLine[0] == '\0' )
+			continue;
+
+		if ( d->nFormat == S_RECORD )
+			nCount = parseSrec(textLine, &nType, &address, record);
+		else
+			nCount = parseIhex(textLine, &nType, &address, record);
+
+		if ( nCount < 0 )
+		{
+			d->nError = nLinePos + 1;
+			break;
+		}
+
+		if ( d->nFormat == S_RECORD )
+		{
+			if ( nType < 1 || nType > 3 || nCount == 0 )	// S1, S2 and S3 data records only
+				continue;
+		}
+		else
+		{
+			if ( nType == 1 )								// end of file
+			{
+				d->nEof = 1;
+				break;
+			}
+
+			if ( nType == 2 && nCount == 2 )
+				base = ((long) record[0] << 12) | ((long) record[1] << 4);
+			else if ( nType == 4 && nCount == 2 )
+				base = ((long) record[0] << 24) | ((long) record[1] << 16);
+
+			if ( nType != 0 || nCount == 0 )
+				continue;
+
+			if ( base < 0 )
+				d->nInherit++;
+			else
+				address += base;
+		}
+
+		if ( d->nRecords == d->nAlloc )						// grow record list and data pool
+		{
+			d->nAlloc = d->nAlloc ? (d->nAlloc * 2) : 1024;
+			if ( (temp = realloc(d->records, d->nAlloc * sizeof(struct record))) == NULL )
+			{
+				d->nError = nLinePos + 1;
+				break;
+			}
+			d->records = temp;
+		}
+
+		if ( (d->nPool + nCount) > d->nPoolAlloc )
+		{
+			d->nPoolAlloc = d->nPoolAlloc ? (d->nPoolAlloc * 2) : (64 * 1024);
+			if ( (temp = realloc(d->pool, d->nPoolAlloc)) == NULL )
+			{
+				d->nError = nLinePos + 1;
+				break;
+			}
+			d->pool = temp;
+		}
+
+		r = &d->records[d->nRecords++];
+		r->address = address;
+		r->nOffset = d->nPool;
+		r->nCount = nCount;
+		memcpy(&d->pool[d->nPool], record, nCount);
+		d->nPool += nCount;
+	}
+
+	d->lastBase = base;
+
+	return NULL;
+}
+
+/*
+ * encodeChunk()
+ *
+ * thread function.
+ * encode the address range of a 'struct encode' chunk into S-record or
+ * Intel HEX text. records are aligned to the line size so chunks that start
+ * on a line boundary produce the same text as a single sequential encode.
+ * Intel HEX chunks lead with an extended linear address record, the writer
+ * drops it when the previous chunk already left that segment in effect.
+ * with a fill byte every address in range is encoded, otherwise gaps are skipped
+ *
+ */
+static void *encodeChunk(void *arg)
+{
+	struct encode	*e = (struct encode*) arg;
+	struct image	*img = e->img;
+	t_byte			line[SREC_BYTES];
+	t_byte			upper[2];
+	unsigned long	address = e->start;
+	unsigned long	lineEnd;
+	unsigned long	segment = (unsigned long) -1;		// not known before the first record
+	unsigned long	imgEnd = img->base + img->size - 1;
+	unsigned long	i;
+	t_byte			*next;
+	void			*temp;
+	int				nLineBytes = (e->nFormat == S_RECORD) ? SREC_BYTES : IHEX_BYTES;
+	int				nCount;
+
+	e->firstSegment = -1;
+	e->lastSegment = -1;
+
+	while ( address <= e->end )
+	{
+		if ( e->nFill < 0 )									// skip to next used byte
+		{
+			if ( address < img->base )
+				address = img->base;
+			if ( address > imgEnd || address > e->end )
+				break;
+
+			i = ((e->end < imgEnd) ? e->end : imgEnd) - address + 1;
+			if ( (next = memchr(&img->used[address - img->base], 1, i)) == NULL )
+				break;
+			address = img->base + (unsigned long) (next - img->used);
+		}
+
+		lineEnd = address | (unsigned long) (nLineBytes - 1);
+		if ( lineEnd > e->end )
+			lineEnd = e->end;
+
+		for ( nCount = 0; (address + nCount) <= lineEnd; nCount++ )
+		{
+			i = address + nCount;
+			if ( i >= img->base && i <= imgEnd && img->used[i - img->base] )
+				line[nCount] = img->data[i - img->base];
+			else if ( e->nFill >= 0 )
+				line[nCount] = (t_byte) e->nFill;
+			else
+				break;
+		}
+
+		if ( (e->nAlloc - e->nLength) < (2 * RECORD_LEN) )	// room for two records
+		{
+			e->nAlloc = e->nAlloc ? (e->nAlloc * 2) : (256 * 1024);
+			if ( (temp = realloc(e->text, e->nAlloc)) == NULL )
+			{
+				e->nError = 1;
+				break;
+			}
+			e->text = temp;
+		}
+
+		if ( e->nFormat == S_RECORD )
+			e->nLength += makeSrec(&e->text[e->nLength], e->nSrecType, address, line, nCount);
+		else
+		{
+			if ( (address >> 16) != segment )				// extended linear address record
+			{
+				segment = address >> 16;
+				upper[0] = (t_byte) (segment >> 8);
+				upper[1] = (t_byte) segment;
+				i = makeIhex(&e->text[e->nLength], 4, 0, upper, 2);
+				if ( e->nLength == 0 )
+				{
+					e->firstSegment = (long) segment;
+					e->nLead = i;
+				}
+				e->nLength += i;
+				e->lastSegment = (long) segment;
+			}
+			e->nLength += makeIhex(&e->text[e->nLength], 0, address, line, nCount);
+		}
+
+		e->nRecords++;
+
+		if ( (address + nCount) < address )					// address wrap around
+			break;
+		address += nCount;
+	}
+
+	return NULL;
+}
+
+/*
+ * writeImageFile()
+ *
+ * write memory image range 'lo' to 'hi' into file 'sName', or stdout
+ * if file name is '-', in the 'cv->nFormat' format.
+ * binary output fills gaps with the fill byte or 0xff.
+ * text output is encoded by parallel threads into per-chunk buffers
+ * that are written in address order.
+ * return '0' on success
+ *
+ */
+int writeImageFile(struct convert *cv, char *sName, struct image *img, unsigned long lo, unsigned long hi)
+{
+	struct encode	chunk[THREAD_MAX];
+	pthread_t		thread[THREAD_MAX];
+	int				nStarted[THREAD_MAX];		// thread created, else its chunk runs inline
+	t_byte			fill[4096];
+	char			textLine[RECORD_LEN];
+	unsigned long	address;
+	unsigned long	nBytes;
+	unsigned long	nChunkSize;
+	unsigned long	imgEnd = img->base + img->size - 1;
+	long			nRecords = 0;
+	long			segment = 0;				// Intel HEX segment in effect, files start in segment 0
+	size_t			nSkip;
+	FILE			*fp;
+	FILE			*raw;
+	int				nChunks;
+	int				nLen;
+	int				i;
+	int				nResult = 0;
+
+	if ( cv->nFormat != BINARY && cv->nFill < 0 )			// skip text files without data
+	{
+		if ( hi < img->base || lo > imgEnd )
+			return 0;
+		address = (lo > img->base) ? lo : img->base;
+		nBytes = ((hi < imgEnd) ? hi : imgEnd) - address + 1;
+		if ( memchr(&img->used[address - img->base], 1, nBytes) == NULL )
+		{
+			imageMessage(cv->message, cv->arg, IMAGE_NOTE, "writeImageFile() '%s' range holds no data, skipped", sName);
+			return 0;
+		}
+	}
+
+	if ( strcmp(sName, STDIO_NAME) == 0 )
+		fp = fdopen(cv->nStdoutFd, "w");
+	else
+		fp = fopen(sName, "w");
+
+	if ( fp == NULL )
+	{
+		imageMessage(cv->message, cv->arg, IMAGE_EFILE, "writeImageFile() could not open file '%s' for writing (errno=%d)", sName, errno);
+		return 1;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, IO_BUFFER);
+
+	if ( (raw = streamOpen(fp, sName, 1, NULL, cv->message, cv->arg)) == NULL )	// compressed by file name extension
+	{
+		fclose(fp);
+		return 1;
+	}
+	fp = raw;
+
+	if ( cv->nFormat == BINARY )
+	{
+		memset(fill, (cv->nFill < 0) ? 0xff : cv->nFill, sizeof(fill));
+
+		for ( address = lo; nResult == 0; address += nBytes )
+		{
+			if ( address >= img->base && address <= imgEnd )	// image data
+			{
+				nBytes = ((hi < imgEnd) ? hi : imgEnd) - address + 1;
+				nResult = ( fwrite(&img->data[address - img->base], 1, nBytes, fp) != nBytes );
+			}
+			else												// padding outside of image
+			{
+				nBytes = ((hi - address) < sizeof(fill)) ? (hi - address + 1) : sizeof(fill);
+				if ( address < img->base && (img->base - address) < nBytes )
+					nBytes = img->base - address;
+				nResult = ( fwrite(fill, 1, nBytes, fp) != nBytes );
+			}
+
+			if ( (address + nBytes - 1) >= hi )
+				break;
+		}
+	}
+	else
+	{
+		memset(chunk, 0, sizeof(chunk));
+
+		nChunks = (int) ((hi - lo) / CHUNK_MIN) + 1;		// line aligned chunks, one per thread
+		if ( nChunks > cv->nThreads )
+			nChunks = cv->nThreads;
+		nChunkSize = (((hi - lo) / nChunks) + SREC_BYTES) & ~((unsigned long) SREC_BYTES - 1);
+
+		for ( i = 0; i < nChunks; i++ )
+		{
+			chunk[i].img = img;
+			chunk[i].nFormat = cv->nFormat;
+			chunk[i].nFill = cv->nFill;
+			chunk[i].start = (i == 0) ? lo : ((lo & ~((unsigned long) SREC_BYTES - 1)) + (nChunkSize * i));
+			chunk[i].end = (i == (nChunks - 1)) ? hi : ((lo & ~((unsigned long) SREC_BYTES - 1)) + (nChunkSize * (i + 1)) - 1);
+
+			if ( hi > 0xffffff )							// S-record address size
+				chunk[i].nSrecType = 3;
+			else if ( hi > 0xffff )
+				chunk[i].nSrecType = 2;
+			else
+				chunk[i].nSrecType = 1;
+		}
+
+		for ( i = 1; i < nChunks; i++ )
+		{
+			if ( (nStarted[i] = (pthread_create(&thread[i], NULL, encodeChunk, &chunk[i]) == 0)) == 0 )
+				encodeChunk(&chunk[i]);						// out of threads, encode it here
+		}
+		encodeChunk(&chunk[0]);
+		for ( i = 1; i < nChunks; i++ )
+		{
+			if ( nStarted[i] )
+				pthread_join(thread[i], NULL);
+		}
+
+		nResult = fileHeader(fp, cv->nFormat);
+
+		for ( i = 0; i < nChunks; i++ )
+		{
+			if ( chunk[i].nError )
+			{
+				imageMessage(cv->message, cv->arg, IMAGE_EMEMORY, "writeImageFile() out of memory");
+				nResult = 1;
+			}
+			if ( chunk[i].firstSegment >= 0 && chunk[i].firstSegment == segment )
+				nSkip = chunk[i].nLead;						// segment already in effect
+			else
+				nSkip = 0;
+			if ( chunk[i].lastSegment >= 0 )
+				segment = chunk[i].lastSegment;
+			if ( nResult == 0 )
+				nResult = ( fwrite(chunk[i].text + nSkip, 1, chunk[i].nLength - nSkip, fp) != (chunk[i].nLength - nSkip) );
+			nRecords += chunk[i].nRecords;
+			free(chunk[i].text);
+		}
+
+		if ( cv->nFormat == S_RECORD )						// record count and termination
+		{
+			nLen = 0;
+			if ( nRecords <= 0xffff )
+				nLen = makeSrec(textLine, 5, (unsigned long) nRecords, NULL, 0);
+			else if ( nRecords <= 0xffffff )
+				nLen = makeSrec(textLine, 6, (unsigned long) nRecords, NULL, 0);
+			nLen += makeSrec(&textLine[nLen], 10 - chunk[0].nSrecType, 0, NULL, 0);
+			if ( nResult == 0 )
+				nResult = ( fwrite(textLine, 1, nLen, fp) != (size_t) nLen );
+		}
+		else if ( nResult == 0 )
+			nResult = fileTrailer(fp, cv->nFormat);
+	}
+
+	if ( fclose(fp) && nResult == 0 )
+		nResult = 1;
+
+	if ( nResult )
+		imageMessage(cv->message, cv->arg, IMAGE_EFILE, "writeImageFile() error writing file '%s'", sName);
+	else
+		imageMessage(cv->message, cv->arg, IMAGE_NOTE, "writeImageFile() '%s' 0x%lx to 0x%lx", sName, lo, hi);
+
+	return nResult;
+}
+
+/*
+ * timeMs()
+ *
+ * return monotonic clock time stamp in milli-seconds
+ *
+ */
+static long long timeMs(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((long long) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/*
+ * imageMessage()
+ *
+ * format a message and pass it with code 'nCode' to callback 'message',
+ * the message is dropped when there is no callback
+ *
+ */
+static void imageMessage(t_message message, void *arg, int nCode, const char *sFormat, ...)
+{
+	char	sMessage[TEXT_LEN * 4];
+	va_list	args;
+
+	if ( message == NULL )
+		return;
+
+	va_start(args, sFormat);
+	vsnprintf(sMessage, sizeof(sMessage), sFormat, args);
+	va_end(args);
+
+	message(arg, nCode, sMessage);
+}
@@ -0,0 +1,109 @@
+/*
+ * image.h
+ *
+ *      Purpose:
+ *
+ *      image file formats and hardware free image handling:
+ *      binary, S-record and Intel HEX parsing, formatting and
+ *      detection, and the multi-threaded convert mode
+ *
+ */
+
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include <stdio.h>
+
+/*
+ * type definitions
+ */
+typedef	unsigned char	t_byte;
+typedef unsigned short	t_word;
+typedef void (*t_message)(void*, int, const char*);	// caller argument, IMAGE_* code and message text
+
+/*
+ * definitions
+ */
+#define TEXT_LEN	80
+
+#define IO_BUFFER	(64*1024)	// stdio buffer size for file and pipe streams
+#define INPUT_ALLOC	(32*1024)	// initial input file memory allocation, doubled as needed
+#define RECORD_LEN	528			// longest text record line: Intel HEX with 255 byte count
+
+#define S_RECORD    1			// data source/destination flags
+#define BINARY      2
+#define INTEL_HEX	3
+
+#define STDIO_NAME	"-"			// file name for stdin/stdout streams
+
+#define SREC_BYTES	32			// data bytes per S-record line in output
+#define IHEX_BYTES	16			// data bytes per Intel HEX line in output
+
+#define SREC_HEADER	"eepromprog"	// S0 header record module name
+
+#define RANGE_START	1			// start and end of range were given
+#define RANGE_END	2
+
+#define IMAGE_MAX	(256UL*1024*1024)	// largest address span of a convert mode image
+#define CHUNK_MIN	(64*1024)	// smallest text input or output chunk worth a thread
+#define THREAD_MAX	64
+
+#define IMAGE_NOTE		0		// message codes, information
+#define IMAGE_EFILE		1		// file open, read or write error
+#define IMAGE_EFORMAT	2		// bad image record or checksum
+#define IMAGE_ERANGE	3		// address range empty or too large
+#define IMAGE_EMEMORY	4		// out of memory
+
+/*
+ * sparse memory image for convert mode
+ */
+struct image
+{
+	unsigned long	base;					// lowest address held in image
+	unsigned long	size;					// bytes from lowest to highest address
+	t_byte			*data;
+	t_byte			*used;					// '1' where 'data' holds a byte from an input file
+};
+
+/*
+ * convert mode options
+ */
+struct convert
+{
+	char			*sOutput;				// output file name, '-' for stdout
+	int				nFormat;				// output file format
+	int				nStdoutFd;				// data output stream when file name is '-'
+	unsigned long	start;					// output range, used per 'nRangeFlag'
+	unsigned long	end;
+	int				nRangeFlag;
+	int				nFill;					// gap fill byte, '-1' no fill
+	unsigned long	ulSplit;				// split size, '0' no split
+	int				nThreads;				// decode/encode threads, '0' all online CPUs
+	t_message		message;				// optional message callback
+	void			*arg;					// caller argument of the callback
+};
+
+/*
+ * function prototypes
+ */
+
+// -- image format functions --
+int		loadInput(char*, t_byte**, int*, t_message, void*);	// read complete input file or stdin into memory
+int		detectFormat(t_byte*, int);		// detect S-record, Intel HEX or binary input
+const char	*formatName(int);			// printable format name
+int		getRecord(t_byte*, int, int*, char*);	// get next text record line from memory image
+int		hexByte(char*);					// convert two hex digits to a byte value
+int		parseSrec(char*, int*, unsigned long*, t_byte*);	// parse S-record line
+int		parseIhex(char*, int*, unsigned long*, t_byte*);	// parse Intel HEX line
+int		makeSrec(char*, int, unsigned long, t_byte*, int);	// format S-record line
+int		makeIhex(char*, int, unsigned long, t_byte*, int);	// format Intel HEX line
+int		fileHeader(FILE*, int);			// write file header record
+int		fileWrite(FILE*, int, t_word, t_byte*, int);	// write data to file, either binary, S-record or Intel HEX
+int		fileTrailer(FILE*, int);		// write file termination record
+
+// -- image conversion functions --
+int		convertImage(struct convert*, int, char**);	// convert, merge, crop and split image files
+int		loadImageFile(struct convert*, char*, struct image*);	// load and decode an image file into memory image
+int		writeImageFile(struct convert*, char*, struct image*, unsigned long, unsigned long);	// write memory image range to file
+
+#endif /* __IMAGE_H__ */
@@ -8,118 +8,166 @@
  *
  *      ATMEL 27C256 32Kx8 eeprom programmer
  *      using IEEE-1284 parallel port interface
- *      using libieee1284 library version: 0.2.11-10build1 (precise)
- *      	/usr/include/ieee1284.h
- *      	/usr/lib/i386-linux-gnu/libieee1284.so
+ *      command line interface to the programmer library in eeprom.c
+ *      and the image file library in image.c
  *
- *      Usage: prog { -r | -w | -x | -q | -h } { -b <bin_file> | -t <S-record_file> } [-s <hex_start_offset>] [-e <hex_end_offset>] [-p <port_id>]
+ *      Usage: prog { -r | -w | -a <patch_file> | -x | -q | -u | -I | -h } { -b <bin_file> | -t <S-record_file> | -i <hex_file> } [-s <hex_start_offset>] [-e <hex_end_offset>] [-p <port_id>]
+ *                  [-m <hex_start>:<hex_end>[=<file>] ...]
+ *                  [-c <cpu> [-P <priority>]] [-l] [-T <trace_file>] [-f <hex_fill>] [-B] [-F]
+ *                  [-S <chip_serial>] [-W <wear_file>] [-L <chip_lot>] [--dry-run] [--watch]
+ *             prog -k <cycles> [-s <hex_start_offset>] [-e <hex_end_offset>] [-p <port_id>] [-B] [-S <chip_serial>]
+ *                  [-W <wear_file>] [-L <chip_lot>] [--dry-run [--faults <fault_list>]]
+ *             prog { -A | -R } <trace_file> [-l]
+ *             prog -C { -b <bin_file> | -t <S-record_file> | -i <hex_file> } [-s <hex_start>] [-e <hex_end>]
+ *                  [-f <hex_fill>] [-z <hex_split_size>] [-j <threads>] <in_file>[@<hex_base>] ...
  *
  *      -r	read eeprom
  *      -w	write eeprom
+ *      -a	apply an IPS or offset/bytes list patch file, write only the patched bytes
+ *      	grouped into page writes, after checking the before values given in the patch
  *		-x  erase device
- *      -q	only query the system: list ieee1284 parallel ports and test programer
+ *      -q	only query the system: list ieee1284 parallel ports and test programer,
+ *      	measure port latency, save it to the station profile and predict throughput
+ *      -u	tune bus delays: search the shortest /OE settle, write and erase delays that pass
+ *      	pattern writes with readback, add a safety margin and save them to the station profile.
+ *      	the 256 bytes from the start offset are overwritten during the search and restored
+ *      -k	soak the chip for qualification: write and read back checkerboard, walking bit,
+ *      	address and random patterns over the address range 'cycles' times, report
+ *      	throughput, write cycle time distribution, bit error rates and failing pages.
+ *      	exit code '2' when any write failed or read back wrong
+ *      -I	interactive shell: hexdump, read, write, fill, search and compare commands
+ *      	over a page cache of the eeprom, the port stays claimed between commands
+ *      -C	convert, merge, crop, pad or split image files without programmer hardware
+ *      -A	analyze bus trace file: bus cycles, time per bus phase and slowest operations
+ *      -R	replay bus trace file against an emulated eeprom chip
  *      -h  print help text
  *      -b	binary file image for read of write
  *      -t	S-record text file for read or write
+ *      -i	Intel HEX text file for read or write
+ *      	file name '-' is stdin for write and stdout for read, input format is auto-detected on write
  *      -s	optional start address/offset, 0x0000 if not provided ** ignored for S-record_file
  *      -e	optional end address/offset, to end of eeprom if not provided ** ignored for S-record_file
+ *      -m	read range, repeat for several ranges in one session instead of -s/-e. a range goes
+ *      	to its own file in the -b/-t/-i format, or without '=<file>' into the -t/-i file.
+ *      	ranges are read once in address order, overlapping and adjacent ranges merged
  *      -p	use specified ieee1284 port id
- *
- * To Do
- * 1) create S-rec file from EEPROM read
+ *      -c	real-time mode: lock memory, pin to 'cpu' and run the bus loop under SCHED_FIFO
+ *      -P	SCHED_FIFO priority for real-time mode (bounded to RT_PRIO_MAX)
+ *      -l	print per-operation bus latency histogram, or list bus cycles with -A
+ *      -T	record every port access into a binary bus trace file
+ *      --dry-run	run the action against an emulated programer and predict its time
+ *      	from the station latency profile, without touching the port
+ *      --watch	with -w keep the port claimed and watch the image file, on every rebuild
+ *      	program and verify only the pages that changed, Ctrl-C ends the watch
+ *      --faults	with --dry-run inject chip faults into the emulated eeprom, a comma separated
+ *      	list of flip=<n>, slow=<n>[:<ns>], stuck=<hex_address>:<bit>:<0|1> and seed=<n>, see emu.c
+ *      -f	fill byte for image gaps in convert mode, or for unused bytes of written pages
+ *      -B	write one byte per write cycle instead of one page per write cycle
+ *      -F	write even if the eeprom already holds the image
+ *      -S	chip serial, accumulate the write cycle wear map of this chip across runs
+ *      -W	export the wear map as CSV, or JSON for a '.json' file name
+ *      -L	chip lot, use station profile '<port name>-<chip_lot>' for bus delays and latency
+ *      -z	split convert mode output into files of 'hex_split_size' bytes
+ *      -j	number of convert mode encode/decode threads, default all online CPUs
  *
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-
-#include <ieee1284.h>
-
-/*
- * type definitions
- */
-typedef	unsigned char	t_byte;
-typedef unsigned short	t_word;
+#include <getopt.h>
+
+#include "eeprom.h"
+#include "trace.h"
+#include "emu.h"
+#include "station.h"
+#include "stream.h"
+#include "shell.h"
+#include "wear.h"
+#include "watch.h"
+#include "soak.h"
 
 /*
  * function prototypes
  */
-
-// -- programer functions --
-int		readEEPROM(void);				// read programer function
-int		writeEEPROM(void);				// write programer function
-int		eraseEEPROM(void);				// erase eeprom programer function
-
-// -- general functions --
-int		writeEEPROMbin(void);			// write eeprom from binary file
-int		writeEEPROMsrec(void);			// write eeprom from S-rec file
-int		readBlock(t_word, int);			// read a block from eeprom to buffer starting at address
-int		writeBlock(t_word, int);		// write block to eeprom from buffer starting at address
-int		fileWrite(int, int);			// write data to file, either binary of S-record
-int		isProgReady(void);				// return true if programmer passes loop test
-int		setAddress(t_word, int);		// set read/write address registers
-void	fastByteWrite(t_word, t_byte);	// write byte to address without read verification
-int		writeByte(t_word, t_byte);		// write byte to address
-t_byte	readByte(t_word);				// read byte from address
-void    setStrobe(void);				// set strobe line
-void	clrStrobe(void);				// clear strobe line
-void	pulseStrobe(void);				// pulse the strobe line
-void	selectFunc(int);				// select programer function
+int		readToFile(struct eeprom*);		// read eeprom into output file
+int		saveFile(char*, t_byte*, t_byte*);	// save marked bytes to file
+long	rangeMask(t_byte*);				// mark bytes of the read ranges
+int		rangeRuns(t_byte*);				// count runs of marked bytes
+int		writeFromFile(struct eeprom*);	// write eeprom from input file
+int		patchFromFile(struct eeprom*);	// apply patch file to eeprom
+struct plan	*loadPatch(struct eeprom*, struct plan*);	// load patch file into a write plan
+struct plan	*loadPlan(struct eeprom*);	// load input file into a write plan
+int		dryRun(struct eeprom*, int, const char*);	// predict action time on emulated programer
+int		queryStation(struct eeprom*, const char*);	// measure port latency and predict throughput
+int		tuneStation(struct eeprom*, const char*);	// search shortest reliable bus delays
+int		tuneTrial(struct eeprom*, int, unsigned int);	// stress one bus delay value with pattern writes
+int		profilePath(char*, int, const char*);	// station profile file name of port and chip lot
+long long	dryRunAction(struct eeprom*, struct emu*, struct station*, int, struct plan*, const char*);	// run one emulated action
+void	printProgress(struct eeprom*, const char*, long, long);	// library progress callback
+void	printError(struct eeprom*, int, const char*);	// library error callback
+void	printMessage(void*, int, const char*);	// image library message callback
+void	latencyReport(struct eeprom*);	// print latency histograms
+int		wearFinish(struct eeprom*);		// fold, report, save and export write cycle wear map
 
 /*
  * global definitions
  */
 #define VERSION		"v1.0"
 
-#define USAGE		"Usage: prog { -r | -w | -x | -q | -h } [ -b <bin_file> | -t <S-record_file> ]\n" \
-					"            [-s <hex_start_offset>] [-e <hex_end_offset>] [-p <port_id>]"
+#define USAGE		"Usage: prog { -r | -w | -a <patch_file> | -x | -q | -u | -k <cycles> | -I | -h } [ -b <bin_file> | -t <S-record_file> | -i <hex_file> ]\n" \
+					"            [-s <hex_start_offset>] [-e <hex_end_offset>] [-m <hex_start>:<hex_end>[=<file>] ...] [-p <port_id>]\n" \
+					"            [-c <cpu> [-P <priority>]] [-l] [-T <trace_file>] [-f <hex_fill>] [-B] [-F]\n" \
+					"            [-S <chip_serial>] [-W <wear_file>] [-L <chip_lot>] [--dry-run [--faults <fault_list>]] [--watch]\n" \
+					"       prog { -A | -R } <trace_file> [-l]\n" \
+					"       prog -C [ -b <bin_file> | -t <S-record_file> | -i <hex_file> ] [-s <hex_start>] [-e <hex_end>]\n" \
+					"            [-f <hex_fill>] [-z <hex_split_size>] [-j <threads>] <in_file>[@<hex_base>] ..."
 #define HELP		"\n" \
 					"\t-r   read EEPROM\n" \
 					"\t-w   write EEPROM\n" \
+					"\t-a   apply IPS or offset/bytes list patch, only patched bytes are written,\n" \
+					"\t     list lines '<offset>: <bytes>' or '<offset>: <before bytes> -> <bytes>'\n" \
 					"\t-x   erase device\n" \
-					"\t-q   only query the system: list ieee1284 ports and test programer\n" \
+					"\t-q   only query the system: list ieee1284 ports, test programer,\n" \
+					"\t     calibrate station latency profile and predict throughput\n" \
+					"\t-u   tune bus delays and save them to the station profile,\n" \
+					"\t     256 bytes from start offset are overwritten and restored\n" \
+					"\t-k   soak chip for qualification, write and read back test patterns 'cycles' times,\n" \
+					"\t     report throughput, write cycle times and errors, exit code 2 on errors\n" \
+					"\t-I   interactive shell, keeps the port claimed, 'help' lists commands\n" \
+					"\t-C   convert, merge, crop, pad or split image files, no programmer needed\n" \
+					"\t-A   analyze bus trace file, no programmer needed\n" \
+					"\t-R   replay bus trace file against emulated eeprom, no programmer needed\n" \
 					"\t-h   print help text\n" \
 					"\t-b   binary file image for read of write\n" \
 					"\t-t   S-record text file for read or write\n" \
+					"\t-i   Intel HEX text file for read or write\n" \
+					"\t     file name '-' is stdin/stdout, write input format is auto-detected\n" \
 					"\t-s   optional start offset, 0x0000 if not provided ** ignored for S-record_file\n" \
 					"\t-e   optional end offset, to end of EEPROM if not provided ** ignored for S-record_file\n" \
-					"\t-p   optional specified ieee1284 port ID\n"
-
-#define TEXT_LEN	80
-
-#define EEPROM_SIZE	0x8000		// ATMEL 27C256 eeprom size 32Kx8
-#define DATA_BUFFER 1024		// 1KB temp data buffer statically allocated
-
-#define DATA_INIT	0xff		// initialize data port
-#define CNTRL_INIT	0x0f		// initialize control port
-
-#define	SET_STROBE	0x01		// set strobe bit
-#define CLR_STROBE	0xfe		// clear strobe bit
-
-#define CLR_FUNC	0xf1		// clear function bits
-#define FUNC_LOADD	0x00		// select low address register
-#define FUNC_HIADD	0x02		// select hi address register
-#define FUNC_CS		0x02		// select /CS register
-#define FUNC_WE		0x04		// select /WE
-#define FUNC_OE		0x06		// select /OE
-#define FUNC_LOOP	0x0e		// select programmer loop test
-
-#define TEST		0x80		// loopback test mask
-
-#define CS_SET		0x80		// 'or' and 'and' masks for /CS
-#define CS_CLR		0x7f
-
-#define DIR_READ	-1			// for use with ieee1284_data_dir()
-#define DIR_WRITE	0
-
-#define S_RECORD    1			// data source/destination flags
-#define BINARY      2
+					"\t-m   read range, repeat for several ranges in one session, each to its own file\n" \
+					"\t     with '=<file>', or to the -t/-i file, ranges are sorted and merged\n" \
+					"\t-p   optional specified ieee1284 port ID\n" \
+					"\t-c   real-time mode, lock memory and run bus loop under SCHED_FIFO pinned to CPU\n" \
+					"\t-P   optional SCHED_FIFO priority for real-time mode, default 50, max 80\n" \
+					"\t-l   print per-operation bus latency histogram, list bus cycles with -A\n" \
+					"\t-T   record bus trace file\n" \
+					"\t--dry-run  predict action time from station profile, port is not used\n" \
+					"\t--watch    with -w program changed pages each time the image file is rebuilt\n" \
+					"\t--faults   with --dry-run inject emulated chip faults, comma separated list of\n" \
+					"\t           flip=<n>, slow=<n>[:<ns>], stuck=<hex_address>:<bit>:<0|1>, seed=<n>\n" \
+					"\t-f   convert mode fill byte for gaps in output range,\n" \
+					"\t     write mode fill byte for unused bytes of written pages\n" \
+					"\t-B   write mode one byte per write cycle, default one page per write cycle\n" \
+					"\t-F   write mode force programming, default skip if eeprom already holds image\n" \
+					"\t-S   chip serial, keep write cycle wear map of the chip in ~/.eepromprog/<serial>.wear\n" \
+					"\t-W   export wear map to CSV file, JSON if file name ends in '.json'\n" \
+					"\t-L   chip lot, use station profile ~/.eepromprog/<port>-<lot>.profile\n" \
+					"\t-z   convert mode split output into files of given size\n" \
+					"\t-j   convert mode thread count, default all online CPUs\n"
 
 #define DEF_BIN		"data.bin"	// default binary file
 #define DEF_SREC	"data.srec"	// default S-record file
@@ -128,22 +176,74 @@ void	selectFunc(int);				// select programer function
 #define WRITE		2
 #define ERASE		4
 #define QUERY		8
+#define CONVERT		16
+#define ANALYZE		32
+#define REPLAY		64
+#define SHELL		128
+#define TUNE		256
+#define PATCH		512
+#define SOAK		1024
+
+#define OPT_DRYRUN	4096		// long options without a short option
+#define OPT_WATCH	4097
+#define OPT_FAULTS	4098
+
+#define QUERY_SAMPLES	5000	// port accesses timed per type in query mode
+#define RANGE_MAX		64		// most -m read ranges
+
+#define TUNE_BLOCKS		4		// 64 byte blocks of scratch area overwritten by bus delay tuning
+#define TUNE_REPEATS	8		// pattern passes a delay value must survive
+#define TUNE_MARGIN		50		// tuned delay margin, % of the shortest passing value
+#define TUNE_FLOOR		10		// and at least this % of the default delay
 
-#define WRITEOK		0			// eeprom write byte with no error
-#define WRITETOV	1			// eeprom waiting for bit.7 negate time out
-#define WRITEVER	2			// eeprom write/verify miscompare
+/*
+ * type definitions
+ */
+struct range								// -m read range
+{
+	t_word			start;
+	t_word			end;
+	char			*sFile;					// its output file, NULL for the -b/-t/-i file
+};
 
 /*
  * globals
  */
-struct	parport *port;						// the default ieee1284 programer interface port
-
-t_byte	buffer[DATA_BUFFER];				// data buffer for buffer read and write operations
 char	sOutFileName[TEXT_LEN] = DEF_BIN;	// name of binary file
-int		nFileFlag = 0;						// S-rec or binary file source/destination
+int		nFileFlag = 0;						// S-rec, Intel HEX or binary file source/destination
+int		nStdoutFd = STDOUT_FILENO;			// data output stream when file name is '-'
 
 t_word	startAddress = 0;					// programming start addredd
 t_word	endAddress = EEPROM_SIZE - 1;		// programming end addredd
+unsigned long	ulStart = 0;				// command line addresses, may exceed device size in convert mode
+unsigned long	ulEnd = 0;
+int		nRangeFlag = 0;						// which of -s and -e were given
+struct range	ranges[RANGE_MAX];			// -m read ranges
+int		nRanges = 0;
+
+int		nFill = -1;							// convert mode gap fill byte, '-1' no fill
+unsigned long	ulSplit = 0;				// convert mode split size, '0' no split
+int		nThreads = 0;						// convert mode threads, '0' all online CPUs
+
+char	*sTraceFileName = NULL;				// bus trace file to record, analyze or replay
+char	*sSerial = NULL;					// chip serial of accumulated wear map
+char	*sWearFile = NULL;					// wear map export file
+char	*sLot = NULL;						// chip lot of station profile
+char	*sPatchFile = NULL;					// patch file to apply
+char	*sFaults = NULL;					// emulated chip faults of a dry run
+struct soak	soak;							// soak options and statistics
+int		nSoakResult = 0;					// soak result of a dry run
+
+int		nDryRun = 0;						// predict action time, do not use the port
+int		nWatch = 0;							// reprogram changed pages on image rebuilds
+
+static struct option	longOptions[] =
+{
+	{"dry-run",	no_argument,	NULL,	OPT_DRYRUN},
+	{"watch",	no_argument,	NULL,	OPT_WATCH},
+	{"faults",	required_argument,	NULL,	OPT_FAULTS},
+	{NULL,		0,				NULL,	0}
+};
 
 /*
  * main function
@@ -151,17 +251,23 @@ t_word	endAddress = EEPROM_SIZE - 1;		// programming end addredd
 int main(int argc, char* argv[])
 {
 	struct	parport_list sysports;				// list of system parallel port
-
-	int		nFlags;								// port open flags
-	int		nCapabilities;						// port capability list
+	struct	parport *port;
+	struct	eeprom	programer;					// programer library context
+	struct	convert	cv;							// convert mode options
 
 	int		nOption = 0;						// command line option parsing
 	int		nProgAction = 0;					// programer action
 	int		nPortID = 0;						// default port ID for programer
+	char	sPath[TEXT_LEN * 2];				// wear map or station profile file
+	struct	station	profile;					// station profile of the port
 
-	int		i;
+	int		i, j;
 	int		nExitCode = 0;
 
+	eepromInit(&programer);
+	programer.progress = printProgress;
+	programer.error = printError;
+
 	printf("%s %s %s\n", VERSION, __DATE__, __TIME__);
 
 	/*
@@ -176,7 +282,7 @@ int main(int argc, char* argv[])
 		goto ABORT;
 	}
 
-	while ( (nOption = getopt(argc, argv, "rwxqhb:t:s:e:p:")) != -1 )
+	while ( (nOption = getopt_long(argc, argv, "rwa:xquk:ICA:R:T:b:t:i:s:e:m:p:c:P:lf:BFS:W:L:z:j:h", longOptions, NULL)) != -1 )
 	{
 		switch ( nOption )
 		{
@@ -202,6 +308,35 @@ int main(int argc, char* argv[])
 				}
 				break;
 
+			case 'a':
+				if ( nProgAction == 0 )
+					nProgAction = PATCH;
+				else
+				{
+					printf("too many action switches\n");
+					nExitCode = 1;
+					goto ABORT;
+				}
+				sPatchFile = optarg;
+				break;
+
+			case 'k':
+				if ( nProgAction == 0 )
+					nProgAction = SOAK;
+				else
+				{
+					printf("too many action switches\n");
+					nExitCode = 1;
+					goto ABORT;
+				}
+				if ( sscanf(optarg, "%ld", &soak.nCycles) != 1 || soak.nCycles < 1 )
+				{
+					printf("invalid soak cycle count '%s'\n", optarg);
+					nExitCode = 1;
+					goto ABORT;
+				}
+				break;
+
 			case 'h':
 				printf("\n%s\n", USAGE);
 				printf("%s", HELP);
@@ -230,10 +365,60 @@ int main(int argc, char* argv[])
 				}
 				break;
 
+			case 'u':
+				if ( nProgAction == 0 )
+					nProgAction = TUNE;
+				else
+				{
+					printf("too many action switches\n");
+					nExitCode = 1;
+					goto ABORT;
+				}
+				break;
+
+			case 'I':
+				if ( nProgAction == 0 )
+					nProgAction = SHELL;
+				else
+				{
+					printf("too many action switches\n");
+					nExitCode = 1;
+					goto ABORT;
+				}
+				break;
+
+			case 'C':
+				if ( nProgAction == 0 )
+					nProgAction = CONVERT;
+				else
+				{
+					printf("too many action switches\n");
+					nExitCode = 1;
+					goto ABORT;
+				}
+				break;
+
+			case 'A':
+			case 'R':
+				if ( nProgAction == 0 )
+					nProgAction = (nOption == 'A') ? ANALYZE : REPLAY;
+				else
+				{
+					printf("too many action switches\n");
+					nExitCode = 1;
+					goto ABORT;
+				}
+				sTraceFileName = optarg;
+				break;
+
+			case 'T':
+				sTraceFileName = optarg;
+				break;
+
 			case 'b':
-                if ( nFileFlag == S_RECORD )
+                if ( nFileFlag == S_RECORD || nFileFlag == INTEL_HEX )
                 {
-                    printf("S-record file '%s' is already defined\n", sOutFileName);
+                    printf("text file '%s' is already defined\n", sOutFileName);
                     nExitCode = 1;
                     goto ABORT;
                 }
@@ -242,9 +427,9 @@ int main(int argc, char* argv[])
 				break;
 
 			case 't':
-                if ( nFileFlag == BINARY )
+                if ( nFileFlag == BINARY || nFileFlag == INTEL_HEX )
                 {
-                    printf("binary file '%s' is already defined\n", sOutFileName);
+                    printf("file '%s' is already defined\n", sOutFileName);
                     nExitCode = 1;
                     goto ABORT;
                 }
@@ -252,18 +437,133 @@ int main(int argc, char* argv[])
                 nFileFlag = S_RECORD;
 				break;
 
+			case 'i':
+                if ( nFileFlag == BINARY || nFileFlag == S_RECORD )
+                {
+                    printf("file '%s' is already defined\n", sOutFileName);
+                    nExitCode = 1;
+                    goto ABORT;
+                }
+				strncpy(sOutFileName, optarg, TEXT_LEN-1);
+                nFileFlag = INTEL_HEX;
+				break;
+
 			case 's':
-				sscanf(optarg, "%hx", &startAddress);
+				sscanf(optarg, "%lx", &ulStart);
+				nRangeFlag |= RANGE_START;
 				break;
 
 			case 'e':
-				sscanf(optarg, "%hx", &endAddress);
+				sscanf(optarg, "%lx", &ulEnd);
+				nRangeFlag |= RANGE_END;
+				break;
+
+			case 'm':
+				if ( nRanges == RANGE_MAX )
+				{
+					printf("too many read ranges, at most %d\n", RANGE_MAX);
+					nExitCode = 1;
+					goto ABORT;
+				}
+				i = 0;
+				if ( sscanf(optarg, "%lx:%lx%n", &ulStart, &ulEnd, &i) != 2 || (optarg[i] != '\0' && (optarg[i] != '=' || optarg[i + 1] == '\0')) ||
+					 ulStart > ulEnd || ulEnd >= EEPROM_SIZE )
+				{
+					printf("invalid read range '%s', use <hex_start>:<hex_end>[=<file>]\n", optarg);
+					nExitCode = 1;
+					goto ABORT;
+				}
+				ranges[nRanges].start = (t_word) ulStart;
+				ranges[nRanges].end = (t_word) ulEnd;
+				ranges[nRanges].sFile = (optarg[i] == '=') ? &optarg[i + 1] : NULL;
+				nRanges++;
+				ulStart = ulEnd = 0;
 				break;
 
 			case 'p':
 				sscanf(optarg, "%d", &nPortID);
 				break;
 
+			case 'c':
+				sscanf(optarg, "%d", &programer.nRtCpu);
+				if ( programer.nRtCpu < 0 || programer.nRtCpu >= sysconf(_SC_NPROCESSORS_CONF) )
+				{
+					printf("CPU %d out of range\n", programer.nRtCpu);
+					nExitCode = 1;
+					goto ABORT;
+				}
+				break;
+
+			case 'P':
+				sscanf(optarg, "%d", &programer.nRtPriority);
+				break;
+
+			case 'l':
+				programer.nLatencyFlag = 1;
+				break;
+
+			case 'f':
+				if ( sscanf(optarg, "%x", &nFill) != 1 || nFill < 0 || nFill > 0xff )
+				{
+					printf("invalid fill byte '%s'\n", optarg);
+					nExitCode = 1;
+					goto ABORT;
+				}
+				programer.nFill = nFill;
+				break;
+
+			case 'B':
+				programer.nPageMode = 0;
+				break;
+
+			case 'F':
+				programer.nForce = 1;
+				break;
+
+			case 'S':
+				sSerial = optarg;
+				break;
+
+			case 'W':
+				sWearFile = optarg;
+				break;
+
+			case 'L':
+				if ( stationName(optarg) )			// lot is part of a file name
+				{
+					printf("invalid chip lot '%s', use letters, digits, '-', '_' and '.'\n", optarg);
+					nExitCode = 1;
+					goto ABORT;
+				}
+				sLot = optarg;
+				break;
+
+			case OPT_DRYRUN:
+				nDryRun = 1;
+				break;
+
+			case OPT_WATCH:
+				nWatch = 1;
+				break;
+
+			case OPT_FAULTS:
+				sFaults = optarg;
+				break;
+
+			case 'z':
+				sscanf(optarg, "%lx", &ulSplit);
+				break;
+
+			case 'j':
+				sscanf(optarg, "%d", &nThreads);
+				if ( nThreads < 1 || nThreads > THREAD_MAX )
+				{
+					printf("thread count out of range 1 to %d\n", THREAD_MAX);
+					nExitCode = 1;
+					goto ABORT;
+				}
+				break;
+
 			case '?':
 				printf("\n%s\n", USAGE);
 				nExitCode = 1;
@@ -271,25 +571,138 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	if ( startAddress > endAddress )		// check for valid start and end addresses
+	if ( nProgAction != CONVERT )			// device offsets are 16 bit
+	{
+		if ( ((nRangeFlag & RANGE_START) && ulStart > 0xffff) || ((nRangeFlag & RANGE_END) && ulEnd > 0xffff) )
+		{
+			printf("address out of range\n");
+			nExitCode = 1;
+			goto ABORT;
+		}
+
+		if ( nRangeFlag & RANGE_START )
+			startAddress = (t_word) ulStart;
+		if ( nRangeFlag & RANGE_END )
+			endAddress = (t_word) ulEnd;
+	}
+
+	if ( startAddress > endAddress ||		// check for valid start and end addresses
+		 (nRangeFlag == (RANGE_START | RANGE_END) && ulStart > ulEnd) )
 	{
 		printf("start address is larger than end address\n");
 		nExitCode = 1;
 		goto ABORT;
 	}
 
+	if ( nWatch && (nProgAction != WRITE || nDryRun) )
+	{
+		printf("watch mode needs -w and has no dry run\n");
+		nExitCode = 1;
+		goto ABORT;
+	}
+
+	if ( sFaults && !nDryRun )
+	{
+		printf("fault injection needs --dry-run\n");
+		nExitCode = 1;
+		goto ABORT;
+	}
+
+	soak.start = startAddress;				// soak range and pattern seed
+	soak.end = endAddress;
+	soak.seed = (unsigned long long) time(NULL);
+
+	if ( programer.nRtPriority < 1 || programer.nRtPriority > RT_PRIO_MAX )	// keep real-time priority bounded
+	{
+		printf("real-time priority %d out of range 1 to %d\n", programer.nRtPriority, RT_PRIO_MAX);
+		nExitCode = 1;
+		goto ABORT;
+	}
+
     if ( nFileFlag == 0 )                   // if binary or S-record files were not specified use binary form
     {
     	nFileFlag = BINARY;
     }
-    
+    else if ( nProgAction == WRITE && strcmp(sOutFileName, STDIO_NAME) != 0 )	// parse a named input in the given format
+    {
+    	programer.nFormat = nFileFlag;
+    }
+
+	if ( nRanges && (nProgAction != READ || nRangeFlag) )
+	{
+		printf("read ranges need -r and replace -s/-e\n");
+		nExitCode = 1;
+		goto ABORT;
+	}
+
+	for ( i = 0; i < nRanges && nFileFlag == BINARY; i++ )	// a binary file holds one contiguous range
+	{
+		if ( (ranges[i].sFile == NULL && nRanges > 1) ||
+			 (ranges[i].sFile && strcmp(ranges[i].sFile, sOutFileName) == 0) )
+			break;
+		for ( j = 0; j < i && (ranges[j].sFile == NULL || strcmp(ranges[i].sFile, ranges[j].sFile)); j++ )
+			;
+		if ( j < i )
+			break;
+	}
+
+	if ( i < nRanges && nFileFlag == BINARY )
+	{
+		printf("binary files hold one range each, name a file per range or use -t/-i\n");
+		nExitCode = 1;
+		goto ABORT;
+	}
+
+	/*
+	 * when eeprom data is read to stdout move all progress messages to stderr
+	 * and keep a private descriptor of the original stdout for the data stream.
+	 * messages already buffered by stdio are flushed later to the new stderr target.
+	 */
+	if ( (nProgAction == READ || nProgAction == CONVERT) && strcmp(sOutFileName, STDIO_NAME) == 0 )
+	{
+		nStdoutFd = dup(STDOUT_FILENO);
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+	}
+
     /*
      * command line parameter check point. can be commented out later.
      */
 	printf("\tfile: '%s'\n", sOutFileName);
-    printf("\tfile format 1=srec 2=bin: %d\n", nFileFlag);
+    printf("\tfile format 1=srec 2=bin 3=ihex: %d\n", nFileFlag);
 	printf("\tstart: 0x%04hx, end: 0x%04hx\n", startAddress, endAddress);
 	printf("\tport ID: %d\n", nPortID);
+	if ( programer.nRtCpu >= 0 )
+		printf("\treal-time CPU: %d, priority: %d\n", programer.nRtCpu, programer.nRtPriority);
+
+	if ( nProgAction == ANALYZE )			// trace analysis and replay do not use the programer
+	{
+		nExitCode = traceAnalyze(sTraceFileName, programer.nLatencyFlag);
+		goto ABORT;
+	}
+
+	if ( nProgAction == REPLAY )
+	{
+		nExitCode = traceReplay(sTraceFileName);
+		goto ABORT;
+	}
+
+	if ( nProgAction == CONVERT )			// convert mode does not use the programer
+	{
+		cv.sOutput = sOutFileName;
+		cv.nFormat = nFileFlag;
+		cv.nStdoutFd = nStdoutFd;
+		cv.start = ulStart;
+		cv.end = ulEnd;
+		cv.nRangeFlag = nRangeFlag;
+		cv.nFill = nFill;
+		cv.ulSplit = ulSplit;
+		cv.nThreads = nThreads;
+		cv.message = printMessage;
+		cv.arg = NULL;
+
+		nExitCode = convertImage(&cv, argc - optind, &argv[optind]);
+		goto ABORT;
+	}
 
 	/*
 	 * query the system to find available ports
@@ -323,7 +736,7 @@ int main(int argc, char* argv[])
 	if ( sysports.portc == 0 )
 		goto EXIT_NOPORTS;
 
-	if ( nPortID > sysports.portc )
+	if ( nPortID >= sysports.portc )
 	{
 		printf("port ID %d out of range\n", nPortID);
 		goto EXIT_NOPORTS;
@@ -335,155 +748,166 @@ int main(int argc, char* argv[])
 		printf("\tport ID: %d, name: '%s', at address: 0x%04lx\n", i, port->name, port->base_addr);
 	}
 
-	/*
-	 * port usage sequence:
-	 * 1. open		ieee1284_open()
-	 * 2. claim		ieee1284_claim()
-	 * 3. do IO work
-	 * 4. release	ieee1284_release()
-	 * 5. close		ieee1284_close()
-	 *
-	 */
-	nFlags = 0;								// not exclusive use of the port
-	nCapabilities = CAP1284_RAW;			// use raw manipulation option
+	if ( nDryRun && (nProgAction == SHELL || nProgAction == TUNE) )
+	{
+		printf("%s mode has no dry run\n", (nProgAction == SHELL) ? "interactive" : "tuning");
+		nExitCode = 1;
+		goto EXIT_NOPORTS;
+	}
 
 	/*
-	 * open port
+	 * apply bus delays tuned for the station and chip lot
 	 */
-	printf("ieee1284_open() ");
-	switch ( ieee1284_open(sysports.portv[nPortID], nFlags, &nCapabilities) )
+	stationInit(&profile);
+	if ( profilePath(sPath, sizeof(sPath), sysports.portv[nPortID]->name) == 0 && stationLoad(&profile, sPath) == 0 )
 	{
-		case E1284_OK:
-			printf("ok\n");
-			break;
-
-		case E1284_INIT:
-			printf("could not initialize or busy\n");
-			nExitCode = -1;
-			break;
-
-		case E1284_NOTAVAIL:
-			printf("capability not available\n");
-			nExitCode = -1;
-			break;
-
-		case E1284_INVALIDPORT:
-			printf("invalid port ID in open\n");
-			nExitCode = -1;
-			break;
-
-		case E1284_NOMEM:
-		case E1284_SYS:
-			printf("system error on out of memory\n");
-			nExitCode = -1;
-			break;
-
-		default:
-			printf("unspecified error\n");
-			nExitCode = -1;
-			break;
+		stationApply(&profile, &programer);
+		printf("station profile '%s', delays: settle %uus, write %uus, erase %uus\n",
+				sPath, programer.nSettleUs, programer.nWriteUs, programer.nEraseUs);
 	}
 
-	if ( nExitCode )
+	if ( nDryRun )							// predict the action on an emulated programer
+	{
+		if ( (nExitCode = dryRun(&programer, nProgAction, sysports.portv[nPortID]->name)) == 0 )
+			nExitCode = nSoakResult;
 		goto EXIT_NOOPEN;
+	}
 
 	/*
-	 * claim port
+	 * collect write cycle telemetry, add it to the chip's wear map
 	 */
-	printf("ieee1284_claim() ");
-	switch ( ieee1284_claim(sysports.portv[nPortID]) )
+	if ( sSerial || sWearFile )
 	{
-		case E1284_OK:
-			printf("ok\n");
-			break;
-
-		case E1284_NOMEM:
-		case E1284_SYS:
-			printf("system error on out of memory\n");
-			nExitCode = -1;
-			break;
-
-		case E1284_INVALIDPORT:
-			printf("invalid port ID in open\n");
-			nExitCode = -1;
-			break;
+		if ( (programer.wear = malloc(sizeof(struct wear))) == NULL )
+		{
+			printf("out of memory\n");
+			nExitCode = 1;
+			goto EXIT_NOOPEN;
+		}
+		wearInit(programer.wear, sSerial ? sSerial : "unnamed");
 
-		default:
-			printf("unspecified error\n");
-			nExitCode = -1;
-			break;
+		if ( sSerial )
+		{
+			if ( wearPath(sPath, sizeof(sPath), sSerial) )
+			{
+				printf("invalid chip serial '%s', use letters, digits, '-', '_' and '.'\n", sSerial);
+				nExitCode = 1;
+				goto EXIT_NOOPEN;
+			}
+			if ( wearLoad(programer.wear, sPath) == 0 )
+				printf("chip '%s' wear map, %ld run(s)\n", sSerial, programer.wear->nRuns);
+		}
 	}
 
-	if ( nExitCode )
-		goto EXIT_NOCLAIM;
-
 	/*
-	 * port IO
-	 *
-	 * port bit assignments:
-	 *
-	 *  data	b7 b6 b5 b4 b3 b2 b1 b0
-	 *
-	 *  contol	b7 b6 b5 b4 b3 b2 b1 b0
-	 *			 |  |  |  |  |  |  |  |
-	 *           |  |  |  |  |  |  |  +- Strobe
-	 *           |  |  |  |  |  |  +---- F0
-	 *           |  |  |  |  |  +------- F1
-	 *           |  |  |  |  +---------- F2
-	 *           |  |  |  +------------- n.c
-	 *           |  |  +---------------- n.c
-	 *           |  +------------------- n.c
-	 *           +---------------------- n.c
-	 *
-	 * 		F2 F1 F0
-	 * 		0  0  0	... A0 - A7 register clk
-	 * 		0  0  1 ... A8 - A14, /CS register clk
-	 * 		0  1  0 ... /WE
-	 * 		0  1  1 ... /OE
-	 * 		1  1  1 ... sys present test (sense on status register b7)
-	 *
-	 *  status	b7 b6 b5 b4 b3 b2 b1 b0
-	 *           |  |  |  |  |  |  |  |
-	 *           |  |  |  |  |  |  |  +- n.c
-	 *           |  |  |  |  |  |  +---- n.c
-	 *           |  |  |  |  |  +------- n.c
-	 *           |  |  |  |  +---------- n.c
-	 *           |  |  |  +------------- n.c
-	 *           |  |  +---------------- n.c
-	 *           |  +------------------- n.c
-	 *           +---------------------- sys present loopback test
-	 *
+	 * start bus trace recording before the port is initialized
 	 */
+	if ( sTraceFileName )
+	{
+		if ( (programer.trace = traceOpen(sTraceFileName)) == NULL )
+		{
+			nExitCode = 1;
+			goto EXIT_NOOPEN;
+		}
+		printf("recording bus trace to '%s'\n", sTraceFileName);
+	}
 
-	port = sysports.portv[nPortID];			// set global variable to use from this point on
+	/*
+	 * open, claim and initialize programer port
+	 */
+	printf("eepromOpen() ");
+	if ( eepromOpen(&programer, sysports.portv[nPortID]) )
+	{
+		printf("failed\n");
+		nExitCode = -1;
+		goto EXIT_NOOPEN;
+	}
+	printf("ok\n");
 
-	ieee1284_write_data(port, DATA_INIT);	// initialize programmer
-	ieee1284_write_control(port, CNTRL_INIT);
-	setAddress(0, CS_SET);
+	if ( programer.nRtCpu >= 0 )
+	{
+		printf("rtEnter() ");
+		if ( rtEnter(&programer) )
+		{
+			printf("failed\n");
+			nExitCode = 1;
+			goto EXIT_NORT;
+		}
+		printf("ok\n");
+	}
 
 	printf("isProgReady() ");
-	if ( isProgReady() )
+	if ( isProgReady(&programer) )
 	{
 		printf("ok\n");
 		switch ( nProgAction )
 		{
 			case READ:		// invoke eeprom read to file process
-				if ( readEEPROM() )
+				if ( readToFile(&programer) )
+				{
 					printf("eeprom read action failed\n");
+					nExitCode = 1;
+				}
 				break;
 
 			case WRITE:		// invoke eeprom write process
-				if ( writeEEPROM() )
+				if ( nWatch )
+				{
+					if ( watchRun(&programer, sOutFileName, startAddress) )
+					{
+						printf("eeprom watch failed\n");
+						nExitCode = 1;
+					}
+				}
+				else if ( writeFromFile(&programer) )
+				{
 					printf("eeprom write action failed\n");
+					nExitCode = 1;
+				}
+				break;
+
+			case PATCH:		// write only the patched bytes
+				if ( patchFromFile(&programer) )
+				{
+					printf("eeprom patch action failed\n");
+					nExitCode = 1;
+				}
 				break;
 
 			case ERASE:
-				eraseEEPROM();
-				printf("eeprom erase complete\n");
+				if ( eraseEEPROM(&programer) )
+				{
+					printf("eeprom erase action failed\n");
+					nExitCode = 1;
+				}
+				else
+					printf("eeprom erase complete\n");
+				break;
+
+			case SHELL:		// interactive commands until 'quit'
+				shellRun(&programer, stdin);
 				break;
 
-			case QUERY:		// nothing else to do here, exit
+			case QUERY:		// calibrate station and exit
 				printf("programer query ok\n");
+				if ( queryStation(&programer, sysports.portv[nPortID]->name) )
+				{
+					printf("station calibration failed\n");
+					nExitCode = 1;
+				}
+				break;
+
+			case TUNE:		// tune bus delays and exit
+				if ( tuneStation(&programer, sysports.portv[nPortID]->name) )
+				{
+					printf("bus delay tuning failed\n");
+					nExitCode = 1;
+				}
+				break;
+
+			case SOAK:		// qualification soak, exit code '2' on errors
+				if ( (nExitCode = soakRun(&programer, &soak)) == 1 )
+					printf("eeprom soak failed\n");
 				break;
 
 			default:
@@ -494,22 +918,27 @@ int main(int argc, char* argv[])
 	else
 		printf("failed\n");
 
-	/*
-	 * code test -- remove after testing
-	 */
-	//printf("setAddress() return %d\n", setAddress(0x7fff));
+	if ( programer.nRtCpu >= 0 )
+		rtLeave(&programer);
+
+	if ( programer.nLatencyFlag )
+		latencyReport(&programer);
 
+	if ( programer.wear && (i = wearFinish(&programer)) && nExitCode == 0 )
+		nExitCode = i;
 
 	/*
 	 * close and clean-up
 	 */
-	selectFunc(FUNC_LOOP);
-	ieee1284_release(sysports.portv[nPortID]);
-
-EXIT_NOCLAIM:
-	ieee1284_close(sysports.portv[nPortID]);
+EXIT_NORT:
+	eepromClose(&programer);
 
 EXIT_NOOPEN:
+	if ( programer.trace && traceClose(programer.trace) )
+		nExitCode = 1;
+
+	free(programer.wear);
+
 EXIT_NOPORTS:
 	ieee1284_free_ports(&sysports);
 
@@ -518,75 +947,119 @@ ABORT:
 }
 
 /*
- * -----------------------------------------
- * ---------  programer functions  ---------
- * -----------------------------------------
+ * readToFile()
+ *
+ * this function will read eeprom data from
+ * 'startAddress' to 'endAddress', or the -m read ranges,
+ * and place read data into a file in either binary image,
+ * S-record or Intel HEX format. each range goes to its own
+ * file or to the -b/-t/-i file, a file holds all its ranges.
+ * file name '-' sends the data to stdout, a '.gz' or '.zst'
+ * file name extension compresses the file
+ *
  */
- 
+int readToFile(struct eeprom *ctx)
+{
+	t_byte	data[EEPROM_SIZE];
+	t_byte	want[EEPROM_SIZE];
+	t_byte	used[EEPROM_SIZE];
+	char	*sName;
+	long	nBytes;
+	int		i, j;
+	int		nResult;
+
+	nBytes = rangeMask(want);
+	if ( nRanges )
+		printf("readToFile() %d ranges merged into %d runs, %ld bytes\n", nRanges, rangeRuns(want), nBytes);
+
+	if ( (nResult = readRanges(ctx, want, data)) )
+		return nResult;
+
+	if ( nRanges == 0 )
+		return saveFile(sOutFileName, want, data);
+
+	for ( i = 0; i < nRanges; i++ )
+	{
+		sName = ranges[i].sFile ? ranges[i].sFile : sOutFileName;
+
+		for ( j = 0; j < i && strcmp(sName, ranges[j].sFile ? ranges[j].sFile : sOutFileName); j++ )
+			;
+		if ( j < i )							// file already saved with an earlier range
+			continue;
+
+		memset(used, 0, sizeof(used));
+		for ( j = i; j < nRanges; j++ )
+		{
+			if ( strcmp(sName, ranges[j].sFile ? ranges[j].sFile : sOutFileName) == 0 )
+				memset(&used[ranges[j].start], 1, ranges[j].end - ranges[j].start + 1);
+		}
+
+		if ( saveFile(sName, used, data) )
+			nResult = 1;
+	}
+
+	return nResult;
+}
+
 /*
- * readEEPROM()
+ * saveFile()
  *
- * this function will read eeprom data from
- * 'nStartAddress' to 'nEndAddress' and place read data into
- * a file in either binary image or S-record format
+ * save the bytes of 'data' marked in 'used' to file 'sName',
+ * or stdout if file name is '-', in the output file format
+ * return '0' on success or '1' on error
  *
  */
-int readEEPROM(void)
+int saveFile(char *sName, t_byte *used, t_byte *data)
 {
-	int		fd;
-	t_word	i;
+	FILE	*fp;
+	FILE	*raw;
+	long	a;
 	int		nCount;
-	int		nRead = 0;
-	int		nWritten;
 	int		nResult = 0;
-	int		nTotalRead = 0;
 
-	printf("readEEPOM() started\n");
+	if ( strcmp(sName, STDIO_NAME) == 0 )
+		fp = fdopen(nStdoutFd, "w");
+	else
+		fp = fopen(sName, "w");
 
-	if ( setAddress(startAddress, CS_SET) )				// validate address range
+	if ( fp == NULL )
 	{
-		printf("readEEPROM() invalid start address 0x%04hx\n", startAddress);
+		printf("saveFile() cound not open file '%s' for writing (errno=%d)\n", sName, errno);
 		return 1;
 	}
 
-	if ( (fd = open(sOutFileName, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) > 0 )
-	{
-		for ( i = startAddress; i <= endAddress; i += (t_word) nRead)
-		{
-			if ( (endAddress - i + 1) > DATA_BUFFER )
-				nCount = DATA_BUFFER;
-			else
-				nCount = (int) (endAddress - i + 1);
+	setvbuf(fp, NULL, _IOFBF, IO_BUFFER);
 
-			nRead = readBlock((t_word) i, nCount);	// read a block of data from eeprom to buffer
+	if ( (raw = streamOpen(fp, sName, 1, NULL, printMessage, NULL)) == NULL )	// '.gz' or '.zst' name compresses
+	{
+		fclose(fp);
+		return 1;
+	}
+	fp = raw;
 
-			if ( nRead != nCount )					// test for address over eeprom size
-			{
-				printf("readEEPROM() read over EEPROM address range\n");
-				nResult = 1;
-				break;
-			}
+	if ( fileHeader(fp, nFileFlag) )
+		nResult = 1;
 
-			nWritten = fileWrite(fd, nRead);		// write data block from buffer to file
+	for ( a = 0; a < EEPROM_SIZE && nResult == 0; a += nCount )	// one run of marked bytes at a time
+	{
+		for ( nCount = 0; (a + nCount) < EEPROM_SIZE && used[a + nCount]; nCount++ )
+			;
 
-			if ( nRead != nWritten )
-			{
-				printf("readEEPROM() error writing file\n");
-				nResult = 1;
-				break;
-			}
-			else
-			{
-				nTotalRead += nRead;
-				printf("\tread %d bytes\n", nTotalRead);
-			}
-		}
+		if ( nCount == 0 )
+			nCount = 1;
+		else if ( fileWrite(fp, nFileFlag, (t_word) a, &data[a], nCount) != nCount )
+			nResult = 1;
+	}
 
-		close(fd);
+	if ( nResult || fileTrailer(fp, nFileFlag) )
+	{
+		printf("saveFile() error writing file '%s'\n", sName);
+		nResult = 1;
 	}
-	else
+
+	if ( fclose(fp) && nResult == 0 )			// buffered data is written here
 	{
-		printf("readEEPROM() cound not open file '%s' for writing (errno=%d)\n", sOutFileName, errno);
+		printf("saveFile() error writing file '%s' (errno=%d)\n", sName, errno);
 		nResult = 1;
 	}
 
@@ -594,554 +1067,844 @@ int readEEPROM(void)
 }
 
 /*
- * writeEEPROM()
+ * rangeMask()
  *
- * this function will write data to eeprom.
- * data will be read from either a binary image file or an S-record file:
- * (1) if data is read from S-record file, then eeprom addresses will be taken from file and 
- * 'nStartAddress' and 'nEndAddress' are ignored.
- * (2) if data is read from a binary image file then data will be written starting at 'nStartAddress'
- * and 'nEndAddress' is ignored.
+ * mark the bytes of the -m read ranges in 'want',
+ * or from 'startAddress' to 'endAddress' without them
+ * return number of marked bytes
  *
  */
-int writeEEPROM(void)
+long rangeMask(t_byte *want)
 {
-	int	nResult = 0;
+	long	a;
+	long	nBytes = 0;
+	int		i;
 
-	if ( nFileFlag == BINARY )
-		nResult = writeEEPROMbin();
-	else
-		nResult = writeEEPROMsrec();
+	memset(want, 0, EEPROM_SIZE);
 
-	return nResult;
+	if ( nRanges == 0 )
+		memset(&want[startAddress], 1, endAddress - startAddress + 1);
+
+	for ( i = 0; i < nRanges; i++ )
+		memset(&want[ranges[i].start], 1, ranges[i].end - ranges[i].start + 1);
+
+	for ( a = 0; a < EEPROM_SIZE; a++ )
+		nBytes += want[a];
+
+	return nBytes;
 }
 
 /*
- * eraseEEPROM()
+ * rangeRuns()
  *
- * this function will erase the eeprom device.
+ * return number of runs of consecutive bytes marked in 'want'
  *
  */
-int eraseEEPROM(void)
+int rangeRuns(t_byte *want)
 {
-	t_word	address;
-
-	int		nByteCount = 0;
+	long	a;
+	int		nRuns = 0;
 
-	for (address = 0; address < EEPROM_SIZE; address++)
+	for ( a = 0; a < EEPROM_SIZE; a++ )
 	{
-		fastByteWrite(address,0xff);					// write blank data pattern
-
-		nByteCount++;
-
-		if ( nByteCount == 64 )							// delay at end of 64 byte block
-		{
-			nByteCount = 0;
-			usleep(20000);
-		}
-
-		if ( (address != 0) && (address % 1024) == 0 )	// display progress
-			printf("eraseEEPROM() erased %d bytes\n", address);
+		if ( want[a] && (a == 0 || !want[a - 1]) )
+			nRuns++;
 	}
 
-	setAddress(0, CS_SET);								// negate CS
-
-	return 0;
+	return nRuns;
 }
 
 /*
- * -----------------------------------------
- * ----------  general functions  ----------
- * -----------------------------------------
- */
-
-/*
- * writeEEPROMbin()
+ * writeFromFile()
  *
- * write eeprom with data from binary file
- * start address used to deterine start offset into device
- * end address is ignored
+ * load the input file, or stdin if file name is '-',
+ * detect its format and write it to eeprom
  *
  */
-int writeEEPROMbin(void)
+int writeFromFile(struct eeprom *ctx)
 {
-	/*
-     * 1. open file
-     * 2. read data from file into buffer 1K or less at the time
-     * 3. write data from buffer to eeprom  (start at 'startAddress')
-     * 4. repeat until end of file of end of device
-     * 5. close file
-     *
-     */
-	int		fd;
-	t_word	i;
-	int		nCount;
-	int		nRead = 0;
-	int		nWritten;
-	int		nResult = 0;
-	int		nFileSize = 0;
-	struct	stat filestat;
-	int		nTotalWritten = 0;
+	struct plan	*plan;
+	int			nResult;
 
-	printf("writeEEPROMbin() started\n");
-
-	if ( setAddress(startAddress, CS_SET) )				// validate address range
-	{
-		printf("writeEEPROMbin() invalid start address 0x%04hx\n", startAddress);
+	if ( (plan = loadPlan(ctx)) == NULL )
 		return 1;
-	}
 
-	if ( (fd = open(sOutFileName, O_RDONLY)) > 0 )
-	{
-		if ( fstat(fd, &filestat) == 0 )
-			nFileSize = filestat.st_size;
-		else
-		{
-			printf("writeEEPROMbin() error getting file size\n");
-			return 1;
-		}
+	nResult = writePlan(ctx, plan);
 
-		if ( nFileSize > EEPROM_SIZE )
-		{
-			printf("writeEEPROMbin() file too large to fit in eeprom device\n");
-			return 1;
-		}
+	if ( plan->nCurrent )
+		printf("writeFromFile() eeprom already current (digest %016llx), programming skipped\n", plan->digest);
 
-		endAddress = startAddress + (t_word) nFileSize - 1;
+	if ( plan->nFallbacks )
+		printf("writeFromFile() %ld pages rewritten in byte mode\n", plan->nFallbacks);
 
-		for ( i = startAddress; i <= endAddress; i += (t_word) nWritten)
-		{
-			if ( (endAddress - i + 1) >= DATA_BUFFER )
-				nCount = DATA_BUFFER;
-			else
-				nCount = (int) (endAddress - i + 1);
+	free(plan);
 
-			nRead = read(fd, buffer, nCount);			// read a block of data from file
+	return nResult;
+}
 
-			nWritten = writeBlock((t_word) i, nRead);	// write data to eeprom
+/*
+ * patchFromFile()
+ *
+ * apply the patch file, or stdin if file name is '-', to the eeprom.
+ * only the patched bytes are read and written, grouped into page writes.
+ * nothing is written if the eeprom differs from the before values of
+ * the patch, or unless forced if the eeprom already holds the patch
+ *
+ */
+int patchFromFile(struct eeprom *ctx)
+{
+	struct plan	*plan;
+	struct plan	*before;
+	long		nDiffer;
+	int			nForce;
+	int			nResult = 0;
 
-			if ( nRead != nWritten )
-			{
-				printf("writeEEPROMbin() error writing EEPROM at address 0x%x\n", (i + nWritten));
-				nResult = 1;
-				break;
-			}
-			else
-			{
-				nTotalWritten += nWritten;
-				printf("\t%d bytes programed\n", nTotalWritten);
-			}
-		}
+	if ( (before = malloc(sizeof(struct plan))) == NULL )
+		return 1;
 
-		close(fd);
+	if ( (plan = loadPatch(ctx, before)) == NULL )
+	{
+		free(before);
+		return 1;
 	}
-	else
+
+	if ( !ctx->nForce && checkPlan(ctx, plan) )
+		printf("patchFromFile() eeprom already patched (digest %016llx), programming skipped\n", plan->digest);
+	else if ( before->nBytes && (nDiffer = verifyPlan(ctx, before)) )
 	{
-		printf("writeEEPROMbin() could not open file '%s' for reading (errno=%d)\n", sOutFileName, errno);
+		printf("patchFromFile() %ld of %ld bytes differ from the patch before values, patch not applied\n", nDiffer, before->nBytes);
 		nResult = 1;
 	}
+	else
+	{
+		nForce = ctx->nForce;					// current check is done
+		ctx->nForce = 1;
+		nResult = writePlan(ctx, plan);
+		ctx->nForce = nForce;
+
+		if ( plan->nFallbacks )
+			printf("patchFromFile() %ld pages rewritten in byte mode\n", plan->nFallbacks);
+	}
+
+	free(plan);
+	free(before);
 
 	return nResult;
 }
 
 /*
- * writeEEPROMsrec()
+ * loadPatch()
  *
- * write eeprom with data from S-rec file
- * start and end addresses are ignored, device offsets
- * are based on S-rec file
+ * load the patch file, or stdin if file name is '-', into a write
+ * plan, patch offsets are relative to 'startAddress'. before values
+ * of the patch go into plan 'before' when it is not NULL
+ * return the plan or NULL on error
  *
  */
-int writeEEPROMsrec(void)
+struct plan *loadPatch(struct eeprom *ctx, struct plan *before)
 {
-	/*
-	 * 1. open file
-	 * 2. read file one record at a time
-	 * 3. extract: byte count, start address, data
-	 * 4. set start address and program data bytes
-	 * 5. repeat until end of S-record file
-	 *
-	 * S-record format
-	 * SnCCAAAAdddddddddd......ddXX\a
-	 *
-	 * S0 : Record data sequence contains vendor specific data rather than program data.
-	 *      String with file name and possibly version info.
-	 * S1, S2, S3: Data sequence, depending on size of address needed.
-	 *             16-bit/64K system uses S1, 24-bit address uses S2 and full 32-bit uses S3.
-	 * S5: Count of S1, S2 and S3 records previously appearing in the file or transmission.
-	 *              The record count is stored in the 2-byte address field.
-	 *              There is no data associated with this record type.
-	 * S7, S8, S9: The address field of the S7, S8, or S9 records may contain a starting address for the program.
-	 *             S7 4-byte address, S8 3-byte address, S9 2 byte address.
-	 *
-	 */
-	FILE	*fp;
-	char	*textLine = NULL;
-	size_t	len = TEXT_LEN;
-	int		nRead;
+	t_byte	*data;
+	int		nLength;
+	int		nIps;
+	int		nResult;
+	struct plan	*plan;
 
-	char	textTemp[TEXT_LEN] = "0x\0";
-	int		nByteCount;
-	int		nDataByte;
-	int		nTotalWritten = 0;
-	int		nWriteResult;
+	if ( (plan = malloc(sizeof(struct plan))) == NULL )
+		return NULL;
 
-	int		nResult = 0;
-	int		i;
+	if ( loadInput(sPatchFile, &data, &nLength, eepromMessage, ctx) )
+	{
+		free(plan);
+		return NULL;
+	}
 
-	printf("writeEEPROMsrec() started\n");
+	nIps = (nLength >= IPS_MAGIC_LEN && memcmp(data, IPS_MAGIC, IPS_MAGIC_LEN) == 0);
 
-	if ( (fp = fopen(sOutFileName, "r")) != NULL )				// open S-record file for reading
+	planInit(plan);
+	if ( before )
+		planInit(before);
+	nResult = planPatch(ctx, plan, before, data, nLength, startAddress);
+	free(data);
+
+	if ( nResult )
 	{
-		while ((nRead = getline(&textLine, &len, fp)) != -1)	// read record from file
-		{
-			if ( textLine[1] == '1' )							// check and process data record 'S1' only
-			{
-				strncpy(&textTemp[2], &textLine[2], 2);			// retrieve byte count
-				textTemp[4] = '\0';
-				sscanf(textTemp, "%x", &nByteCount);
-				nByteCount -= 3;								// adjust for address and checksum bytes
+		free(plan);
+		return NULL;
+	}
 
-				strncpy(&textTemp[2], &textLine[4], 4);			// retrieve write address
-				textTemp[6] = '\0';
-				sscanf(textTemp, "%hx", &startAddress);
+	planBuild(plan, -1);						// no page fill, bytes around the patch stay
+	if ( before )
+		planBuild(before, -1);
 
-				for ( i = 0; i < nByteCount; i++ )				// loop through data bytes
-				{
+	printf("loadPatch() %s patch, %ld bytes in %d pages, %ld before values\n",
+			nIps ? "IPS" : "list", plan->nBytes, plan->nPages, before ? before->nBytes : 0L);
 
-					strncpy(&textTemp[2], &textLine[8 + (i * 2)], 2);	// get data byte
-					textTemp[4] = '\0';
-					sscanf(textTemp, "%x", &nDataByte);
+	return plan;
+}
 
-					nWriteResult = writeByte((t_word) (i + startAddress), (t_byte) nDataByte);	// write byte to EEPROM
+/*
+ * loadPlan()
+ *
+ * load the input file, or stdin if file name is '-',
+ * parse it in the given or detected format and build its write plan
+ * return the plan or NULL on error
+ *
+ */
+struct plan *loadPlan(struct eeprom *ctx)
+{
+	t_byte	*data;
+	int		nLength;
+	int		nResult;
+	struct plan	*plan;
 
-					if ( nWriteResult )							// check for reported errors
-					{
-						printf("\t==> eeprom write error %d (data=0x%x)\n", nWriteResult, nDataByte);
-						break;
-					}
-				}												// loop on bytes in record
+	if ( (plan = malloc(sizeof(struct plan))) == NULL )
+		return NULL;
 
-				if ( nWriteResult == 0 )
-				{
-					nTotalWritten += i;
-					printf("writeEEPROMsrec() %d bytes programed\n", nTotalWritten);
-				}
-			}													// finished processing data record
+	if ( loadInput(sOutFileName, &data, &nLength, eepromMessage, ctx) )
+	{
+		free(plan);
+		return NULL;
+	}
 
-			if ( nWriteResult )									// break outer loop on error
-				break;
-		}														// read next record until end of file
+	printf("loadPlan() %s input, %d bytes\n", formatName(ctx->nFormat ? ctx->nFormat : detectFormat(data, nLength)), nLength);
 
-		free(textLine);											// free temp record text buffer allocated by getline()
-		fclose(fp);												// close file
-	}
-	else
+	planInit(plan);
+	nResult = planImage(ctx, plan, data, nLength, startAddress);
+	free(data);
+
+	if ( nResult )
 	{
-		printf("writeEEPROMsrec() could not open file '%s' for reading (errno=%d)\n", sOutFileName, errno);
-		nResult = 1;
+		free(plan);
+		return NULL;
 	}
 
-	return nResult;
+	planBuild(plan, ctx->nFill);
+	printf("loadPlan() %ld bytes in %d pages, %ld overlapping, %ld filled, %s mode\n",
+			plan->nBytes, plan->nPages, plan->nDuplicates, plan->nFilled, ctx->nPageMode ? "page" : "byte");
+
+	return plan;
 }
 
 /*
- * readBlock()
+ * dryRun()
  *
- * read a block of data of length 'nCount' from eeprom
- * starting at 'address'.
- * return number of bytes read from eeprom.
+ * validate and run action 'nAction' on an emulated programer with
+ * the latency model of station port 'sPort', report the bus operations
+ * it takes and its predicted time. for writes also predict the
+ * time with each write option changed, fastest first.
+ * the port is not opened.
  *
  */
-int readBlock(t_word address, int nCount)
+int dryRun(struct eeprom *ctx, int nAction, const char *sPort)
 {
-	int	i;
-	t_byte	byte;
+	struct station	model;
+	struct emu		*emu;
+	struct plan		*plan = NULL;
+	char			sPath[TEXT_LEN * 2];
+	t_progress		progress;
+
+	const char		*sOption[3];
+	long long		predicted[3];
+	int				nOptions = 0;
+	int				nPageMode;
+	int				i, j;
+	long long		t;
+	const char		*s;
+
+	stationInit(&model);
+	if ( profilePath(sPath, sizeof(sPath), sPort) == 0 && stationLoad(&model, sPath) == 0 )
+		printf("dryRun() station profile '%s'\n", sPath);
+	else
+		printf("dryRun() no station profile for port '%s', using default latency model\n", sPort);
+
+	if ( (emu = malloc(sizeof(struct emu))) == NULL )
+		return 1;
 
-	for (i = 0; i < nCount; i++)
+	if ( nAction == PATCH )						// predicted as a write of the patched bytes
 	{
-		if ( (i + address) > (EEPROM_SIZE - 1) )	// test address for out of eeprom size range
-			break;
+		if ( (plan = loadPatch(ctx, NULL)) == NULL )
+		{
+			free(emu);
+			return 1;
+		}
+		nAction = WRITE;
+	}
+	else if ( nAction == WRITE && (plan = loadPlan(ctx)) == NULL )
+	{
+		free(emu);
+		return 1;
+	}
 
-		byte = readByte((t_word) i + address);		// read a byte from eeprom
-		buffer[i] = byte;							// store in buffer
+	if ( sFaults )								// check the fault list once, dryRunAction() applies it
+	{
+		emuInit(emu, 1);
+		if ( emuFaults(emu, sFaults) )
+		{
+			printf("dryRun() invalid fault list '%s'\n", sFaults);
+			free(plan);
+			free(emu);
+			return 1;
+		}
 	}
 
-	return i;
-}
+	progress = ctx->progress;					// emulated actions run silently
+	ctx->progress = NULL;
 
-/*
- * writeBlock()
- *
- * write block of 'nCount' bytes from buffer to eeprom
- * starting at 'address'.
- * return number of bytes written to eeprom.
- *
- */
-int writeBlock(t_word address, int nCount)
-{
-	int	i;
-	t_byte	byte;
-	int nWriteResult;
+	predicted[nOptions] = dryRunAction(ctx, emu, &model, nAction, plan, "requested");
+	sOption[nOptions++] = "as requested";
 
-	for (i = 0; i < nCount; i++)
+	if ( nAction == WRITE && predicted[0] >= 0 )
 	{
-		if ( (i + address) > (EEPROM_SIZE - 1) )				// test address for out of eeprom size range
-			break;
+		nPageMode = ctx->nPageMode;				// the other write mode
+		ctx->nPageMode = !nPageMode;
+		predicted[nOptions] = dryRunAction(ctx, emu, &model, nAction, plan, NULL);
+		sOption[nOptions++] = nPageMode ? "byte mode (-B)" : "page mode (no -B)";
+		ctx->nPageMode = nPageMode;
 
-		byte = buffer[i];										// read byte from buffer
-		nWriteResult = writeByte((t_word) (i + address), byte);	// write byte to eeprom
-		
-		if ( nWriteResult )
+		predicted[nOptions] = dryRunAction(ctx, emu, &model, 0, plan, NULL);
+		sOption[nOptions++] = ctx->nForce ? "skip if current (no -F), chip already holds image" :
+											"chip already holds image, skipped after verify";
+
+		for ( i = 1; i < nOptions; i++ )		// fastest first
 		{
-			printf("\t==> eeprom write error %d (data=0x%x)\n", nWriteResult, byte);
-			break;
+			for ( j = i; j > 0 && predicted[j] < predicted[j - 1]; j-- )
+			{
+				t = predicted[j]; predicted[j] = predicted[j - 1]; predicted[j - 1] = t;
+				s = sOption[j]; sOption[j] = sOption[j - 1]; sOption[j - 1] = s;
+			}
 		}
+
+		printf("dryRun() predicted write time by option:\n");
+		for ( i = 0; i < nOptions; i++ )
+			printf("\t%9.3fs  %s\n", predicted[i] / 1e9, sOption[i]);
 	}
 
-	return i;
+	ctx->progress = progress;
+
+	free(plan);
+	free(emu);
+
+	return (predicted[0] < 0);
 }
 
 /*
- * fileWrite()
+ * queryStation()
  *
- * write data from 'buffer' to file descritor.
- * data will be writted as binary or S-record
- * the function will return the number of bytes writen to the file
+ * time port accesses on the claimed port of station 'sPort', print
+ * median and 99th percentile latency per access type and save the
+ * medians as the station profile. the chip write cycle time and the
+ * tuned bus delays are kept from an existing profile. then predict read, write and erase
+ * throughput on an emulated programer with the new profile.
  *
  */
-int fileWrite(int fd, int nCount)
+int queryStation(struct eeprom *ctx, const char *sPort)
 {
-	int	nWritten = 0;
+	static const char	*portName[PORT_OPS] = {"write data", "write control", "read control", "read data", "read status", "data direction"};
+
+	struct station	median;
+	struct station	p99;
+	struct eeprom	sim;							// emulation context, leaves 'ctx' port state alone
+	struct emu		*emu;
+	struct plan		*plan;
+	t_byte			data[EEPROM_SIZE];
+	char			sPath[TEXT_LEN * 2];
+	long long		t;
+	long			nBytes;
+	int				i;
+	int				nResult = 0;
+
+	stationInit(&median);
+	stationInit(&p99);
+
+	if ( profilePath(sPath, sizeof(sPath), sPort) )
+		sPath[0] = '\0';
+	else
+		stationLoad(&median, sPath);
 
-	if ( nFileFlag == BINARY )
+	printf("queryStation() timing %d calls per port access type\n", QUERY_SAMPLES);
+	if ( portBenchmark(ctx, QUERY_SAMPLES, &median, &p99) )
+		return 1;
+
+	for ( i = 0; i < PORT_OPS; i++ )
+		printf("\t%-16s median %7lldns, p99 %7lldns\n", portName[i], median.portNs[i], p99.portNs[i]);
+	printf("\t%-16s median %7lldns, max %7lldns\n", "1ms delay over", median.sleepNs, p99.sleepNs);
+
+	if ( sPath[0] && stationSave(&median, sPath) == 0 )
+		printf("queryStation() station profile saved to '%s'\n", sPath);
+
+	/*
+	 * predict throughput of the actions with the new profile
+	 */
+	emu = malloc(sizeof(struct emu));
+	plan = malloc(sizeof(struct plan));
+	if ( emu == NULL || plan == NULL )
 	{
-		nWritten = write(fd, buffer, nCount);	// write data to binary file
+		free(emu);
+		free(plan);
+		return 1;
 	}
+
+	for ( i = 0; i < EEPROM_SIZE; i++ )				// full device image, no two neighbours alike
+		data[i] = (t_byte) ((i * 7) ^ (i >> 8));
+
+	eepromInit(&sim);
+	stationApply(&median, &sim);
+	sim.nPageMode = ctx->nPageMode;
+	planInit(plan);
+	planAdd(&sim, plan, 0, data, EEPROM_SIZE);
+	planBuild(plan, -1);
+
+	printf("queryStation() predicted throughput:\n");
+
+	nBytes = (long) endAddress - startAddress + 1;
+	if ( (t = dryRunAction(&sim, emu, &median, READ, NULL, NULL)) > 0 )
+		printf("\tread   %8.0f bytes/s, %ld bytes in %.3fs\n", nBytes * 1e9 / t, nBytes, t / 1e9);
 	else
-	{
-		nWritten = 0;
-	}
+		nResult = 1;
+
+	if ( (t = dryRunAction(&sim, emu, &median, WRITE, plan, NULL)) > 0 )
+		printf("\twrite  %8.0f bytes/s, %d bytes in %.3fs, %s mode\n", EEPROM_SIZE * 1e9 / t, EEPROM_SIZE, t / 1e9,
+				sim.nPageMode ? "page" : "byte");
+	else
+		nResult = 1;
 
-	return nWritten;
+	if ( (t = dryRunAction(&sim, emu, &median, ERASE, NULL, NULL)) > 0 )
+		printf("\terase  %8.0f bytes/s, %d bytes in %.3fs\n", EEPROM_SIZE * 1e9 / t, EEPROM_SIZE, t / 1e9);
+	else
+		nResult = 1;
+
+	free(plan);
+	free(emu);
+
+	return nResult;
 }
 
 /*
- * isProgReady()
+ * tuneStation()
  *
- * performe loopback test through parallel port to
- * check presence of programmer.
- * loopback test selects Q7 on 74ls138 and tests state through
- * bit 7 of parallel port's status register.
+ * search the shortest /OE settle, write and erase delays that pass
+ * tuneTrial() on the claimed programer and chip, in that order,
+ * each tuned delay is used while searching the next. a safety margin
+ * is added to the shortest passing values and they are saved to the
+ * profile of station 'sPort' and chip lot. the scratch area at
+ * 'startAddress' is restored when done.
  *
  */
-int isProgReady(void)
+int tuneStation(struct eeprom *ctx, const char *sPort)
 {
-	t_byte	byte;
-	int		nData;
-	int		nResult = 0;
+	static const char	*delayName[3] = {"/OE settle", "write", "erase"};
+	static const unsigned int	delayDefault[3] = {DEF_SETTLE_US, DEF_WRITE_US, DEF_ERASE_US};
+
+	unsigned int	*delay[3];
+	unsigned int	lo, hi, mid;
+	unsigned int	margin;
+	struct station	st;
+	struct plan		*plan;
+	t_byte			save[TUNE_BLOCKS * PAGE_SIZE];
+	char			sPath[TEXT_LEN * 2];
+	int				i;
+	int				nResult = 0;
+
+	if ( startAddress % PAGE_SIZE || (long) startAddress + sizeof(save) > EEPROM_SIZE )
+	{
+		printf("tuneStation() scratch area at 0x%04x must be page aligned and hold %d bytes\n", startAddress, (int) sizeof(save));
+		return 1;
+	}
+
+	if ( (plan = malloc(sizeof(struct plan))) == NULL )
+		return 1;
 
-	byte = (t_byte) ieee1284_read_control(port);		// make sure loopback test function is set
-	byte &= CLR_FUNC;
-	byte |= FUNC_LOOP;
-	byte |= SET_STROBE;
-	ieee1284_write_control(port, (unsigned char) byte);
+	delay[0] = &ctx->nSettleUs;
+	delay[1] = &ctx->nWriteUs;
+	delay[2] = &ctx->nEraseUs;
 
-	nData = ieee1284_read_status(port);		// read status
-	if ( nData & TEST )						// loopback bit is '1' then ok
+	for ( i = 0; i < 3; i++ )						// search from the worst case delays
+		*delay[i] = delayDefault[i];
+
+	if ( readEEPROM(ctx, startAddress, (t_word) (startAddress + sizeof(save) - 1), save) )
 	{
-		byte &= CLR_STROBE;
-		ieee1284_write_control(port, (unsigned char) byte);	// set loopback bit to '0'
-		nData = ieee1284_read_status(port);
-		if ( (nData & TEST) == 0 )			// loopback bit is '0' then ok
+		free(plan);
+		return 1;
+	}
+
+	printf("tuneStation() scratch area 0x%04x to 0x%04x, %d passes per value\n",
+			startAddress, (int) (startAddress + sizeof(save) - 1), TUNE_REPEATS);
+
+	for ( i = 0; i < 3; i++ )
+	{
+		if ( !tuneTrial(ctx, i, delayDefault[i]) )
+		{
+			printf("\t%-10s fails at default %uus, keeping default\n", delayName[i], delayDefault[i]);
+			*delay[i] = delayDefault[i];
 			nResult = 1;
+			continue;
+		}
+
+		lo = 0;										// binary search for the shortest passing value
+		hi = delayDefault[i];
+		while ( lo < hi )
+		{
+			mid = (lo + hi) / 2;
+			if ( tuneTrial(ctx, i, mid) )
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+
+		margin = hi * TUNE_MARGIN / 100;
+		if ( margin < delayDefault[i] * TUNE_FLOOR / 100 )
+			margin = delayDefault[i] * TUNE_FLOOR / 100;
+
+		*delay[i] = (hi + margin < delayDefault[i]) ? hi + margin : delayDefault[i];
+		printf("\t%-10s shortest passing %6uus, tuned %6uus, default %6uus\n", delayName[i], hi, *delay[i], delayDefault[i]);
+	}
+
+	/*
+	 * restore the scratch area with the tuned delays
+	 */
+	planInit(plan);
+	planAdd(ctx, plan, startAddress, save, sizeof(save));
+	planBuild(plan, -1);
+	if ( writePlan(ctx, plan) )
+	{
+		printf("tuneStation() could not restore scratch area\n");
+		nResult = 1;
 	}
+	free(plan);
 
-	ieee1284_write_control(port, CNTRL_INIT);
+	if ( nResult )
+		return nResult;
 
-	return nResult;
+	stationInit(&st);								// keep latency model of an existing profile
+	if ( profilePath(sPath, sizeof(sPath), sPort) )
+		return 1;
+	stationLoad(&st, sPath);
+
+	st.settleUs = ctx->nSettleUs;
+	st.writeUs = ctx->nWriteUs;
+	st.eraseUs = ctx->nEraseUs;
+
+	if ( stationSave(&st, sPath) )
+		return 1;
+
+	printf("tuneStation() bus delays saved to '%s'\n", sPath);
+
+	return 0;
 }
 
 /*
- * setAddress()
+ * tuneTrial()
  *
- * set read/write address registers and global address variable
- * return '1' if address is out of range
+ * set bus delay 'nDelay', '0' /OE settle, '1' write or '2' erase, to
+ * 'nUs' and stress it with TUNE_REPEATS passes of checkerboard, all
+ * zero, all one and inverted checkerboard patterns over the scratch area.
+ * settle passes read a written page back repeatedly, write passes
+ * write a page in byte mode and in page mode, erase passes erase
+ * all scratch blocks back to back, each pass reads back every byte.
+ * a write cycle left running by a failed trial is waited out first.
+ * writes DATA poll after the write delay, so the write delay found is
+ * the shortest wait before the first poll reads a valid DATA bit, not
+ * the chip write cycle time.
+ * return '1' if all passes read back the expected bytes, '0' if not
  *
  */
-int setAddress(t_word address, int nCS)
+int tuneTrial(struct eeprom *ctx, int nDelay, unsigned int nUs)
 {
-	t_byte byte;
+	static const t_byte	pattern[4][2] = {{0x55, 0xaa}, {0x00, 0x00}, {0xff, 0xff}, {0xaa, 0x55}};
 
-	if ( address >= EEPROM_SIZE )
-		return 1;								// exit if address is out of range
+	unsigned int	nSettleUs = ctx->nSettleUs;
+	unsigned int	nWriteUs = ctx->nWriteUs;
+	unsigned int	nEraseUs = ctx->nEraseUs;
+	t_byte			data[TUNE_BLOCKS * PAGE_SIZE];
+	t_byte			used[PAGE_SIZE];
+	int				nRepeat;
+	int				nBlock;
+	int				i;
+	int				nPass = 1;
 
-	byte = (t_byte) (address & 0x00ff);			// extract low address byte
-	ieee1284_write_data(port, (unsigned char) byte);
-	selectFunc(FUNC_LOADD);
-	pulseStrobe();
+	memset(used, 1, sizeof(used));
 
-	byte = (t_byte) ((address & 0xff00) >> 8);	// extract high address byte
-	if ( nCS == CS_CLR )						// CS state
-		byte &= CS_CLR;
-	else
-		byte |= CS_SET;
-	ieee1284_write_data(port, (unsigned char) byte);
-	selectFunc(FUNC_HIADD);
-	pulseStrobe();
+	waitWrite(ctx);									// chip idle before the trial
 
-	return 0;
+	for ( nRepeat = 0; nRepeat < TUNE_REPEATS && nPass; nRepeat++ )
+	{
+		for ( i = 0; i < (int) sizeof(data); i++ )
+			data[i] = pattern[nRepeat % 4][i & 1];
+
+		switch ( nDelay )
+		{
+			case 0:									// settle: pattern written with the current delays
+				if ( writePage(ctx, startAddress, data, used) )
+				{
+					nPass = 0;
+					break;
+				}
+				ctx->nSettleUs = nUs;
+				for ( i = 0; i < TUNE_BLOCKS * PAGE_SIZE && nPass; i++ )
+					nPass = (readByte(ctx, (t_word) (startAddress + i % PAGE_SIZE)) == data[i % PAGE_SIZE]);
+				ctx->nSettleUs = nSettleUs;
+				break;
+
+			case 1:									// write: one page byte by byte, the next in one cycle
+				ctx->nWriteUs = nUs;
+				for ( i = 0; i < PAGE_SIZE && nPass; i++ )
+					nPass = (writeByte(ctx, (t_word) (startAddress + i), data[i]) == 0);
+				if ( nPass )
+					nPass = (writePage(ctx, (t_word) (startAddress + PAGE_SIZE), &data[PAGE_SIZE], used) == 0);
+				ctx->nWriteUs = nWriteUs;
+				for ( i = 0; i < 2 * PAGE_SIZE && nPass; i++ )
+					nPass = (readByte(ctx, (t_word) (startAddress + i)) == data[i]);
+				break;
+
+			case 2:									// erase: blocks written with the current delays
+				for ( nBlock = 0; nBlock < TUNE_BLOCKS && nPass; nBlock++ )
+					nPass = (writePage(ctx, (t_word) (startAddress + nBlock * PAGE_SIZE), &data[nBlock * PAGE_SIZE], used) == 0);
+				if ( !nPass )
+					break;
+				ctx->nEraseUs = nUs;
+				for ( nBlock = 0; nBlock < TUNE_BLOCKS; nBlock++ )
+					eraseBlock(ctx, (t_word) (startAddress + nBlock * PAGE_SIZE));
+				ctx->nEraseUs = nEraseUs;
+				for ( i = 0; i < TUNE_BLOCKS * PAGE_SIZE && nPass; i++ )
+					nPass = (readByte(ctx, (t_word) (startAddress + i)) == 0xff);
+				break;
+		}
+	}
+
+	return nPass;
 }
 
 /*
- * fastByteWrite()
+ * profilePath()
  *
- * write 'byte' to 'address' without write verification
- * use to load special eeprom commands
+ * build station profile file name of port 'sPort' into 'sPath',
+ * with a '-L' chip lot the profile is '<port>-<lot>'
+ * return '0' on success, '1' if there is no profile file name
+ * or the lot is not a file name part, see stationName()
  *
  */
-void fastByteWrite(t_word address, t_byte byte)
+int profilePath(char *sPath, int nLength, const char *sPort)
 {
-	setAddress(address, CS_CLR);						// setup write address and assert CS
+	char	sName[TEXT_LEN];
+
+	if ( sLot == NULL )
+		return stationPath(sPath, nLength, sPort);
+
+	if ( stationName(sLot) )
+		return 1;
+
+	if ( snprintf(sName, sizeof(sName), "%s-%s", sPort, sLot) >= (int) sizeof(sName) )
+		return 1;
 
-	selectFunc(FUNC_WE);								// select eeprom /WE function
-	ieee1284_write_data(port, (unsigned char) byte);	// write data
-	pulseStrobe();										// pulse /WE line to program
+	return stationPath(sPath, nLength, sName);
 }
 
 /*
- * void	writeByte(int);
+ * dryRunAction()
  *
- * write a byte to the eeprom at 'address'
- * return error code on write time-out of verify error, otherwise
- * returns '0'
+ * run action 'nAction' on a freshly erased emulated programer,
+ * '0' writes 'plan' to an emulated eeprom that already holds it. when 'sLabel' is not NULL report the
+ * port accesses, chip cycles and predicted time
+ * return predicted time in nano-seconds or '-1' on error
  *
  */
-int writeByte(t_word address, t_byte byte)
+long long dryRunAction(struct eeprom *ctx, struct emu *emu, struct station *model, int nAction, struct plan *plan, const char *sLabel)
 {
-	int	i = 0;
-	t_byte readTest = 1;
-	t_byte readBack;
-	int nResult = WRITEOK;
-    
-	setAddress(address, CS_CLR);						// setup write address and assert CS
+	static const char	*portName[PORT_OPS] = {"write data", "write control", "read control", "read data", "read status", "data direction"};
 
-	selectFunc(FUNC_WE);								// select eeprom /WE function
-	ieee1284_write_data(port, (unsigned char) byte);	// write data
-	pulseStrobe();										// pulse /WE line to program
-
-	usleep(1000);
+	t_byte	data[EEPROM_SIZE];
+	t_byte	want[EEPROM_SIZE];
+	int		nResult = EEPROM_OK;
+	long	nTotal = 0;
+	int		nForce;
+	int		i;
 
-	setAddress(address, CS_SET);						// negate CS
+	eepromEmulate(ctx, emu, model);
+	if ( sFaults )
+		emuFaults(emu, sFaults);
 
-	while ( readTest )									// read-test for inverted I/O7 bit
+	if ( !isProgReady(ctx) )
+		nResult = EEPROM_EPORT;
+	else
 	{
-		readBack = readByte(address);					// read back the byte
-		
-		readTest = readBack;							// isolate bit.7
-		readTest ^= byte;
-		readTest &= 0x80;
+		switch ( nAction )
+		{
+			case READ:
+				rangeMask(want);
+				nResult = readRanges(ctx, want, data);
+				break;
 
-		//printf("readBack %x, readTest %x\n", readBack, readTest);
+			case WRITE:
+				nResult = writePlan(ctx, plan);
+				break;
 
-		i++;											// crude way to escape on a timeout
-		if ( i > 100 )									// typical write time is about 40 cycles
-		{
-			nResult = WRITETOV;							// timed out while waiting for bit.7 to negate
-			break;
+			case ERASE:
+				nResult = eraseEEPROM(ctx);
+				break;
+
+			case SOAK:
+				if ( (nSoakResult = soakRun(ctx, &soak)) == 1 )
+					nResult = EEPROM_EWRITE;
+				break;
+
+			case 0:
+				for ( i = 0; i < EEPROM_SIZE; i++ )
+				{
+					if ( plan->used[i] )
+						emu->mem[i] = plan->data[i];
+				}
+				nForce = ctx->nForce;
+				ctx->nForce = 0;
+				nResult = writePlan(ctx, plan);
+				ctx->nForce = nForce;
+				break;
 		}
 	}
 
-	if ( (nResult == WRITEOK) && (readBack != byte) )	// check if write is good and verified
-		nResult = WRITEVER;
+	eepromClose(ctx);
 
-	return nResult;
+	if ( nResult )
+		return -1;
+
+	if ( sLabel )
+	{
+		for ( i = 0; i < PORT_OPS; i++ )
+			nTotal += ctx->nPortOps[i];
+
+		printf("dryRun() %s action:\n", sLabel);
+		printf("\tport transactions %ld:", nTotal);
+		for ( i = 0; i < PORT_OPS; i++ )
+			printf("%s %s %ld", i ? "," : "", portName[i], ctx->nPortOps[i]);
+		printf("\n");
+		printf("\tdelays %ld, %.3fms requested\n", ctx->nDelays, ctx->delayUs / 1000.0);
+		printf("\tchip: %ld byte loads, %ld write cycles, %ld DATA polling reads\n", emu->nLoads, emu->nCycles, emu->nPolls);
+		if ( sFaults )
+			printf("\tinjected faults: %ld bits flipped, %ld slow write cycles\n", emu->nFlips, emu->nSlow);
+		printf("\tpredicted time %.3fs\n", ctx->clock / 1e9);
+	}
+
+	return ctx->clock;
 }
 
 /*
- * readByte()
+ * printProgress()
  *
- * read a byte from the eeprom at 'address'
+ * programer library progress callback,
+ * 'nTotal' is '0' when the action does not know its total byte count
  *
  */
-t_byte readByte(t_word address)
+void printProgress(struct eeprom *ctx, const char *sAction, long nDone, long nTotal)
 {
-	t_byte byte;
-
-	setAddress(address, CS_CLR);				// setup read address and assert CS
+	(void) ctx;
 
-	ieee1284_data_dir(port, DIR_READ);			// disable port line drivers
-
-	selectFunc(FUNC_OE);						// select eeprom /OE function
-	clrStrobe();								// activate /OE
-	usleep(10);
-	byte = (t_byte) ieee1284_read_data(port);	// read data
-	setStrobe();								// deactivate /OE
-
-	ieee1284_data_dir(port, DIR_WRITE);			// enable port line drivers
-
-	setAddress(address, CS_SET);				// negate CS
-
-	return byte;
+	if ( nDone == 0 )
+		printf("%s started\n", sAction);
+	else if ( nTotal == 0 )
+		printf("\t%s %ld bytes\n", sAction, nDone);
+	else
+		printf("\t%s %ld of %ld bytes\n", sAction, nDone, nTotal);
 }
 
 /*
- * setStrobe()
+ * printError()
  *
- * set strobe line high
+ * programer library error callback
  *
  */
-void setStrobe(void)
+void printError(struct eeprom *ctx, int nError, const char *sMessage)
 {
-	unsigned char byte;
-
-	byte = ieee1284_read_control(port);
+	(void) ctx;
 
-	byte |= SET_STROBE;
-	ieee1284_write_control(port, byte);
+	if ( nError == EEPROM_OK )
+		printf("%s\n", sMessage);
+	else
+		printf("\t==> %s (error %d)\n", sMessage, nError);
 }
 
 /*
- * clrStrobe()
+ * printMessage()
  *
- * set strobe line low
+ * image library message callback of convert mode
  *
  */
-void clrStrobe(void)
+void printMessage(void *arg, int nCode, const char *sMessage)
 {
-	unsigned char byte;
-
-	byte = ieee1284_read_control(port);
+	(void) arg;
 
-	byte &= CLR_STROBE;
-	ieee1284_write_control(port, byte);
+	if ( nCode == IMAGE_NOTE )
+		printf("%s\n", sMessage);
+	else
+		printf("\t==> %s (error %d)\n", sMessage, nCode);
 }
 
 /*
- * pulseStrobe()
+ * latencyReport()
  *
- * pulse the strobe line
+ * print latency histograms of operation types that were used
  *
  */
-void pulseStrobe(void)
+void latencyReport(struct eeprom *ctx)
 {
-	setStrobe();
-	clrStrobe();
-	setStrobe();
+	static const char	*opName[OP_TYPES] = {"readByte()", "writeByte()", "fastByteWrite()", "writePage()"};
+
+	struct latency	*lat;
+	int				i, j;
+	long			nLow;
+
+	for ( i = 0; i < OP_TYPES; i++ )
+	{
+		lat = &ctx->latency[i];
+		if ( lat->count == 0 )
+			continue;
+
+		printf("%s latency: count %ld, min %lldus, avg %lldus, max %lldus\n", opName[i], lat->count,
+				lat->min / 1000, lat->total / lat->count / 1000, lat->max / 1000);
+
+		for ( j = 0; j < HIST_BINS; j++ )
+		{
+			if ( lat->bins[j] == 0 )
+				continue;
+
+			nLow = (j == 0) ? 0 : (1L << (j - 1));
+			if ( j == (HIST_BINS - 1) )
+				printf("\t>= %6ldus     : %ld\n", nLow, lat->bins[j]);
+			else
+				printf("\t%6ld - %6ldus : %ld\n", nLow, (1L << j), lat->bins[j]);
+		}
+	}
 }
 
 /*
- * selectFunc()
+ * wearFinish()
  *
- * select programer function
+ * fold this run's write cycles into the wear map, report it, save
+ * the chip's accumulated map and export it when requested
+ * return '2' if pages are slowing or failing, '1' on file error, otherwise '0'
  *
  */
-void selectFunc(int nFunc)
+int wearFinish(struct eeprom *ctx)
 {
-	t_byte byte;
+	char	sPath[TEXT_LEN * 2];
+	int		nResult = 0;
 
-	byte = (t_byte) ieee1284_read_control(port);
-	byte &= CLR_FUNC;
-	byte |= (t_byte) nFunc;
-	ieee1284_write_control(port, (unsigned char) byte);
+	if ( wearRun(ctx->wear) && wearReport(ctx->wear) )
+		nResult = 2;
+
+	if ( sSerial && wearPath(sPath, sizeof(sPath), sSerial) == 0 )
+	{
+		if ( wearSave(ctx->wear, sPath) )
+			nResult = 1;
+		else
+			printf("wear map saved to '%s'\n", sPath);
+	}
+
+	if ( sWearFile )
+	{
+		if ( wearExport(ctx->wear, sWearFile) )
+			nResult = 1;
+		else
+			printf("wear map exported to '%s'\n", sWearFile);
+	}
+
+	return nResult;
 }
@@ -0,0 +1,581 @@
+/*
+ * shell.c
+ *
+ *      Purpose:
+ *
+ *      interactive peek/poke shell over a claimed programer port.
+ *
+ *      commands, addresses and bytes in hex, ranges are inclusive:
+ *
+ *      	hexdump <start> [<end>]						dump range, 0x100 bytes if no end
+ *      	read <start> <end> <file> [b|t|i]			save range to binary, S-record or Intel HEX file
+ *      	write <address> <byte> [<byte> ...]			write bytes
+ *      	fill <start> <end> <byte>					write one byte value to a range
+ *      	search <start> <end> <byte> [<byte> ...]	list addresses of a byte sequence
+ *      	compare <start> <end> <file>				compare range with an image file
+ *      	drop										empty the page cache, e.g. after a chip swap
+ *      	help, quit
+ *
+ *      page cache: 'data' holds eeprom contents for every page marked in
+ *      'valid'. commands load the pages of their range that are not
+ *      valid yet, writes go through the planner and then clear the
+ *      written pages so the next view reads back what the chip holds.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "shell.h"
+#include "stream.h"
+
+/*
+ * local type definitions
+ */
+struct shell								// shell state and page cache
+{
+	struct eeprom	*ctx;
+	t_byte			data[EEPROM_SIZE];		// cached eeprom contents
+	t_byte			valid[PAGES];			// '1' page in 'data' is loaded
+	long			nLoaded;				// pages read from eeprom by current command
+	long			nCached;				// pages served from cache by current command
+	struct plan		plan;					// write plan, also image loader for compare
+};
+
+/*
+ * local function prototypes
+ */
+static int	cacheLoad(struct shell*, t_word, t_word);		// load missing pages of a range
+static void	cacheDrop(struct shell*, t_word, t_word);		// invalidate pages of a range
+static int	shellWrite(struct shell*);						// write planned bytes and invalidate their pages
+static int	cmdHexdump(struct shell*, int, char**);
+static int	cmdRead(struct shell*, int, char**);
+static int	cmdWrite(struct shell*, int, char**);
+static int	cmdFill(struct shell*, int, char**);
+static int	cmdSearch(struct shell*, int, char**);
+static int	cmdCompare(struct shell*, int, char**);
+static int	getAddress(char*, t_word*);				// parse hex eeprom address
+static int	getRange(char*, char*, t_word*, t_word*);	// parse hex address range
+static int	getBytes(int, char**, t_byte*);			// parse hex byte list
+
+/*
+ * local definitions
+ */
+#define SHELL_HELP	"\thexdump <start> [<end>]\n" \
+					"\tread <start> <end> <file> [b|t|i]\n" \
+					"\twrite <address> <byte> [<byte> ...]\n" \
+					"\tfill <start> <end> <byte>\n" \
+					"\tsearch <start> <end> <byte> [<byte> ...]\n" \
+					"\tcompare <start> <end> <file>\n" \
+					"\tdrop\n" \
+					"\tquit\n" \
+					"\taddresses and bytes in hex, ranges include <end>\n"
+
+#define DUMP_LINE	16			// bytes per hexdump line
+
+/*
+ * shellRun()
+ *
+ * read and run commands from 'in' until 'quit' or end of input.
+ * a prompt is printed when 'in' is a terminal
+ * return '0' on 'quit' or end of input
+ *
+ */
+int shellRun(struct eeprom *ctx, FILE *in)
+{
+	struct shell	*sh;
+	char			textLine[SHELL_LINE];
+	char			*argv[SHELL_ARGS];
+	int				argc;
+	int				nPrompt;
+	int				nResult;
+	t_progress		progress;
+
+	if ( (sh = calloc(1, sizeof(struct shell))) == NULL )
+	{
+		printf("shellRun() out of memory\n");
+		return 1;
+	}
+
+	sh->ctx = ctx;
+	progress = ctx->progress;									// commands report their own results
+	ctx->progress = NULL;
+	nPrompt = isatty(fileno(in));
+
+	printf("interactive mode, 'help' lists commands\n");
+
+	while ( 1 )
+	{
+		if ( nPrompt )
+			printf(SHELL_PROMPT);
+		fflush(stdout);
+
+		if ( fgets(textLine, sizeof(textLine), in) == NULL )
+			break;
+
+		argc = 0;
+		argv[argc] = strtok(textLine, " \t\r\n");
+		while ( argv[argc] != NULL && argc < (SHELL_ARGS - 1) )
+			argv[++argc] = strtok(NULL, " \t\r\n");
+
+		if ( argc == 0 || argv[0][0] == '#' )
+			continue;
+
+		sh->nLoaded = 0;
+		sh->nCached = 0;
+		nResult = 0;
+
+		if ( strcmp(argv[0], "hexdump") == 0 || strcmp(argv[0], "d") == 0 )
+			nResult = cmdHexdump(sh, argc, argv);
+		else if ( strcmp(argv[0], "read") == 0 )
+			nResult = cmdRead(sh, argc, argv);
+		else if ( strcmp(argv[0], "write") == 0 || strcmp(argv[0], "w") == 0 )
+			nResult = cmdWrite(sh, argc, argv);
+		else if ( strcmp(argv[0], "fill") == 0 )
+			nResult = cmdFill(sh, argc, argv);
+		else if ( strcmp(argv[0], "search") == 0 )
+			nResult = cmdSearch(sh, argc, argv);
+		else if ( strcmp(argv[0], "compare") == 0 )
+			nResult = cmdCompare(sh, argc, argv);
+		else if ( strcmp(argv[0], "drop") == 0 )
+			cacheDrop(sh, 0, EEPROM_SIZE - 1);
+		else if ( strcmp(argv[0], "help") == 0 || strcmp(argv[0], "?") == 0 )
+			printf("%s", SHELL_HELP);
+		else if ( strcmp(argv[0], "quit") == 0 || strcmp(argv[0], "q") == 0 )
+			break;
+		else
+			printf("unknown command '%s', 'help' lists commands\n", argv[0]);
+
+		if ( nResult )
+			printf("%s failed\n", argv[0]);
+
+		if ( sh->nLoaded )
+			printf("(%ld page(s) read from eeprom, %ld cached)\n", sh->nLoaded, sh->nCached);
+	}
+
+	ctx->progress = progress;
+	free(sh);
+
+	return 0;
+}
+
+/*
+ * cacheLoad()
+ *
+ * read the pages of range 'start' to 'end' that are not in the cache
+ * return '0' on success
+ *
+ */
+static int cacheLoad(struct shell *sh, t_word start, t_word end)
+{
+	int		nPage;
+	t_word	address;
+
+	for ( nPage = start / PAGE_SIZE; nPage <= end / PAGE_SIZE; nPage++ )
+	{
+		if ( sh->valid[nPage] )
+		{
+			sh->nCached++;
+			continue;
+		}
+
+		address = (t_word) (nPage * PAGE_SIZE);
+		if ( readBlock(sh->ctx, address, &sh->data[address], PAGE_SIZE) != PAGE_SIZE )
+			return 1;
+
+		sh->valid[nPage] = 1;
+		sh->nLoaded++;
+	}
+
+	return 0;
+}
+
+/*
+ * cacheDrop()
+ *
+ * invalidate cached pages of range 'start' to 'end'
+ *
+ */
+static void cacheDrop(struct shell *sh, t_word start, t_word end)
+{
+	memset(&sh->valid[start / PAGE_SIZE], 0, (end / PAGE_SIZE) - (start / PAGE_SIZE) + 1);
+}
+
+/*
+ * shellWrite()
+ *
+ * write the bytes held in the shell write plan and
+ * invalidate every page the plan touched
+ * return '0' on success
+ *
+ */
+static int shellWrite(struct shell *sh)
+{
+	int		i;
+	int		nResult;
+
+	planBuild(&sh->plan, sh->ctx->nFill);
+	nResult = writePlan(sh->ctx, &sh->plan);
+
+	for ( i = 0; i < sh->plan.nPages; i++ )
+		sh->valid[sh->plan.pages[i] / PAGE_SIZE] = 0;
+
+	if ( nResult == EEPROM_OK )
+	{
+		if ( sh->plan.nCurrent )
+			printf("%ld byte(s) already current, nothing written\n", sh->plan.nBytes);
+		else
+			printf("%ld byte(s) written in %d page(s)\n", sh->plan.nBytes, sh->plan.nPages);
+	}
+
+	return nResult;
+}
+
+/*
+ * cmdHexdump()
+ *
+ * hexdump <start> [<end>]
+ *
+ */
+static int cmdHexdump(struct shell *sh, int argc, char **argv)
+{
+	t_word	start;
+	t_word	end;
+	long	line;
+	long	a;
+	t_byte	byte;
+
+	if ( argc == 2 && getAddress(argv[1], &start) == 0 )
+		end = (start > (EEPROM_SIZE - SHELL_DUMP)) ? (EEPROM_SIZE - 1) : (t_word) (start + SHELL_DUMP - 1);
+	else if ( argc != 3 || getRange(argv[1], argv[2], &start, &end) )
+	{
+		printf("usage: hexdump <start> [<end>]\n");
+		return 1;
+	}
+
+	if ( cacheLoad(sh, start, end) )
+		return 1;
+
+	for ( line = start & ~(DUMP_LINE - 1); line <= end; line += DUMP_LINE )
+	{
+		printf("%04lx ", line);
+
+		for ( a = line; a < (line + DUMP_LINE); a++ )
+		{
+			if ( a == (line + DUMP_LINE / 2) )
+				printf(" ");
+			if ( a < start || a > end )
+				printf("   ");
+			else
+				printf(" %02x", sh->data[a]);
+		}
+
+		printf("  |");
+		for ( a = line; a < (line + DUMP_LINE); a++ )
+		{
+			byte = sh->data[a];
+			if ( a < start || a > end )
+				printf(" ");
+			else
+				printf("%c", (byte >= 0x20 && byte < 0x7f) ? byte : '.');
+		}
+		printf("|\n");
+	}
+
+	return 0;
+}
+
+/*
+ * cmdRead()
+ *
+ * read <start> <end> <file> [b|t|i]
+ *
+ */
+static int cmdRead(struct shell *sh, int argc, char **argv)
+{
+	FILE	*fp;
+	FILE	*raw;
+	t_word	start;
+	t_word	end;
+	int		nFormat = BINARY;
+	int		nCount;
+	int		nResult = 0;
+
+	if ( argc == 5 && strcmp(argv[4], "t") == 0 )
+		nFormat = S_RECORD;
+	else if ( argc == 5 && strcmp(argv[4], "i") == 0 )
+		nFormat = INTEL_HEX;
+	else if ( argc == 5 && strcmp(argv[4], "b") != 0 )
+		argc = 0;
+
+	if ( (argc != 4 && argc != 5) || getRange(argv[1], argv[2], &start, &end) )
+	{
+		printf("usage: read <start> <end> <file> [b|t|i]\n");
+		return 1;
+	}
+
+	if ( cacheLoad(sh, start, end) )
+		return 1;
+
+	if ( (fp = fopen(argv[3], "w")) == NULL )
+	{
+		printf("cmdRead() could not open file '%s' for writing (errno=%d)\n", argv[3], errno);
+		return 1;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, IO_BUFFER);
+
+	if ( (raw = streamOpen(fp, argv[3], 1, NULL, eepromMessage, sh->ctx)) == NULL )
+	{
+		fclose(fp);
+		return 1;
+	}
+	fp = raw;
+
+	nCount = end - start + 1;
+
+	if ( fileHeader(fp, nFormat) ||
+		 fileWrite(fp, nFormat, start, &sh->data[start], nCount) != nCount ||
+		 fileTrailer(fp, nFormat) )
+		nResult = 1;
+
+	if ( fclose(fp) )
+		nResult = 1;
+
+	if ( nResult )
+		printf("cmdRead() error writing file '%s'\n", argv[3]);
+	else
+		printf("%d byte(s) saved to '%s' (%s)\n", nCount, argv[3], formatName(nFormat));
+
+	return nResult;
+}
+
+/*
+ * cmdWrite()
+ *
+ * write <address> <byte> [<byte> ...]
+ *
+ */
+static int cmdWrite(struct shell *sh, int argc, char **argv)
+{
+	t_byte	bytes[SHELL_ARGS];
+	t_word	address;
+	int		nCount;
+
+	if ( argc < 3 || getAddress(argv[1], &address) || (nCount = getBytes(argc - 2, &argv[2], bytes)) < 0 )
+	{
+		printf("usage: write <address> <byte> [<byte> ...]\n");
+		return 1;
+	}
+
+	planInit(&sh->plan);
+	if ( planAdd(sh->ctx, &sh->plan, address, bytes, nCount) )
+		return 1;
+
+	return shellWrite(sh);
+}
+
+/*
+ * cmdFill()
+ *
+ * fill <start> <end> <byte>
+ *
+ */
+static int cmdFill(struct shell *sh, int argc, char **argv)
+{
+	t_byte	bytes[PAGE_SIZE];
+	t_word	start;
+	t_word	end;
+	long	a;
+	int		nCount;
+
+	if ( argc != 4 || getRange(argv[1], argv[2], &start, &end) || getBytes(1, &argv[3], bytes) < 0 )
+	{
+		printf("usage: fill <start> <end> <byte>\n");
+		return 1;
+	}
+
+	memset(bytes, bytes[0], PAGE_SIZE);
+
+	planInit(&sh->plan);
+	for ( a = start; a <= end; a += nCount )
+	{
+		nCount = ((end - a + 1) < PAGE_SIZE) ? (int) (end - a + 1) : PAGE_SIZE;
+		if ( planAdd(sh->ctx, &sh->plan, (t_word) a, bytes, nCount) )
+			return 1;
+	}
+
+	return shellWrite(sh);
+}
+
+/*
+ * cmdSearch()
+ *
+ * search <start> <end> <byte> [<byte> ...]
+ *
+ */
+static int cmdSearch(struct shell *sh, int argc, char **argv)
+{
+	t_byte	bytes[SHELL_ARGS];
+	t_word	start;
+	t_word	end;
+	int		nCount;
+	long	a;
+	long	nFound = 0;
+
+	if ( argc < 4 || getRange(argv[1], argv[2], &start, &end) || (nCount = getBytes(argc - 3, &argv[3], bytes)) < 0 )
+	{
+		printf("usage: search <start> <end> <byte> [<byte> ...]\n");
+		return 1;
+	}
+
+	if ( cacheLoad(sh, start, end) )
+		return 1;
+
+	for ( a = start; (a + nCount - 1) <= end; a++ )
+	{
+		if ( memcmp(&sh->data[a], bytes, nCount) == 0 )
+		{
+			if ( nFound < SHELL_LIST )
+				printf("\t0x%04lx\n", a);
+			nFound++;
+		}
+	}
+
+	printf("%ld match(es)%s\n", nFound, (nFound > SHELL_LIST) ? ", first listed" : "");
+
+	return 0;
+}
+
+/*
+ * cmdCompare()
+ *
+ * compare <start> <end> <file>
+ * binary files are compared from <start>, S-record and Intel HEX
+ * files at their record addresses, only bytes held by the file
+ * inside the range are compared
+ *
+ */
+static int cmdCompare(struct shell *sh, int argc, char **argv)
+{
+	t_byte	*image;
+	int		nLength;
+	t_word	start;
+	t_word	end;
+	long	a;
+	long	nBytes = 0;
+	long	nDiffer = 0;
+	int		nResult;
+
+	if ( argc != 4 || getRange(argv[1], argv[2], &start, &end) )
+	{
+		printf("usage: compare <start> <end> <file>\n");
+		return 1;
+	}
+
+	if ( loadInput(argv[3], &image, &nLength, eepromMessage, sh->ctx) )
+		return 1;
+
+	planInit(&sh->plan);
+	nResult = planImage(sh->ctx, &sh->plan, image, nLength, start);
+	free(image);
+
+	if ( nResult )
+		return 1;
+
+	if ( cacheLoad(sh, start, end) )
+		return 1;
+
+	for ( a = start; a <= end; a++ )
+	{
+		if ( !sh->plan.used[a] )
+			continue;
+
+		nBytes++;
+		if ( sh->data[a] != sh->plan.data[a] )
+		{
+			if ( nDiffer < SHELL_LIST )
+				printf("\t0x%04lx eeprom 0x%02x file 0x%02x\n", a, sh->data[a], sh->plan.data[a]);
+			nDiffer++;
+		}
+	}
+
+	printf("%ld byte(s) compared, %ld differ\n", nBytes, nDiffer);
+
+	return 0;
+}
+
+/*
+ * getAddress()
+ *
+ * parse hex eeprom address 'text' into 'address'
+ * return '0' on success
+ *
+ */
+static int getAddress(char *text, t_word *address)
+{
+	char			*end;
+	unsigned long	value;
+
+	value = strtoul(text, &end, 16);
+	if ( *text == '\0' || *end != '\0' || value >= EEPROM_SIZE )
+	{
+		printf("invalid address '%s'\n", text);
+		return 1;
+	}
+
+	*address = (t_word) value;
+
+	return 0;
+}
+
+/*
+ * getRange()
+ *
+ * parse hex address range 'sStart' to 'sEnd'
+ * return '0' on success
+ *
+ */
+static int getRange(char *sStart, char *sEnd, t_word *start, t_word *end)
+{
+	if ( getAddress(sStart, start) || getAddress(sEnd, end) )
+		return 1;
+
+	if ( *start > *end )
+	{
+		printf("start address is larger than end address\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * getBytes()
+ *
+ * parse 'nCount' hex byte words 'text' into 'bytes'
+ * return byte count or '-1' on error
+ *
+ */
+static int getBytes(int nCount, char **text, t_byte *bytes)
+{
+	char			*end;
+	unsigned long	value;
+	int				i;
+
+	for ( i = 0; i < nCount; i++ )
+	{
+		value = strtoul(text[i], &end, 16);
+		if ( *text[i] == '\0' || *end != '\0' || value > 0xff )
+		{
+			printf("invalid byte '%s'\n", text[i]);
+			return -1;
+		}
+		bytes[i] = (t_byte) value;
+	}
+
+	return nCount;
+}
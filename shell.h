@@ -0,0 +1,34 @@
+/*
+ * shell.h
+ *
+ *      Purpose:
+ *
+ *      interactive peek/poke shell. the port stays claimed between
+ *      commands and device contents are kept in a page cache, a page
+ *      is read from the eeprom the first time a command touches it
+ *      and is dropped again only when it is written.
+ *
+ */
+
+#ifndef __SHELL_H__
+#define __SHELL_H__
+
+#include <stdio.h>
+
+#include "eeprom.h"
+
+/*
+ * definitions
+ */
+#define SHELL_PROMPT	"eeprom> "
+#define SHELL_LINE		512			// longest command line
+#define SHELL_ARGS		128			// most command line words
+#define SHELL_DUMP		0x100		// default hexdump length
+#define SHELL_LIST		32			// most search matches and compare differences listed
+
+/*
+ * function prototypes
+ */
+int		shellRun(struct eeprom*, FILE*);	// run interactive commands until 'quit' or end of input
+
+#endif /* __SHELL_H__ */
@@ -0,0 +1,433 @@
+/*
+ * soak.c
+ *
+ *      Purpose:
+ *
+ *      chip qualification soak mode.
+ *
+ *      each cycle runs four passes over the address range, one per pattern:
+ *      	checkerboard			0x55/0xaa on alternate addresses
+ *      	walking bit				one bit set, moving one bit per address and cycle
+ *      	address-in-address		low address byte xor high address byte
+ *      	random					xorshift64 bytes from the seed and cycle number
+ *      odd cycles write the inverse of the first three, so every cell
+ *      toggles every bit between two cycles. a pass writes the pattern
+ *      in page or byte mode with the context bus delays, counting writes
+ *      that time out or fail verify, then reads the whole range back.
+ *      write cycle times and write fails come from the wear map hook, see
+ *      wear.c, into a private map of the soak. with a chip wear map in the
+ *      context the private map is added to it after the soak.
+ *      Ctrl-C ends the soak after the current pass, statistics are
+ *      reported for the passes completed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "soak.h"
+
+/*
+ * local function prototypes
+ */
+static void	soakPattern(struct soak*, int, t_byte*);	// build pattern bytes of a pass
+static long	soakWrite(struct eeprom*, struct soak*, t_byte*, t_byte*);	// write a pass, return write fails
+static long	soakCheck(struct soak*, int, t_byte*, t_byte*);	// compare read back, return errors
+static void	soakStop(int);								// SIGINT handler
+
+/*
+ * local globals
+ */
+static const char	*patternName[SOAK_PATTERNS] = {"checkerboard", "walking bit", "address", "random"};
+
+static volatile sig_atomic_t	nStop = 0;			// Ctrl-C seen
+
+/*
+ * soakRun()
+ *
+ * run 'sk->nCycles' soak cycles over 'sk->start' to 'sk->end'
+ * and report the statistics collected in 'sk'
+ * return '0' if all passes were clean, '2' on write fails or
+ * read back errors, '1' if the soak could not run
+ *
+ */
+int soakRun(struct eeprom *ctx, struct soak *sk)
+{
+	t_byte				*expected;
+	t_byte				*data;
+	t_byte				*want;
+	struct wear			*wear;
+	struct sigaction	action;
+	struct sigaction	saved;
+	t_progress			progress;
+	long long			writeNs;
+	long long			readNs;
+	long				nBytes;
+	long				nFails;
+	long				nErrors;
+	long				nTotal = 0;
+	int					nPattern = 0;
+
+	if ( (expected = malloc(3 * EEPROM_SIZE)) == NULL || (sk->wear = malloc(sizeof(struct wear))) == NULL )
+	{
+		printf("soakRun() out of memory\n");
+		free(expected);
+		return 1;
+	}
+	data = &expected[EEPROM_SIZE];
+	want = &expected[2 * EEPROM_SIZE];
+
+	wearInit(sk->wear, "soak");									// write cycle times go through the wear hook,
+	wear = ctx->wear;											// the chip map gets them after the soak
+	ctx->wear = sk->wear;
+
+	nBytes = (long) sk->end - sk->start + 1;
+	memset(want, 0, EEPROM_SIZE);
+	memset(&want[sk->start], 1, nBytes);
+
+	progress = ctx->progress;									// passes report their own results
+	ctx->progress = NULL;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = soakStop;
+	sigemptyset(&action.sa_mask);
+	nStop = 0;
+	sigaction(SIGINT, &action, &saved);
+
+	printf("soakRun() %ld cycles over 0x%04x to 0x%04x, %s mode, delays: settle %uus, write %uus, Ctrl-C to end\n",
+			sk->nCycles, sk->start, sk->end, ctx->nPageMode ? "page" : "byte", ctx->nSettleUs, ctx->nWriteUs);
+
+	for ( sk->nDone = 0; sk->nDone < sk->nCycles && !nStop; sk->nDone++ )
+	{
+		for ( nPattern = 0; nPattern < SOAK_PATTERNS && !nStop; nPattern++ )
+		{
+			soakPattern(sk, nPattern, expected);
+
+			writeNs = portTime(ctx);
+			nFails = soakWrite(ctx, sk, expected, want);
+			writeNs = portTime(ctx) - writeNs;
+
+			readNs = portTime(ctx);
+			readRanges(ctx, want, data);
+			readNs = portTime(ctx) - readNs;
+
+			nErrors = soakCheck(sk, nPattern, expected, data);
+
+			sk->nPasses[nPattern]++;
+			sk->writeNs[nPattern] += writeNs;
+			sk->readNs[nPattern] += readNs;
+			sk->nWriteFails[nPattern] += nFails;
+			nTotal += nFails + nErrors;
+
+			printf("\tcycle %ld %-12s write %8.0f bytes/s, read %8.0f bytes/s, %ld write fails, %ld read back errors\n",
+					sk->nDone + 1, patternName[nPattern], nBytes * 1e9 / (writeNs ? writeNs : 1),
+					nBytes * 1e9 / (readNs ? readNs : 1), nFails, nErrors);
+		}
+	}
+
+	if ( nStop )
+		printf("soakRun() stopped after %ld cycles\n", nPattern == SOAK_PATTERNS ? sk->nDone : sk->nDone - 1);
+
+	sigaction(SIGINT, &saved, NULL);
+	ctx->progress = progress;
+	ctx->wear = wear;
+
+	soakReport(sk);
+
+	if ( wear )
+		wearMerge(wear, sk->wear);
+
+	free(sk->wear);
+	sk->wear = NULL;
+	free(expected);
+
+	return nTotal ? 2 : 0;
+}
+
+/*
+ * soakReport()
+ *
+ * print throughput per pattern, the write cycle time distribution,
+ * write fails by kind, read back errors per data bit, the first
+ * error locations and the pages with most errors
+ *
+ */
+void soakReport(struct soak *sk)
+{
+	long		nBytes = (long) sk->end - sk->start + 1;
+	long		nCycles = 0;
+	long		nSum = 0;
+	long		nFails = 0;
+	long		nErrors = 0;
+	long		nTimeouts = 0;
+	long		nVerify = 0;
+	long		nSlow = 0;
+	long		nMax;
+	int			nPage;
+	int			nMedian = -1;
+	int			nP99 = -1;
+	int			i, j;
+	char		sBar[TEXT_LEN];
+
+	printf("soakReport() %ld bytes per pass\n", nBytes);
+	for ( i = 0; i < SOAK_PATTERNS; i++ )
+	{
+		if ( sk->nPasses[i] == 0 )
+			continue;
+
+		printf("\t%-12s %5ld passes, write %8.0f bytes/s, read %8.0f bytes/s, %ld write fails, %ld read back errors\n",
+				patternName[i], sk->nPasses[i],
+				sk->nPasses[i] * nBytes * 1e9 / (sk->writeNs[i] ? sk->writeNs[i] : 1),
+				sk->nPasses[i] * nBytes * 1e9 / (sk->readNs[i] ? sk->readNs[i] : 1),
+				sk->nWriteFails[i], sk->nErrors[i]);
+
+		nFails += sk->nWriteFails[i];
+		nErrors += sk->nErrors[i];
+	}
+
+	/*
+	 * write cycle time distribution, from write pulse to end of DATA polling
+	 */
+	for ( i = 0; sk->wear && i < WEAR_HIST; i++ )
+		nCycles += sk->wear->hist[i];
+
+	if ( nCycles )
+	{
+		for ( i = 0, nMax = 1; i < WEAR_HIST; i++ )
+		{
+			if ( sk->wear->hist[i] > nMax )
+				nMax = sk->wear->hist[i];
+		}
+
+		printf("soakReport() write cycle time, %ld cycles:\n", nCycles);
+		for ( i = 0; i < WEAR_HIST; i++ )
+		{
+			nSum += sk->wear->hist[i];
+			if ( nMedian < 0 && nSum * 2 >= nCycles )
+				nMedian = i;
+			if ( nP99 < 0 && nSum * 100 >= nCycles * 99 )
+				nP99 = i;
+
+			if ( sk->wear->hist[i] == 0 )
+				continue;
+
+			j = (int) (sk->wear->hist[i] * 40 / nMax);
+			memset(sBar, '#', j);
+			sBar[j] = '\0';
+
+			if ( i < WEAR_HIST - 1 )
+				printf("\t%5.1f - %5.1fms %9ld %s\n", i * WEAR_BUCKET / 1e6, (i + 1) * WEAR_BUCKET / 1e6, sk->wear->hist[i], sBar);
+			else
+				printf("\t  over %5.1fms %9ld %s\n", i * WEAR_BUCKET / 1e6, sk->wear->hist[i], sBar);
+		}
+		printf("\tmedian under %.1fms, p99 %s %.1fms\n", (nMedian + 1) * WEAR_BUCKET / 1e6,
+				(nP99 < WEAR_HIST - 1) ? "under" : "over", (nP99 < WEAR_HIST - 1 ? nP99 + 1 : nP99) * WEAR_BUCKET / 1e6);
+	}
+
+	/*
+	 * write fails by kind, slow cycles completed before the time-out.
+	 * a timed out cycle is recorded at the time-out, in the last bucket
+	 */
+	for ( i = 0; sk->wear && i < PAGES; i++ )
+	{
+		nTimeouts += sk->wear->page[i].nTimeouts;
+		nVerify += sk->wear->page[i].nVerify;
+	}
+
+	if ( nCycles )
+	{
+		for ( i = SOAK_SLOW * (nMedian + 1); i < WEAR_HIST; i++ )
+			nSlow += sk->wear->hist[i];
+		nSlow = (nSlow > nTimeouts) ? nSlow - nTimeouts : 0;
+
+		printf("soakReport() %ld write cycles slow (over %.1fms), %ld timed out, %ld failed verify\n",
+				nSlow, SOAK_SLOW * (nMedian + 1) * WEAR_BUCKET / 1e6, nTimeouts, nVerify);
+	}
+
+	if ( nErrors )
+	{
+		printf("soakReport() read back errors per data bit, read '0' for '1' / read '1' for '0':\n\t");
+		for ( i = 7; i >= 0; i-- )
+			printf(" b%d %ld/%ld", i, sk->bitErrors[i][0], sk->bitErrors[i][1]);
+		printf("\n");
+
+		printf("soakReport() first read back errors:\n");
+		for ( i = 0; i < sk->nList; i++ )
+			printf("\tcycle %ld %-12s 0x%04x wrote 0x%02x read 0x%02x\n", sk->list[i].nCycle + 1,
+					patternName[sk->list[i].nPattern], sk->list[i].address, sk->list[i].expected, sk->list[i].read);
+	}
+
+	if ( nFails || nErrors )
+	{
+		printf("soakReport() pages with most write fails and read back errors:\n");
+		for ( i = 0; i < SOAK_TOP; i++ )						// PAGES is small, pick the next largest each time
+		{
+			for ( j = 0, nPage = -1, nMax = 0; j < PAGES; j++ )
+			{
+				if ( sk->pageErrors[j] > nMax )
+				{
+					nMax = sk->pageErrors[j];
+					nPage = j;
+				}
+			}
+
+			if ( nPage < 0 )
+				break;
+
+			printf("\tpage 0x%04x %ld\n", nPage * PAGE_SIZE, nMax);
+			sk->pageErrors[nPage] = -nMax;						// listed, restored below
+		}
+
+		for ( j = 0; j < PAGES; j++ )
+		{
+			if ( sk->pageErrors[j] < 0 )
+				sk->pageErrors[j] = -sk->pageErrors[j];
+		}
+
+		printf("soakReport() %ld write fails, %ld read back errors, chip failed\n", nFails, nErrors);
+	}
+	else
+		printf("soakReport() no write fails or read back errors, chip passed\n");
+}
+
+/*
+ * soakPattern()
+ *
+ * build the bytes of pattern 'nPattern' for the current cycle
+ * into the soak range of 'expected'
+ *
+ */
+static void soakPattern(struct soak *sk, int nPattern, t_byte *expected)
+{
+	unsigned long long	x;
+	t_byte	inv = (sk->nDone & 1) ? 0xff : 0x00;
+	long	a;
+
+	x = sk->seed ^ ((unsigned long long) (sk->nDone + 1) * 0x9e3779b97f4a7c15ULL);
+	if ( x == 0 )
+		x = 1;
+
+	for ( a = sk->start; a <= sk->end; a++ )
+	{
+		switch ( nPattern )
+		{
+			case 0:
+				expected[a] = ((a & 1) ? 0xaa : 0x55) ^ inv;
+				break;
+
+			case 1:
+				expected[a] = (t_byte) (1 << ((a + sk->nDone) % 8)) ^ inv;
+				break;
+
+			case 2:
+				expected[a] = (t_byte) (a ^ (a >> 8)) ^ inv;
+				break;
+
+			default:
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+				expected[a] = (t_byte) (x >> 24);
+				break;
+		}
+	}
+}
+
+/*
+ * soakWrite()
+ *
+ * write the soak range bytes of 'expected', marked in 'want',
+ * a page per write cycle in page mode, otherwise a byte
+ * return number of page or byte writes failing time-out or verify
+ *
+ */
+static long soakWrite(struct eeprom *ctx, struct soak *sk, t_byte *expected, t_byte *want)
+{
+	long	a;
+	long	nFails = 0;
+
+	if ( ctx->nPageMode )
+	{
+		for ( a = sk->start & ~(PAGE_SIZE - 1); a <= sk->end; a += PAGE_SIZE )
+		{
+			if ( writePage(ctx, (t_word) a, &expected[a], &want[a]) != WRITEOK )
+			{
+				nFails++;
+				sk->pageErrors[a / PAGE_SIZE]++;
+			}
+		}
+	}
+	else
+	{
+		for ( a = sk->start; a <= sk->end; a++ )
+		{
+			if ( writeByte(ctx, (t_word) a, expected[a]) != WRITEOK )
+			{
+				nFails++;
+				sk->pageErrors[a / PAGE_SIZE]++;
+			}
+		}
+	}
+
+	return nFails;
+}
+
+/*
+ * soakCheck()
+ *
+ * compare the read back 'data' of pattern 'nPattern' with 'expected',
+ * count errors per pattern, data bit and page and list the first ones
+ * return number of bytes read back wrong
+ *
+ */
+static long soakCheck(struct soak *sk, int nPattern, t_byte *expected, t_byte *data)
+{
+	long	a;
+	long	nErrors = 0;
+	int		nDiff;
+	int		i;
+
+	for ( a = sk->start; a <= sk->end; a++ )
+	{
+		if ( (nDiff = data[a] ^ expected[a]) == 0 )
+			continue;
+
+		nErrors++;
+		sk->pageErrors[a / PAGE_SIZE]++;
+
+		for ( i = 0; i < 8; i++ )
+		{
+			if ( nDiff & (1 << i) )
+				sk->bitErrors[i][(data[a] >> i) & 1]++;
+		}
+
+		if ( sk->nList < SOAK_LIST )
+		{
+			sk->list[sk->nList].nCycle = sk->nDone;
+			sk->list[sk->nList].nPattern = nPattern;
+			sk->list[sk->nList].address = (t_word) a;
+			sk->list[sk->nList].expected = expected[a];
+			sk->list[sk->nList].read = data[a];
+			sk->nList++;
+		}
+	}
+
+	sk->nErrors[nPattern] += nErrors;
+
+	return nErrors;
+}
+
+/*
+ * soakStop()
+ *
+ * SIGINT handler, end the soak after the current pass
+ *
+ */
+static void soakStop(int nSignal)
+{
+	(void) nSignal;
+
+	nStop = 1;
+}
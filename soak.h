@@ -0,0 +1,66 @@
+/*
+ * soak.h
+ *
+ *      Purpose:
+ *
+ *      chip qualification soak mode. every cycle writes and reads back
+ *      checkerboard, walking bit, address-in-address and random patterns
+ *      over the address range with the context bus delays, and collects
+ *      write and read throughput, the write cycle time distribution and
+ *      the locations of write failures and read back errors.
+ *
+ */
+
+#ifndef __SOAK_H__
+#define __SOAK_H__
+
+#include "eeprom.h"
+#include "wear.h"
+
+/*
+ * definitions
+ */
+#define SOAK_PATTERNS	4			// checkerboard, walking bit, address-in-address, random
+#define SOAK_LIST		16			// first error locations listed
+#define SOAK_TOP		10			// pages with most errors listed
+#define SOAK_SLOW		2			// write cycles taking this many times the median are slow
+
+/*
+ * type definitions
+ */
+struct soakError							// one read back error
+{
+	long			nCycle;
+	int				nPattern;
+	t_word			address;
+	t_byte			expected;
+	t_byte			read;
+};
+
+struct soak									// soak options and statistics
+{
+	long			nCycles;				// cycles to run, each writes every pattern once
+	t_word			start;					// address range
+	t_word			end;
+	unsigned long long	seed;				// random pattern seed
+
+	long			nDone;					// cycles completed
+	long			nPasses[SOAK_PATTERNS];	// per pattern: passes, write and read time,
+	long long		writeNs[SOAK_PATTERNS];
+	long long		readNs[SOAK_PATTERNS];
+	long			nWriteFails[SOAK_PATTERNS];	// page or byte writes failing time-out or verify
+	long			nErrors[SOAK_PATTERNS];	// bytes read back wrong after the pass
+	long			bitErrors[8][2];		// per data bit: read '0' for '1', read '1' for '0'
+	long			pageErrors[PAGES];		// write fails and read back errors per page
+	int				nList;
+	struct soakError	list[SOAK_LIST];
+	struct wear		*wear;					// write cycle times and fails of this soak
+};
+
+/*
+ * function prototypes
+ */
+int		soakRun(struct eeprom*, struct soak*);	// run soak cycles and report statistics
+void	soakReport(struct soak*);				// print soak statistics
+
+#endif /* __SOAK_H__ */
@@ -0,0 +1,212 @@
+/*
+ * station.c
+ *
+ *      Purpose:
+ *
+ *      per-station profile load and save.
+ *
+ *      profile format, one value per line, '#' starts a comment:
+ *
+ *      	write_data_ns	1000
+ *      	write_control_ns	1000
+ *      	...
+ *
+ *      unknown keys are ignored so older programs can read newer profiles.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "station.h"
+
+/*
+ * local definitions
+ */
+#define DEF_PORT_NS		1000		// default model: ~1us per port access through ppdev
+#define DEF_SLEEP_NS	60000		// timer slack and wake up latency of a short sleep
+#define DEF_CYCLE_NS	3000000		// page write cycle
+
+/*
+ * locals
+ */
+static const struct
+{
+	const char	*sKey;
+	size_t		nOffset;
+} keys[] =									// profile keys and their 'struct station' fields
+{
+	{"write_data_ns",		offsetof(struct station, portNs[PORT_WDATA])},
+	{"write_control_ns",	offsetof(struct station, portNs[PORT_WCONTROL])},
+	{"read_control_ns",		offsetof(struct station, portNs[PORT_RCONTROL])},
+	{"read_data_ns",		offsetof(struct station, portNs[PORT_RDATA])},
+	{"read_status_ns",		offsetof(struct station, portNs[PORT_RSTATUS])},
+	{"data_dir_ns",			offsetof(struct station, portNs[PORT_DIR])},
+	{"sleep_overrun_ns",	offsetof(struct station, sleepNs)},
+	{"write_cycle_ns",		offsetof(struct station, writeCycleNs)},
+	{"oe_settle_us",		offsetof(struct station, settleUs)},
+	{"write_delay_us",		offsetof(struct station, writeUs)},
+	{"erase_delay_us",		offsetof(struct station, eraseUs)},
+};
+
+#define KEYS	(int) (sizeof(keys) / sizeof(keys[0]))
+
+/*
+ * stationInit()
+ *
+ * set default latency model, used when a station has no profile
+ *
+ */
+void stationInit(struct station *st)
+{
+	int		i;
+
+	memset(st, 0, sizeof(struct station));
+
+	for ( i = 0; i < PORT_OPS; i++ )
+		st->portNs[i] = DEF_PORT_NS;
+
+	st->sleepNs = DEF_SLEEP_NS;
+	st->writeCycleNs = DEF_CYCLE_NS;
+	st->settleUs = DEF_SETTLE_US;
+	st->writeUs = DEF_WRITE_US;
+	st->eraseUs = DEF_ERASE_US;
+}
+
+/*
+ * stationPath()
+ *
+ * build profile file name of port 'sPort' into 'sPath'
+ * return '0' on success, '1' if $HOME is not set or name is too long
+ *
+ */
+int stationPath(char *sPath, int nLength, const char *sPort)
+{
+	char	*sHome;
+
+	if ( (sHome = getenv("HOME")) == NULL )
+		return 1;
+
+	if ( snprintf(sPath, nLength, "%s/%s/%s%s", sHome, STATION_DIR, sPort, STATION_EXT) >= nLength )
+		return 1;
+
+	return 0;
+}
+
+/*
+ * stationName()
+ *
+ * check that chip lot or serial 'sName' can be part of a profile or
+ * wear map file name: letters, digits, '-', '_' and '.', not leading '.'
+ * return '0' if it can, '1' if not
+ *
+ */
+int stationName(const char *sName)
+{
+	const char	*s;
+
+	if ( *sName == '\0' || *sName == '.' )
+		return 1;
+
+	for ( s = sName; *s; s++ )
+	{
+		if ( !isalnum((unsigned char) *s) && *s != '-' && *s != '_' && *s != '.' )
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * stationLoad()
+ *
+ * read profile 'sPath' into 'st', keys missing from the
+ * profile keep their current value
+ * return '0' on success, '1' if there is no readable profile
+ *
+ */
+int stationLoad(struct station *st, char *sPath)
+{
+	FILE		*fp;
+	char		textLine[TEXT_LEN];
+	char		sKey[TEXT_LEN];
+	long long	value;
+	int			i;
+
+	if ( (fp = fopen(sPath, "r")) == NULL )
+		return 1;
+
+	while ( fgets(textLine, sizeof(textLine), fp) )
+	{
+		if ( textLine[0] == '#' || sscanf(textLine, "%79s %lld", sKey, &value) != 2 )
+			continue;
+
+		for ( i = 0; i < KEYS; i++ )
+		{
+			if ( strcmp(sKey, keys[i].sKey) == 0 && value >= 0 )
+				*(long long*) ((char*) st + keys[i].nOffset) = value;
+		}
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+/*
+ * stationSave()
+ *
+ * write profile 'st' to 'sPath', creating the
+ * profile directory in $HOME if needed
+ * return '0' on success
+ *
+ */
+int stationSave(struct station *st, char *sPath)
+{
+	FILE	*fp;
+	char	sDir[TEXT_LEN * 2];
+	char	*sHome;
+	int		i;
+
+	if ( (sHome = getenv("HOME")) != NULL )
+	{
+		snprintf(sDir, sizeof(sDir), "%s/%s", sHome, STATION_DIR);
+		mkdir(sDir, 0755);
+	}
+
+	if ( (fp = fopen(sPath, "w")) == NULL )
+	{
+		printf("stationSave() could not open file '%s' for writing (errno=%d)\n", sPath, errno);
+		return 1;
+	}
+
+	fprintf(fp, "# eepromprog station profile\n");
+	for ( i = 0; i < KEYS; i++ )
+		fprintf(fp, "%s\t%lld\n", keys[i].sKey, *(long long*) ((char*) st + keys[i].nOffset));
+
+	if ( fclose(fp) )
+	{
+		printf("stationSave() error writing file '%s' (errno=%d)\n", sPath, errno);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * stationApply()
+ *
+ * set bus delays of context 'ctx' from profile 'st'
+ *
+ */
+void stationApply(struct station *st, struct eeprom *ctx)
+{
+	ctx->nSettleUs = (unsigned int) st->settleUs;
+	ctx->nWriteUs = (unsigned int) st->writeUs;
+	ctx->nEraseUs = (unsigned int) st->eraseUs;
+}
@@ -0,0 +1,48 @@
+/*
+ * station.h
+ *
+ *      Purpose:
+ *
+ *      per-station profile: the port latency model of the parallel port
+ *      and programer attached to this host, used to predict action times,
+ *      and the bus delays tuned for the station and its chips.
+ *      profiles are plain text 'key value' lines kept in
+ *      ~/.eepromprog/<port name>.profile
+ *
+ */
+
+#ifndef __STATION_H__
+#define __STATION_H__
+
+#include "eeprom.h"
+
+/*
+ * definitions
+ */
+#define STATION_DIR		".eepromprog"	// profile directory in $HOME
+#define STATION_EXT		".profile"
+
+/*
+ * type definitions
+ */
+struct station								// station profile
+{
+	long long		portNs[PORT_OPS];		// cost of each port access type in nano-seconds
+	long long		sleepNs;				// time a delay runs over its requested length
+	long long		writeCycleNs;			// chip page write cycle time
+	long long		settleUs;				// bus delays applied to the context, see eeprom.h
+	long long		writeUs;
+	long long		eraseUs;
+};
+
+/*
+ * function prototypes
+ */
+void	stationInit(struct station*);		// set default latency model
+int		stationPath(char*, int, const char*);	// profile file name for a port
+int		stationName(const char*);		// check a lot or serial for use in a file name
+int		stationLoad(struct station*, char*);	// read profile, missing keys keep their value
+int		stationSave(struct station*, char*);	// write profile, create profile directory
+void	stationApply(struct station*, struct eeprom*);	// set context bus delays from profile
+
+#endif /* __STATION_H__ */
@@ -0,0 +1,723 @@
+/*
+ * stream.c
+ *
+ *      Purpose:
+ *
+ *      transparent compressed file streams.
+ *
+ *      streamOpen() wraps an open stdio stream with fopencookie(), the
+ *      wrapper stream reads or writes plain data while a codec thread
+ *      inflates the file into, or deflates the file from, a ring buffer.
+ *      decompression of the next block runs while the caller parses
+ *      the previous one, and compression while the caller formats.
+ *
+ *      gzip magic:	1f 8b
+ *      zstd magic:	28 b5 2f fd
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "image.h"
+#include "stream.h"
+
+/*
+ * local type definitions
+ */
+struct stream								// compressed stream state, the fopencookie() cookie
+{
+	FILE			*fp;					// underlying compressed file
+	const char		*sName;
+	t_message		message;				// optional message callback, called from the codec thread too
+	void			*arg;					// caller argument of the callback
+	int				nCodec;
+	int				nWrite;					// '1' compressing output, '0' decompressing input
+	pthread_t		thread;					// codec thread
+	int				nThread;				// codec thread started
+	int				nKeepFile;				// leave 'fp' open on close, streamOpen() failed
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	t_byte			*ring;					// STREAM_RING bytes of plain data
+	size_t			nHead;					// total bytes put into ring
+	size_t			nTail;					// total bytes taken from ring
+	int				nEof;					// ring producer is done
+	int				nClosed;				// ring consumer is gone
+	int				nError;					// codec or file error
+	t_byte			prefix[STREAM_MAGIC];	// magic bytes read ahead from input
+	int				nPrefix;
+	int				nPrefixPos;
+};
+
+/*
+ * local function prototypes
+ */
+static ssize_t	streamRead(void*, char*, size_t);		// cookie functions
+static ssize_t	streamWrite(void*, const char*, size_t);
+static int		streamClose(void*);
+static void		*streamThread(void*);		// thread: run codec between file and ring
+static size_t	rawRead(struct stream*, t_byte*, size_t);	// read compressed input after read ahead bytes
+static int		ringPut(struct stream*, const t_byte*, size_t);	// ring buffer producer
+static size_t	ringGet(struct stream*, t_byte*, size_t);	// ring buffer consumer
+static int		gzipDecode(struct stream*, t_byte*, t_byte*);
+static int		gzipEncode(struct stream*, t_byte*, t_byte*);
+#ifdef HAVE_ZSTD
+static int		zstdDecode(struct stream*, t_byte*, t_byte*);
+static int		zstdEncode(struct stream*, t_byte*, t_byte*);
+#endif
+static void		streamMessage(t_message, void*, int, const char*, ...);	// format and report a message
+
+/*
+ * local definitions
+ */
+static const t_byte	gzipMagic[] = {0x1f, 0x8b};
+static const t_byte	zstdMagic[] = {0x28, 0xb5, 0x2f, 0xfd};
+
+#define GZIP_WINDOW	15			// zlib window bits, +16 gzip header, +32 detect gzip or zlib header
+#define GZIP_MEMORY	8			// zlib deflate memory level
+
+/*
+ * streamOpen()
+ *
+ * wrap stream 'fp' of file 'sName'.
+ * input ('nWrite' clear): detect compression from the first bytes of
+ * the stream, output ('nWrite' set): select compression by 'sName' extension.
+ * return 'fp' itself for plain files, a wrapper stream that owns 'fp'
+ * for compressed files or NULL on error, 'fp' is left open on error.
+ * the codec is returned in 'nCodec' if not NULL.
+ * errors go to the optional 'message' callback with 'arg', codec
+ * errors are reported from the codec thread
+ *
+ */
+FILE *streamOpen(FILE *fp, const char *sName, int nWrite, int *nCodec, t_message message, void *arg)
+{
+	struct stream			*s;
+	cookie_io_functions_t	io = {streamRead, streamWrite, NULL, streamClose};
+	t_byte					magic[STREAM_MAGIC];
+	int						nMagic = 0;
+	int						nType;
+	FILE					*wfp;
+
+	if ( nWrite )
+		nType = streamCodec(sName);
+	else
+	{
+		nMagic = fread(magic, 1, STREAM_MAGIC, fp);
+
+		if ( nMagic >= (int) sizeof(gzipMagic) && memcmp(magic, gzipMagic, sizeof(gzipMagic)) == 0 )
+			nType = STREAM_GZIP;
+		else if ( nMagic >= (int) sizeof(zstdMagic) && memcmp(magic, zstdMagic, sizeof(zstdMagic)) == 0 )
+			nType = STREAM_ZSTD;
+		else
+			nType = STREAM_PLAIN;
+	}
+
+	if ( nCodec )
+		*nCodec = nType;
+
+	if ( nType == STREAM_PLAIN && (nMagic == 0 || fseek(fp, -(long) nMagic, SEEK_CUR) == 0) )
+		return fp;												// plain file or seekable plain input
+
+#ifndef HAVE_ZSTD
+	if ( nType == STREAM_ZSTD )
+	{
+		streamMessage(message, arg, IMAGE_EFORMAT, "streamOpen() '%s' zstd compression not supported, build with HAVE_ZSTD", sName);
+		return NULL;
+	}
+#endif
+
+	if ( (s = calloc(1, sizeof(struct stream))) == NULL ||
+		 (nType != STREAM_PLAIN && (s->ring = malloc(STREAM_RING)) == NULL) )
+	{
+		streamMessage(message, arg, IMAGE_EMEMORY, "streamOpen() out of memory");
+		free(s);
+		return NULL;
+	}
+
+	s->fp = fp;
+	s->sName = sName;
+	s->message = message;
+	s->arg = arg;
+	s->nCodec = nType;
+	s->nWrite = nWrite;
+	memcpy(s->prefix, magic, nMagic);							// plain input from a pipe: replay read ahead bytes
+	s->nPrefix = nMagic;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+
+	if ( (wfp = fopencookie(s, nWrite ? "w" : "r", io)) == NULL )
+	{
+		streamMessage(message, arg, IMAGE_EFILE, "streamOpen() could not open stream '%s' (errno=%d)", sName, errno);
+		goto ABORT;
+	}
+
+	if ( nType != STREAM_PLAIN )
+	{
+		if ( pthread_create(&s->thread, NULL, streamThread, s) )
+		{
+			streamMessage(message, arg, IMAGE_EMEMORY, "streamOpen() could not start codec thread");
+			s->nKeepFile = 1;									// caller still owns 'fp'
+			fclose(wfp);
+			return NULL;
+		}
+		s->nThread = 1;
+	}
+
+	setvbuf(wfp, NULL, _IOFBF, IO_BUFFER);
+
+	return wfp;
+
+ABORT:
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	free(s->ring);
+	free(s);
+
+	return NULL;
+}
+
+/*
+ * streamCodec()
+ *
+ * return output codec selected by extension of file name 'sName'
+ *
+ */
+int streamCodec(const char *sName)
+{
+	const char	*ext;
+
+	if ( sName == NULL || (ext = strrchr(sName, '.')) == NULL )
+		return STREAM_PLAIN;
+
+	if ( strcmp(ext, STREAM_GZIP_EXT) == 0 )
+		return STREAM_GZIP;
+
+	if ( strcmp(ext, STREAM_ZSTD_EXT) == 0 )
+		return STREAM_ZSTD;
+
+	return STREAM_PLAIN;
+}
+
+/*
+ * streamName()
+ *
+ * return printable name of codec 'nCodec'
+ *
+ */
+const char *streamName(int nCodec)
+{
+	switch ( nCodec )
+	{
+		case STREAM_GZIP:
+			return "gzip";
+
+		case STREAM_ZSTD:
+			return "zstd";
+
+		default:
+			return "plain";
+	}
+}
+
+/*
+ * streamRead()
+ *
+ * cookie read function, take plain data from the ring
+ *
+ */
+static ssize_t streamRead(void *cookie, char *buf, size_t nSize)
+{
+	struct stream	*s = cookie;
+	size_t			nRead;
+
+	if ( s->nCodec == STREAM_PLAIN )
+		return rawRead(s, (t_byte*) buf, nSize);
+
+	if ( (nRead = ringGet(s, (t_byte*) buf, nSize)) == 0 && s->nError )
+		return -1;
+
+	return nRead;
+}
+
+/*
+ * streamWrite()
+ *
+ * cookie write function, put plain data into the ring
+ *
+ */
+static ssize_t streamWrite(void *cookie, const char *buf, size_t nSize)
+{
+	struct stream	*s = cookie;
+
+	if ( ringPut(s, (const t_byte*) buf, nSize) )
+		return -1;
+
+	return nSize;
+}
+
+/*
+ * streamClose()
+ *
+ * cookie close function, end the ring, wait for the codec
+ * thread to finish and close the underlying file
+ *
+ */
+static int streamClose(void *cookie)
+{
+	struct stream	*s = cookie;
+	int				nResult;
+
+	pthread_mutex_lock(&s->lock);
+	if ( s->nWrite )
+		s->nEof = 1;											// codec thread flushes and ends the file
+	else
+		s->nClosed = 1;											// codec thread stops early
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+
+	if ( s->nThread )
+		pthread_join(s->thread, NULL);
+
+	nResult = s->nError;
+
+	if ( !s->nKeepFile && fclose(s->fp) )
+	{
+		streamMessage(s->message, s->arg, IMAGE_EFILE, "streamClose() error closing '%s' (errno=%d)", s->sName, errno);
+		nResult = 1;
+	}
+
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	free(s->ring);
+	free(s);
+
+	return nResult ? EOF : 0;
+}
+
+/*
+ * streamThread()
+ *
+ * codec thread, inflate the file into the ring or
+ * deflate the ring into the file until either side ends
+ *
+ */
+static void *streamThread(void *arg)
+{
+	struct stream	*s = arg;
+	t_byte			*buffer;
+	int				nResult = 1;
+
+	if ( (buffer = malloc(STREAM_CHUNK * 2)) == NULL )
+		streamMessage(s->message, s->arg, IMAGE_EMEMORY, "streamThread() out of memory");
+	else if ( s->nCodec == STREAM_GZIP )
+		nResult = s->nWrite ? gzipEncode(s, buffer, &buffer[STREAM_CHUNK]) : gzipDecode(s, buffer, &buffer[STREAM_CHUNK]);
+#ifdef HAVE_ZSTD
+	else if ( s->nCodec == STREAM_ZSTD )
+		nResult = s->nWrite ? zstdEncode(s, buffer, &buffer[STREAM_CHUNK]) : zstdDecode(s, buffer, &buffer[STREAM_CHUNK]);
+#endif
+
+	free(buffer);
+
+	pthread_mutex_lock(&s->lock);
+	s->nError = nResult;
+	if ( s->nWrite )
+		s->nClosed = 1;											// writers fail from here on
+	else
+		s->nEof = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+
+	return NULL;
+}
+
+/*
+ * rawRead()
+ *
+ * read up to 'nSize' bytes of the underlying file,
+ * read ahead magic bytes first
+ *
+ */
+static size_t rawRead(struct stream *s, t_byte *buf, size_t nSize)
+{
+	size_t	nCount = 0;
+
+	while ( s->nPrefixPos < s->nPrefix && nCount < nSize )
+		buf[nCount++] = s->prefix[s->nPrefixPos++];
+
+	if ( nCount < nSize )
+		nCount += fread(&buf[nCount], 1, nSize - nCount, s->fp);
+
+	return nCount;
+}
+
+/*
+ * ringPut()
+ *
+ * copy 'nSize' bytes into the ring, wait for space as needed.
+ * return '0' on success, '1' if the consumer is gone
+ *
+ */
+static int ringPut(struct stream *s, const t_byte *data, size_t nSize)
+{
+	size_t	nCount;
+	size_t	nPos;
+	int		nResult = 0;
+
+	pthread_mutex_lock(&s->lock);
+
+	while ( 1 )
+	{
+		while ( (s->nHead - s->nTail) == STREAM_RING && !s->nClosed )
+			pthread_cond_wait(&s->cond, &s->lock);
+
+		if ( s->nClosed )
+		{
+			nResult = 1;
+			break;
+		}
+
+		if ( nSize == 0 )
+			break;
+
+		nPos = s->nHead % STREAM_RING;
+		nCount = STREAM_RING - (s->nHead - s->nTail);			// free space
+		if ( nCount > (STREAM_RING - nPos) )					// up to ring end
+			nCount = STREAM_RING - nPos;
+		if ( nCount > nSize )
+			nCount = nSize;
+
+		memcpy(&s->ring[nPos], data, nCount);
+		s->nHead += nCount;
+		data += nCount;
+		nSize -= nCount;
+
+		pthread_cond_broadcast(&s->cond);
+	}
+
+	pthread_mutex_unlock(&s->lock);
+
+	return nResult;
+}
+
+/*
+ * ringGet()
+ *
+ * copy up to 'nSize' bytes out of the ring, wait for data as needed.
+ * return byte count, '0' when the producer is done and the ring is empty
+ *
+ */
+static size_t ringGet(struct stream *s, t_byte *buf, size_t nSize)
+{
+	size_t	nCount;
+	size_t	nPos;
+	size_t	nDone = 0;
+
+	pthread_mutex_lock(&s->lock);
+
+	while ( s->nHead == s->nTail && !s->nEof )
+		pthread_cond_wait(&s->cond, &s->lock);
+
+	while ( nDone < nSize && s->nHead != s->nTail )				// at most two copies around ring end
+	{
+		nPos = s->nTail % STREAM_RING;
+		nCount = s->nHead - s->nTail;
+		if ( nCount > (STREAM_RING - nPos) )
+			nCount = STREAM_RING - nPos;
+		if ( nCount > (nSize - nDone) )
+			nCount = nSize - nDone;
+
+		memcpy(&buf[nDone], &s->ring[nPos], nCount);
+		s->nTail += nCount;
+		nDone += nCount;
+	}
+
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+
+	return nDone;
+}
+
+/*
+ * gzipDecode()
+ *
+ * inflate gzip file into the ring, concatenated gzip members are
+ * decoded as one stream. 'in' and 'out' are STREAM_CHUNK buffers
+ * return '0' on success
+ *
+ */
+static int gzipDecode(struct stream *s, t_byte *in, t_byte *out)
+{
+	z_stream	z;
+	size_t		nRead;
+	int			nRet;
+	int			nEnd = 0;								// a gzip member ended
+	int			nResult = 0;
+
+	memset(&z, 0, sizeof(z));
+	if ( inflateInit2(&z, GZIP_WINDOW + 32) != Z_OK )
+		return 1;
+
+	z.avail_out = 1;											// nothing held, read first input
+
+	while ( 1 )
+	{
+		if ( z.avail_in == 0 && z.avail_out != 0 )				// decoder holds no more output, read input
+		{
+			if ( (nRead = rawRead(s, in, STREAM_CHUNK)) == 0 )
+			{
+				if ( ferror(s->fp) )
+				{
+					streamMessage(s->message, s->arg, IMAGE_EFILE, "gzipDecode() error reading '%s' (errno=%d)", s->sName, errno);
+					nResult = 1;
+				}
+				else if ( !nEnd )
+				{
+					streamMessage(s->message, s->arg, IMAGE_EFORMAT, "gzipDecode() '%s' truncated", s->sName);
+					nResult = 1;
+				}
+				break;
+			}
+			z.next_in = in;
+			z.avail_in = nRead;
+		}
+
+		if ( nEnd && z.avail_in > 0 )							// next gzip member
+		{
+			inflateReset(&z);
+			nEnd = 0;
+		}
+
+		z.next_out = out;
+		z.avail_out = STREAM_CHUNK;
+
+		nRet = inflate(&z, Z_NO_FLUSH);
+		if ( nRet != Z_OK && nRet != Z_STREAM_END && nRet != Z_BUF_ERROR )
+		{
+			streamMessage(s->message, s->arg, IMAGE_EFORMAT, "gzipDecode() '%s' corrupt data (%s)", s->sName, z.msg ? z.msg : "zlib error");
+			nResult = 1;
+			break;
+		}
+
+		if ( nRet == Z_STREAM_END )
+			nEnd = 1;
+
+		if ( ringPut(s, out, STREAM_CHUNK - z.avail_out) )		// reader closed the stream
+			break;
+	}
+
+	inflateEnd(&z);
+
+	return nResult;
+}
+
+/*
+ * gzipEncode()
+ *
+ * deflate the ring into a gzip file until the writer closes the stream.
+ * 'in' and 'out' are STREAM_CHUNK buffers
+ * return '0' on success
+ *
+ */
+static int gzipEncode(struct stream *s, t_byte *in, t_byte *out)
+{
+	z_stream	z;
+	size_t		nRead;
+	size_t		nOut;
+	int			nFlush;
+	int			nResult = 0;
+
+	memset(&z, 0, sizeof(z));
+	if ( deflateInit2(&z, STREAM_LEVEL, Z_DEFLATED, GZIP_WINDOW + 16, GZIP_MEMORY, Z_DEFAULT_STRATEGY) != Z_OK )
+		return 1;
+
+	do
+	{
+		nRead = ringGet(s, in, STREAM_CHUNK);
+		nFlush = (nRead > 0) ? Z_NO_FLUSH : Z_FINISH;
+
+		z.next_in = in;
+		z.avail_in = nRead;
+
+		do
+		{
+			z.next_out = out;
+			z.avail_out = STREAM_CHUNK;
+			deflate(&z, nFlush);
+
+			nOut = STREAM_CHUNK - z.avail_out;
+			if ( nOut > 0 && fwrite(out, 1, nOut, s->fp) != nOut )
+			{
+				streamMessage(s->message, s->arg, IMAGE_EFILE, "gzipEncode() error writing '%s' (errno=%d)", s->sName, errno);
+				nResult = 1;
+				break;
+			}
+		}
+		while ( z.avail_out == 0 );
+	}
+	while ( nFlush != Z_FINISH && nResult == 0 );
+
+	deflateEnd(&z);
+
+	return nResult;
+}
+
+#ifdef HAVE_ZSTD
+/*
+ * zstdDecode()
+ *
+ * decompress zstd file into the ring, concatenated frames are
+ * decoded as one stream. 'in' and 'out' are STREAM_CHUNK buffers
+ * return '0' on success
+ *
+ */
+static int zstdDecode(struct stream *s, t_byte *in, t_byte *out)
+{
+	ZSTD_DStream	*d;
+	ZSTD_inBuffer	zin = {in, 0, 0};
+	ZSTD_outBuffer	zout = {out, STREAM_CHUNK, 0};
+	size_t			nRet = 0;
+	int				nFrame = 0;
+	int				nResult = 0;
+
+	if ( (d = ZSTD_createDStream()) == NULL )
+		return 1;
+
+	ZSTD_initDStream(d);
+
+	while ( 1 )
+	{
+		if ( zin.pos == zin.size && zout.pos != zout.size )		// decoder holds no more output, read input
+		{
+			if ( (zin.size = rawRead(s, in, STREAM_CHUNK)) == 0 )
+			{
+				if ( ferror(s->fp) )
+				{
+					streamMessage(s->message, s->arg, IMAGE_EFILE, "zstdDecode() error reading '%s' (errno=%d)", s->sName, errno);
+					nResult = 1;
+				}
+				else if ( nRet != 0 || !nFrame )
+				{
+					streamMessage(s->message, s->arg, IMAGE_EFORMAT, "zstdDecode() '%s' truncated", s->sName);
+					nResult = 1;
+				}
+				break;
+			}
+			zin.pos = 0;
+		}
+
+		zout.pos = 0;
+
+		nRet = ZSTD_decompressStream(d, &zout, &zin);
+		if ( ZSTD_isError(nRet) )
+		{
+			streamMessage(s->message, s->arg, IMAGE_EFORMAT, "zstdDecode() '%s' corrupt data (%s)", s->sName, ZSTD_getErrorName(nRet));
+			nResult = 1;
+			break;
+		}
+
+		if ( nRet == 0 )
+			nFrame = 1;
+
+		if ( ringPut(s, out, zout.pos) )						// reader closed the stream
+			break;
+	}
+
+	ZSTD_freeDStream(d);
+
+	return nResult;
+}
+
+/*
+ * zstdEncode()
+ *
+ * compress the ring into a zstd file until the writer closes the stream.
+ * 'in' and 'out' are STREAM_CHUNK buffers
+ * return '0' on success
+ *
+ */
+static int zstdEncode(struct stream *s, t_byte *in, t_byte *out)
+{
+	ZSTD_CCtx		*c;
+	ZSTD_inBuffer	zin;
+	ZSTD_outBuffer	zout;
+	ZSTD_EndDirective	nMode;
+	size_t			nRet;
+	int				nDone;
+	int				nResult = 0;
+
+	if ( (c = ZSTD_createCCtx()) == NULL )
+		return 1;
+
+	ZSTD_CCtx_setParameter(c, ZSTD_c_compressionLevel, STREAM_ZLEVEL);
+
+	do
+	{
+		zin.src = in;
+		zin.size = ringGet(s, in, STREAM_CHUNK);
+		zin.pos = 0;
+		nMode = (zin.size > 0) ? ZSTD_e_continue : ZSTD_e_end;
+
+		do
+		{
+			zout.dst = out;
+			zout.size = STREAM_CHUNK;
+			zout.pos = 0;
+
+			nRet = ZSTD_compressStream2(c, &zout, &zin, nMode);
+			if ( ZSTD_isError(nRet) )
+			{
+				streamMessage(s->message, s->arg, IMAGE_EFORMAT, "zstdEncode() '%s' %s", s->sName, ZSTD_getErrorName(nRet));
+				nResult = 1;
+				break;
+			}
+
+			if ( zout.pos > 0 && fwrite(out, 1, zout.pos, s->fp) != zout.pos )
+			{
+				streamMessage(s->message, s->arg, IMAGE_EFILE, "zstdEncode() error writing '%s' (errno=%d)", s->sName, errno);
+				nResult = 1;
+				break;
+			}
+
+			nDone = (nMode == ZSTD_e_end) ? (nRet == 0) : (zin.pos == zin.size);
+		}
+		while ( !nDone );
+	}
+	while ( nMode != ZSTD_e_end && nResult == 0 );
+
+	ZSTD_freeCCtx(c);
+
+	return nResult;
+}
+#endif
+
+/*
+ * streamMessage()
+ *
+ * format a message and pass it to callback 'message', if any
+ *
+ */
+static void streamMessage(t_message message, void *arg, int nCode, const char *sFormat, ...)
+{
+	char	sMessage[TEXT_LEN * 4];
+	va_list	args;
+
+	if ( message == NULL )
+		return;
+
+	va_start(args, sFormat);
+	vsnprintf(sMessage, sizeof(sMessage), sFormat, args);
+	va_end(args);
+
+	message(arg, nCode, sMessage);
+}
@@ -0,0 +1,46 @@
+/*
+ * stream.h
+ *
+ *      Purpose:
+ *
+ *      transparent compressed file streams.
+ *      a stdio stream is wrapped so that gzip (zlib) or zstd compressed
+ *      images read and write like plain files. input compression is
+ *      detected from the magic bytes, output compression is selected by
+ *      the file name extension. compression runs in a codec thread
+ *      that exchanges data with the stream through a ring buffer.
+ *      zstd is only available when built with HAVE_ZSTD defined.
+ *
+ */
+
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdio.h>
+
+#include "image.h"
+
+/*
+ * definitions
+ */
+#define STREAM_PLAIN	0			// stream codecs
+#define STREAM_GZIP		1
+#define STREAM_ZSTD		2
+
+#define STREAM_GZIP_EXT	".gz"		// output file name extensions
+#define STREAM_ZSTD_EXT	".zst"
+
+#define STREAM_RING		(256*1024)	// ring buffer between stream and codec thread
+#define STREAM_CHUNK	(64*1024)	// codec input and output block size
+#define STREAM_MAGIC	4			// bytes read to detect input compression
+#define STREAM_LEVEL	9			// gzip compression level
+#define STREAM_ZLEVEL	12			// zstd compression level
+
+/*
+ * function prototypes
+ */
+FILE	*streamOpen(FILE*, const char*, int, int*, t_message, void*);	// wrap a stream for decompression or compression
+int		streamCodec(const char*);		// output codec selected by file name extension
+const char	*streamName(int);			// printable codec name
+
+#endif /* __STREAM_H__ */
@@ -0,0 +1,223 @@
+/*
+ * image_test.c
+ *
+ *      Purpose:
+ *
+ *      convert mode image tests, no port needed: Intel HEX ranges cropped
+ *      above 64K are written with their extended linear address records
+ *      and read back at the same addresses, and multi-threaded encodes
+ *      produce the same text as a single thread.
+ *      exit code is '0' when all checks pass
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../image.h"
+
+/*
+ * definitions
+ */
+#define CHECK(c)	check((c), #c, __FILE__, __LINE__)
+
+#define HEX_FILE	"/tmp/image_test.hex"
+#define HEX_FILE_MT	"/tmp/image_test_mt.hex"
+
+#define IMAGE_BASE	0x10000UL
+#define IMAGE_SIZE	0x60000UL
+
+/*
+ * function prototypes
+ */
+void	check(int, const char*, const char*, int);	// count and report a failed check
+void	convertInit(struct convert*, int);	// Intel HEX convert options with 'nThreads'
+int		sameFile(char*, char*);				// compare two files
+int		roundTrip(unsigned long, unsigned long);	// write a range and read it back
+void	testCrop(void);						// ranges cropped above 64K
+void	testThreads(void);					// threaded encode matches one thread
+
+/*
+ * globals
+ */
+int		nChecks = 0;
+int		nFailed = 0;
+
+struct image	img;
+
+/*
+ * main()
+ *
+ */
+int main(void)
+{
+	unsigned long	a;
+
+	img.base = IMAGE_BASE;
+	img.size = IMAGE_SIZE;
+	img.data = malloc(IMAGE_SIZE);
+	img.used = malloc(IMAGE_SIZE);
+	if ( img.data == NULL || img.used == NULL )
+		return 1;
+
+	for ( a = 0; a < IMAGE_SIZE; a++ )
+		img.data[a] = (t_byte) ((a * 7) ^ (a >> 9));
+	memset(img.used, 1, IMAGE_SIZE);
+
+	testCrop();
+	testThreads();
+
+	unlink(HEX_FILE);
+	unlink(HEX_FILE_MT);
+	free(img.data);
+	free(img.used);
+
+	printf("image_test: %d checks, %d failed\n", nChecks, nFailed);
+
+	return (nFailed != 0);
+}
+
+/*
+ * testCrop()
+ *
+ * a range above 64K starts with its extended linear address record,
+ * ranges within and across segments read back at their addresses
+ *
+ */
+void testCrop(void)
+{
+	FILE	*fp;
+	char	textLine[RECORD_LEN];
+
+	CHECK(roundTrip(0x18000, 0x18fff) == 0);
+
+	CHECK((fp = fopen(HEX_FILE, "r")) != NULL);
+	if ( fp )
+	{
+		CHECK(fgets(textLine, sizeof(textLine), fp) != NULL && strncmp(textLine, ":020000040001F9", 15) == 0);
+		fclose(fp);
+	}
+
+	CHECK(roundTrip(0x1fff0, 0x2000f) == 0);			// across a segment boundary
+	CHECK(roundTrip(0x10000, 0x10000) == 0);
+	CHECK(roundTrip(0x6fff8, 0x6ffff) == 0);
+}
+
+/*
+ * testThreads()
+ *
+ * ranges over several segments, with and without gaps, encode to
+ * the same text with one thread and with a chunk per thread
+ *
+ */
+void testThreads(void)
+{
+	struct convert	cv;
+
+	convertInit(&cv, 1);
+	CHECK(writeImageFile(&cv, HEX_FILE, &img, 0x10003, 0x6fffc) == 0);
+	convertInit(&cv, 5);
+	CHECK(writeImageFile(&cv, HEX_FILE_MT, &img, 0x10003, 0x6fffc) == 0);
+	CHECK(sameFile(HEX_FILE, HEX_FILE_MT));
+
+	memset(&img.used[0x08000], 0, 0x30000);					// gap over whole chunks and segments
+
+	convertInit(&cv, 1);
+	CHECK(writeImageFile(&cv, HEX_FILE, &img, 0x18000, 0x6ffff) == 0);
+	convertInit(&cv, 5);
+	CHECK(writeImageFile(&cv, HEX_FILE_MT, &img, 0x18000, 0x6ffff) == 0);
+	CHECK(sameFile(HEX_FILE, HEX_FILE_MT));
+
+	memset(&img.used[0x08000], 1, 0x30000);
+}
+
+/*
+ * roundTrip()
+ *
+ * write image range 'lo' to 'hi' as Intel HEX on two threads,
+ * read the file back and compare addresses and data
+ * return '0' if the range reads back unchanged
+ *
+ */
+int roundTrip(unsigned long lo, unsigned long hi)
+{
+	struct convert	cv;
+	struct image	back = {0, 0, NULL, NULL};
+	int				nResult;
+
+	convertInit(&cv, 2);
+
+	if ( writeImageFile(&cv, HEX_FILE, &img, lo, hi) || loadImageFile(&cv, HEX_FILE, &back) )
+		return 1;
+
+	nResult = ( back.base != lo || back.size != (hi - lo + 1) ||
+				memcmp(back.data, &img.data[lo - img.base], back.size) != 0 );
+
+	free(back.data);
+	free(back.used);
+
+	return nResult;
+}
+
+/*
+ * convertInit()
+ *
+ * set Intel HEX convert options without fill or messages
+ *
+ */
+void convertInit(struct convert *cv, int nThreads)
+{
+	memset(cv, 0, sizeof(struct convert));
+
+	cv->nFormat = INTEL_HEX;
+	cv->nFill = -1;
+	cv->nThreads = nThreads;
+}
+
+/*
+ * sameFile()
+ *
+ * return '1' if files 'sName1' and 'sName2' hold the same bytes
+ *
+ */
+int sameFile(char *sName1, char *sName2)
+{
+	FILE	*fp1 = fopen(sName1, "r");
+	FILE	*fp2 = fopen(sName2, "r");
+	int		c1 = 0, c2 = 0;
+
+	if ( fp1 && fp2 )
+	{
+		do
+		{
+			c1 = getc(fp1);
+			c2 = getc(fp2);
+		} while ( c1 == c2 && c1 != EOF );
+	}
+
+	if ( fp1 )
+		fclose(fp1);
+	if ( fp2 )
+		fclose(fp2);
+
+	return ( fp1 && fp2 && c1 == c2 );
+}
+
+/*
+ * check()
+ *
+ * count a check, report it when condition 'nPass' is false
+ *
+ */
+void check(int nPass, const char *sCondition, const char *sFile, int nLine)
+{
+	nChecks++;
+
+	if ( nPass )
+		return;
+
+	nFailed++;
+	printf("%s:%d: check failed: %s\n", sFile, nLine, sCondition);
+}
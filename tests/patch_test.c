@@ -0,0 +1,218 @@
+/*
+ * patch_test.c
+ *
+ *      Purpose:
+ *
+ *      patch parser tests, no port needed: IPS records, run records,
+ *      the 'EOF' marker, truncated patches and out of range records,
+ *      and offset/bytes list lines with before values and bad hex.
+ *      exit code is '0' when all checks pass
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../eeprom.h"
+
+/*
+ * definitions
+ */
+#define CHECK(c)	check((c), #c, __FILE__, __LINE__)
+
+/*
+ * function prototypes
+ */
+void	check(int, const char*, const char*, int);	// count and report a failed check
+int		ips(const char*, int, t_word);		// plan IPS patch bytes
+int		list(const char*, t_word);			// plan list patch text
+void	testIps(void);						// IPS records, runs and EOF marker
+void	testIpsErrors(void);				// truncated and out of range IPS patches
+void	testList(void);						// list lines and before values
+void	testListErrors(void);				// bad list lines
+
+/*
+ * globals
+ */
+int		nChecks = 0;
+int		nFailed = 0;
+
+struct eeprom	ctx;
+struct plan		plan;
+struct plan		before;
+
+/*
+ * main()
+ *
+ */
+int main(void)
+{
+	eepromInit(&ctx);
+
+	testIps();
+	testIpsErrors();
+	testList();
+	testListErrors();
+
+	printf("patch_test: %d checks, %d failed\n", nChecks, nFailed);
+
+	return (nFailed != 0);
+}
+
+/*
+ * testIps()
+ *
+ * a data record and a run record longer than a page are planned,
+ * records after the 'EOF' marker and the truncate length are ignored
+ *
+ */
+void testIps(void)
+{
+	static const char	patch[] =
+		"PATCH"
+		"\x00\x01\x00" "\x00\x03" "\x11\x22\x33"			// 0x0100: 11 22 33
+		"\x00\x20\x00" "\x00\x00" "\x00\x96" "\xee"			// 0x2000: 150 x ee
+		"EOF"
+		"\x00\x30\x00" "\x00\x01" "\x55"					// after EOF, not a record
+		;
+	long	a;
+
+	CHECK(ips(patch, sizeof(patch) - 1, 0) == EEPROM_OK);
+	CHECK(plan.nBytes == 3 + 150);
+	CHECK(plan.data[0x0100] == 0x11 && plan.data[0x0101] == 0x22 && plan.data[0x0102] == 0x33);
+	CHECK(plan.used[0x00ff] == 0 && plan.used[0x0103] == 0);
+
+	for ( a = 0x2000; a < 0x2000 + 150 && plan.used[a] && plan.data[a] == 0xee; a++ )
+		;
+	CHECK(a == 0x2000 + 150);
+	CHECK(plan.used[0x2000 + 150] == 0);
+	CHECK(plan.used[0x3000] == 0);
+
+	CHECK(ips(patch, sizeof(patch) - 1, 0x0400) == EEPROM_OK);	// offsets relative to base
+	CHECK(plan.used[0x0500] && plan.data[0x0500] == 0x11 && plan.used[0x0100] == 0);
+
+	CHECK(ips("PATCH" "EOF" "\x00\x80\x00", 11, 0) == EEPROM_OK);	// empty patch, truncate length
+	CHECK(plan.nBytes == 0);
+}
+
+/*
+ * testIpsErrors()
+ *
+ * patches cut short anywhere in a record or before the 'EOF' marker are
+ * rejected, records running past the end of the eeprom are out of range
+ *
+ */
+void testIpsErrors(void)
+{
+	CHECK(ips("PATCH" "\x00\x01\x00" "\x00\x03" "\x11\x22", 12, 0) == EEPROM_EFORMAT);	// short data
+	CHECK(ips("PATCH" "\x00\x01\x00" "\x00", 9, 0) == EEPROM_EFORMAT);					// short size
+	CHECK(ips("PATCH" "\x00\x01\x00" "\x00\x00" "\x00\x10", 12, 0) == EEPROM_EFORMAT);	// short run
+	CHECK(ips("PATCH" "\x00\x01", 7, 0) == EEPROM_EFORMAT);								// short offset
+	CHECK(ips("PATCH" "\x00\x01\x00" "\x00\x01" "\x11", 11, 0) == EEPROM_EFORMAT);		// no EOF
+	CHECK(ips("PATCH" "\x00\x01\x00" "\x00\x01" "\x11" "EO", 13, 0) == EEPROM_EFORMAT);	// EOF cut short
+
+	CHECK(ips("PATCH" "\x00\x7f\xf0" "\x00\x00" "\x00\x11" "\xaa" "EOF", 18, 0) == EEPROM_ERANGE);	// run past end
+	CHECK(ips("PATCH" "\x00\x7f\xf0" "\x00\x00" "\x00\x10" "\xaa" "EOF", 18, 0) == EEPROM_OK);		// run to end
+	CHECK(plan.used[EEPROM_SIZE - 1] && plan.data[EEPROM_SIZE - 1] == 0xaa);
+	CHECK(ips("PATCH" "\x00\x7f\xff" "\x00\x02" "\x11\x22" "EOF", 15, 0) == EEPROM_ERANGE);		// data past end
+	CHECK(ips("PATCH" "\x00\x7f\xff" "\x00\x01" "\x11" "EOF", 14, 1) == EEPROM_ERANGE);			// past end after base
+	CHECK(ips("PATCH" "\x10\x00\x00" "\x00\x01" "\x11" "EOF", 14, 0) == EEPROM_ERANGE);			// 24 bit offset
+	CHECK(plan.nBytes == 0);
+}
+
+/*
+ * testList()
+ *
+ * list lines with spaces, commas, bytes run together, comments
+ * and before values, before values go to plan 'before'
+ *
+ */
+void testList(void)
+{
+	CHECK(list("# header comment\n"
+			   "1ff0: 12 34,56 78\n"
+			   "\n"
+			   "  0010 abcd # trailing comment\n"
+			   "7ffc: ff ff -> 00 80\r\n", 0) == EEPROM_OK);
+	CHECK(plan.nBytes == 4 + 2 + 2);
+	CHECK(plan.data[0x1ff0] == 0x12 && plan.data[0x1ff3] == 0x78);
+	CHECK(plan.data[0x0010] == 0xab && plan.data[0x0011] == 0xcd);
+	CHECK(plan.data[0x7ffc] == 0x00 && plan.data[0x7ffd] == 0x80);
+	CHECK(before.nBytes == 2 && before.data[0x7ffc] == 0xff && before.data[0x7ffd] == 0xff);
+
+	CHECK(list("0010: 01\n", 0x0100) == EEPROM_OK);	// offsets relative to base
+	CHECK(plan.used[0x0110] && plan.data[0x0110] == 0x01);
+}
+
+/*
+ * testListErrors()
+ *
+ * bad hex offsets and bytes, odd digit counts, missing
+ * bytes, mismatched before values and out of range lines
+ *
+ */
+void testListErrors(void)
+{
+	CHECK(list("0010: 12 3g\n", 0) == EEPROM_EFORMAT);
+	CHECK(list("0010: 123\n", 0) == EEPROM_EFORMAT);
+	CHECK(list("0010: xy\n", 0) == EEPROM_EFORMAT);
+	CHECK(list("zz: 12\n", 0) == EEPROM_EFORMAT);
+	CHECK(list("10g: 12\n", 0) == EEPROM_EFORMAT);
+	CHECK(list("0010:\n", 0) == EEPROM_EFORMAT);
+	CHECK(list("0010: 12 34 -> 56\n", 0) == EEPROM_EFORMAT);
+	CHECK(list("0010: 12 ->\n", 0) == EEPROM_EFORMAT);
+	CHECK(list("0010: 12\n0010: 13\n", 0) == EEPROM_EFORMAT);	// conflicting lines
+
+	CHECK(list("7fff: 12 34\n", 0) == EEPROM_ERANGE);
+	CHECK(list("8000: 12\n", 0) == EEPROM_ERANGE);
+	CHECK(list("7fff: 12\n", 1) == EEPROM_ERANGE);
+	CHECK(list("7fff: 12\n", 0) == EEPROM_OK);
+}
+
+/*
+ * ips()
+ *
+ * clear the plans and plan IPS patch 'patch' of 'nLength' bytes at 'base'
+ * return planIps() result
+ *
+ */
+int ips(const char *patch, int nLength, t_word base)
+{
+	planInit(&plan);
+	planInit(&before);
+
+	return planIps(&ctx, &plan, (t_byte *) patch, nLength, base);
+}
+
+/*
+ * list()
+ *
+ * clear the plans and plan list patch text 'sText' at 'base'
+ * return planList() result
+ *
+ */
+int list(const char *sText, t_word base)
+{
+	planInit(&plan);
+	planInit(&before);
+
+	return planList(&ctx, &plan, (t_byte *) sText, (int) strlen(sText), base, &before);
+}
+
+/*
+ * check()
+ *
+ * count a check, report it when condition 'nPass' is false
+ *
+ */
+void check(int nPass, const char *sCondition, const char *sFile, int nLine)
+{
+	nChecks++;
+
+	if ( nPass )
+		return;
+
+	nFailed++;
+	printf("%s:%d: check failed: %s\n", sFile, nLine, sCondition);
+}
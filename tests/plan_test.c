@@ -0,0 +1,290 @@
+/*
+ * plan_test.c
+ *
+ *      Purpose:
+ *
+ *      write planner tests against the emulated programer, no port needed:
+ *      overlap conflicts, ascending page order, page fill and the byte
+ *      mode fallback of page writes that fail verification, and the image
+ *      format given or detected for the planned input.
+ *      page write order is taken from a bus trace of the write.
+ *      exit code is '0' when all checks pass
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../eeprom.h"
+#include "../emu.h"
+#include "../station.h"
+#include "../trace.h"
+
+/*
+ * definitions
+ */
+#define CHECK(c)	check((c), #c, __FILE__, __LINE__)
+
+#define TRACE_FILE	"/tmp/plan_test.trc"
+
+/*
+ * function prototypes
+ */
+void	check(int, const char*, const char*, int);	// count and report a failed check
+int		tracePages(char*, t_word*, int);	// list page write addresses of a trace file
+void	testOverlap(void);					// overlapping and conflicting bytes
+void	testOrderFill(void);				// page order and page fill
+void	testFallback(void);					// byte mode fallback after failed page writes
+void	testFormat(void);					// given and detected image formats
+
+/*
+ * globals
+ */
+int		nChecks = 0;
+int		nFailed = 0;
+
+struct eeprom	ctx;
+struct emu		emu;
+struct station	model;
+struct plan		plan;
+
+/*
+ * main()
+ *
+ */
+int main(void)
+{
+	testOverlap();
+	testOrderFill();
+	testFallback();
+	testFormat();
+
+	printf("plan_test: %d checks, %d failed\n", nChecks, nFailed);
+
+	return (nFailed != 0);
+}
+
+/*
+ * testOverlap()
+ *
+ * identical overlapping bytes are counted as duplicates,
+ * a different byte at a planned address is rejected
+ *
+ */
+void testOverlap(void)
+{
+	t_byte	first[] = {0x01, 0x02, 0x03};
+	t_byte	same[] = {0x02, 0x03, 0x04};
+	t_byte	conflict[] = {0x99};
+
+	eepromInit(&ctx);
+	planInit(&plan);
+
+	CHECK(planAdd(&ctx, &plan, 0x0010, first, 3) == EEPROM_OK);
+	CHECK(planAdd(&ctx, &plan, 0x0011, same, 3) == EEPROM_OK);
+	CHECK(plan.nDuplicates == 2);
+	CHECK(plan.nBytes == 4);
+
+	CHECK(planAdd(&ctx, &plan, 0x0012, conflict, 1) == EEPROM_EFORMAT);
+	CHECK(plan.data[0x0012] == 0x03);
+
+	CHECK(planAdd(&ctx, &plan, EEPROM_SIZE - 2, first, 3) == EEPROM_ERANGE);
+	CHECK(plan.used[EEPROM_SIZE - 2] == 0);
+}
+
+/*
+ * testOrderFill()
+ *
+ * bytes added to pages 5, 1 and 3 in that order are planned and
+ * written in ascending page order with the unused bytes filled,
+ * pages without planned bytes are not touched
+ *
+ */
+void testOrderFill(void)
+{
+	t_byte	data[8] = {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17};
+	t_word	pages[PAGES];
+	int		nPages;
+	int		i;
+	long	a;
+
+	eepromInit(&ctx);
+	planInit(&plan);
+
+	CHECK(planAdd(&ctx, &plan, 5 * PAGE_SIZE + 4, data, 8) == EEPROM_OK);
+	CHECK(planAdd(&ctx, &plan, 1 * PAGE_SIZE, data, 2) == EEPROM_OK);
+	CHECK(planAdd(&ctx, &plan, 3 * PAGE_SIZE + PAGE_SIZE - 1, data, 1) == EEPROM_OK);
+
+	planBuild(&plan, 0xa5);
+
+	CHECK(plan.nPages == 3);
+	CHECK(plan.pages[0] == 1 * PAGE_SIZE && plan.pages[1] == 3 * PAGE_SIZE && plan.pages[2] == 5 * PAGE_SIZE);
+	CHECK(plan.nFilled == 3 * PAGE_SIZE - 11);
+	CHECK(plan.nBytes == 3 * PAGE_SIZE);
+	CHECK(plan.data[1 * PAGE_SIZE + 2] == 0xa5 && plan.data[3 * PAGE_SIZE] == 0xa5 && plan.data[5 * PAGE_SIZE + 12] == 0xa5);
+	CHECK(plan.data[5 * PAGE_SIZE + 4] == 0x10 && plan.data[3 * PAGE_SIZE + PAGE_SIZE - 1] == 0x10);
+	CHECK(plan.used[2 * PAGE_SIZE] == 0 && plan.used[4 * PAGE_SIZE] == 0);
+
+	stationInit(&model);
+	eepromEmulate(&ctx, &emu, &model);
+	CHECK((ctx.trace = traceOpen(TRACE_FILE)) != NULL);
+	CHECK(isProgReady(&ctx));
+
+	CHECK(writePlan(&ctx, &plan) == EEPROM_OK);
+	CHECK(plan.nCurrent == 0 && plan.nFallbacks == 0);
+
+	CHECK(traceClose(ctx.trace) == 0);
+	ctx.trace = NULL;
+
+	nPages = tracePages(TRACE_FILE, pages, PAGES);
+	unlink(TRACE_FILE);
+
+	CHECK(nPages == 3);
+	for ( i = 1; i < nPages; i++ )
+		CHECK(pages[i] > pages[i - 1]);
+
+	for ( a = 0; a < EEPROM_SIZE; a++ )
+	{
+		if ( emu.mem[a] != (plan.used[a] ? plan.data[a] : 0xff) )
+			break;
+	}
+	CHECK(a == EEPROM_SIZE);
+
+	CHECK(writePlan(&ctx, &plan) == EEPROM_OK);		// eeprom holds the plan now
+	CHECK(plan.nCurrent == 1);
+
+	eepromClose(&ctx);
+}
+
+/*
+ * testFallback()
+ *
+ * a byte load window shorter than a byte load makes the emulated chip
+ * start its write cycle after the first byte of a page and ignore the
+ * rest, every page write fails verification and is rewritten in byte mode
+ *
+ */
+void testFallback(void)
+{
+	t_byte	data[3 * PAGE_SIZE];
+	long	a;
+	int		i;
+
+	for ( i = 0; i < (int) sizeof(data); i++ )
+		data[i] = (t_byte) (i * 7 + 1);
+
+	eepromInit(&ctx);
+	ctx.nForce = 1;
+	planInit(&plan);
+
+	CHECK(planAdd(&ctx, &plan, 0x0100, data, sizeof(data)) == EEPROM_OK);
+	planBuild(&plan, -1);
+
+	stationInit(&model);
+	eepromEmulate(&ctx, &emu, &model);
+	emu.blcNs = 1;
+	CHECK(isProgReady(&ctx));
+
+	CHECK(writePlan(&ctx, &plan) == EEPROM_OK);
+	CHECK(plan.nFallbacks == 3);
+	CHECK(emu.nBusyWrites > 0);
+
+	for ( a = 0; a < (long) sizeof(data); a++ )
+	{
+		if ( emu.mem[0x0100 + a] != data[a] )
+			break;
+	}
+	CHECK(a == (long) sizeof(data));
+
+	eepromClose(&ctx);
+}
+
+/*
+ * testFormat()
+ *
+ * a given format is parsed as such, a text image whose first record
+ * does not parse is an error and not a binary image
+ *
+ */
+void testFormat(void)
+{
+	char	srec[] = "S1050010AB1C23\n";
+	char	broken[] = "S1050010AB1C24\n";
+
+	eepromInit(&ctx);
+	planInit(&plan);
+
+	CHECK(detectFormat((t_byte *) srec, strlen(srec)) == S_RECORD);
+	CHECK(detectFormat((t_byte *) broken, strlen(broken)) == 0);
+	CHECK(detectFormat((t_byte *) "S\x01\x02\n", 4) == BINARY);
+
+	CHECK(planImage(&ctx, &plan, (t_byte *) srec, strlen(srec), 0x0100) == EEPROM_OK);
+	CHECK(plan.nBytes == 2 && plan.data[0x0010] == 0xab && plan.data[0x0011] == 0x1c);
+
+	planInit(&plan);
+	CHECK(planImage(&ctx, &plan, (t_byte *) broken, strlen(broken), 0x0100) == EEPROM_EFORMAT);
+	CHECK(plan.nBytes == 0);
+
+	planInit(&plan);
+	ctx.nFormat = BINARY;							// given format is not detected
+	CHECK(planImage(&ctx, &plan, (t_byte *) srec, strlen(srec), 0x0100) == EEPROM_OK);
+	CHECK(plan.nBytes == (long) strlen(srec) && plan.data[0x0100] == 'S');
+
+	planInit(&plan);
+	ctx.nFormat = INTEL_HEX;
+	CHECK(planImage(&ctx, &plan, (t_byte *) srec, strlen(srec), 0x0100) == EEPROM_EFORMAT);
+}
+
+/*
+ * tracePages()
+ *
+ * list the pages of the TRACE_PAGE records of trace file 'sName'
+ * in recorded order, at most 'nMax'
+ * return number of pages listed or '-1' on error
+ *
+ */
+int tracePages(char *sName, t_word *pages, int nMax)
+{
+	struct traceHeader	header;
+	struct traceRecord	record;
+	FILE				*fp;
+	int					nPages = 0;
+
+	if ( (fp = fopen(sName, "rb")) == NULL )
+		return -1;
+
+	if ( fread(&header, sizeof(header), 1, fp) != 1 || header.magic != TRACE_MAGIC )
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	while ( fread(&record, sizeof(record), 1, fp) == 1 && nPages < nMax )
+	{
+		if ( record.type == TRACE_PAGE )
+			pages[nPages++] = record.address & ~(PAGE_SIZE - 1);
+	}
+
+	fclose(fp);
+
+	return nPages;
+}
+
+/*
+ * check()
+ *
+ * count a check, report it when condition 'nPass' is false
+ *
+ */
+void check(int nPass, const char *sCondition, const char *sFile, int nLine)
+{
+	nChecks++;
+
+	if ( nPass )
+		return;
+
+	nFailed++;
+	printf("%s:%d: check failed: %s\n", sFile, nLine, sCondition);
+}
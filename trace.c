@@ -0,0 +1,674 @@
+/*
+ * trace.c
+ *
+ *      Purpose:
+ *
+ *      bus level trace recording, analysis and replay.
+ *
+ *      recording is kept cheap enough to leave on: one clock read and an
+ *      8 byte store per port access, records are written to the file in
+ *      TRACE_BUFFER blocks.
+ *
+ *      the analyzer rebuilds programer state from the port accesses:
+ *      address registers and /CS are latched on strobe, /WE and /OE cycles
+ *      run from strobe active to strobe inactive. time between records is
+ *      charged to a bus phase and operations are timed between their
+ *      start and end markers.
+ *
+ *      replay drives the emulated chip in emu.c with the traced port writes
+ *      on the traced time line and compares every traced read with what
+ *      the emulated chip returns. chip contents that were never written in
+ *      the trace are learned from the first read.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "trace.h"
+#include "emu.h"
+
+/*
+ * local type definitions
+ */
+struct traceOp								// operation between start and end markers
+{
+	struct traceRecord	rec;				// start marker
+	t_byte				result;				// end marker value
+	long long			start;				// time from trace start
+	long long			duration;
+	int					nPolls;				// readByte() calls nested in writeByte()
+};
+
+/*
+ * local function prototypes
+ */
+static void	traceStore(struct trace*, unsigned int, int, t_word, t_byte);	// store record in buffer
+static void	traceFlush(struct trace*);			// write buffered records to file
+static FILE	*traceLoad(char*, struct traceHeader*);	// open trace file and check header
+static void	traceSlow(struct traceOp*, int*, struct traceOp*);	// keep slowest operations
+
+/*
+ * local definitions
+ */
+#define DATA_INIT	0xff		// port states set by eepromOpen()
+#define CNTRL_INIT	0x0f
+
+#define STROBE		0x01		// control port strobe bit
+#define FUNC(c)		(((c) >> 1) & 0x07)	// decoder function select F2 F1 F0
+
+#define F_LOADD		0			// decoder outputs
+#define F_HIADD		1
+#define F_WE		2
+#define F_OE		3
+#define F_LOOP		7
+
+#define CS_BIT		0x80		// /CS in high address register
+
+#define TRACE_WRITE_NS	1000000	// replay write cycle, as short as writeByte() allows, so a slow
+								// traced chip shows up as busy late rather than as ignored loads
+
+#define OP_DEPTH	4			// operation marker nesting, writeByte() polls with readByte()
+#define OP_TYPE(t)	(((t) == TRACE_PAGE) ? OP_PAGE : ((t) - TRACE_READ))	// marker to operation type
+#define IS_WRITE(t)	((t) == TRACE_WRITE || (t) == TRACE_PAGE)	// markers of DATA polled writes
+
+#define PH_OTHER	0			// bus phases
+#define PH_ADDRESS	1
+#define PH_WRITE	2
+#define PH_DELAY	3
+#define PH_POLL		4
+#define PH_READ		5
+#define PH_LOOP		6
+#define PHASES		7
+
+/*
+ * locals
+ */
+static const char	*phaseName[PHASES] = {"host/other", "address setup", "write pulse", "delay", "poll/verify", "read", "loop test"};
+static const char	*opName[OP_TYPES] = {"readByte()", "writeByte()", "fastByteWrite()", "writePage()"};
+
+/*
+ * -----------------------------------------
+ * ---------  recording functions  ---------
+ * -----------------------------------------
+ */
+
+/*
+ * traceOpen()
+ *
+ * create trace file 'sName' and return a recorder,
+ * or NULL if the file cannot be created
+ *
+ */
+struct trace *traceOpen(char *sName)
+{
+	struct trace		*tr;
+	struct traceHeader	header;
+	struct timespec		ts;
+
+	if ( (tr = calloc(1, sizeof(struct trace))) == NULL )
+	{
+		printf("traceOpen() out of memory\n");
+		return NULL;
+	}
+
+	if ( (tr->fp = fopen(sName, "wb")) == NULL )
+	{
+		printf("traceOpen() could not open file '%s' for writing (errno=%d)\n", sName, errno);
+		free(tr);
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	memset(&header, 0, sizeof(struct traceHeader));
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+	header.recordSize = sizeof(struct traceRecord);
+	header.startTime = ((long long) ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+
+	if ( fwrite(&header, sizeof(struct traceHeader), 1, tr->fp) != 1 )
+		tr->nError = 1;
+
+	tr->lastTime = getTimeNs();
+
+	return tr;
+}
+
+/*
+ * traceClose()
+ *
+ * flush buffered records and close trace file
+ * return '0' if all records were written
+ *
+ */
+int traceClose(struct trace *tr)
+{
+	int		nResult;
+
+	traceFlush(tr);
+
+	if ( fclose(tr->fp) )
+		tr->nError = 1;
+
+	nResult = tr->nError;
+	if ( nResult )
+		printf("traceClose() error writing trace file, trace is truncated\n");
+
+	free(tr);
+
+	return nResult;
+}
+
+/*
+ * traceEvent()
+ *
+ * record event 'nType' with its address and value
+ * and the time since the previous record
+ *
+ */
+void traceEvent(struct trace *tr, int nType, t_word address, t_byte value)
+{
+	long long	now;
+	long long	delta;
+
+	now = getTimeNs();
+	delta = now - tr->lastTime;
+	tr->lastTime = now;
+
+	while ( delta > 0xffffffffLL )						// gaps over ~4.3 seconds
+	{
+		traceStore(tr, 0xffffffff, TRACE_GAP, 0, 0);
+		delta -= 0xffffffffLL;
+	}
+
+	traceStore(tr, (unsigned int) delta, nType, address, value);
+}
+
+/*
+ * traceStore()
+ *
+ * store a record in the buffer, write buffer to file when full
+ *
+ */
+static void traceStore(struct trace *tr, unsigned int delta, int nType, t_word address, t_byte value)
+{
+	struct traceRecord	*rec = &tr->buffer[tr->nCount];
+
+	rec->delta = delta;
+	rec->type = (t_byte) nType;
+	rec->value = value;
+	rec->address = address;
+
+	if ( ++tr->nCount == TRACE_BUFFER )
+		traceFlush(tr);
+}
+
+/*
+ * traceFlush()
+ *
+ * write buffered records to trace file,
+ * drop them if an earlier write failed
+ *
+ */
+static void traceFlush(struct trace *tr)
+{
+	if ( tr->nCount && !tr->nError )
+	{
+		if ( fwrite(tr->buffer, sizeof(struct traceRecord), tr->nCount, tr->fp) != (size_t) tr->nCount )
+			tr->nError = 1;
+		else
+			tr->nRecords += tr->nCount;
+	}
+
+	tr->nCount = 0;
+}
+
+/*
+ * -----------------------------------------
+ * ---------  analysis functions  ----------
+ * -----------------------------------------
+ */
+
+/*
+ * traceAnalyze()
+ *
+ * read trace file 'sName', reconstruct programer bus cycles
+ * and print time spent per bus phase, operation statistics and
+ * the slowest operations. 'nVerbose' lists every bus cycle.
+ * return '0' on success
+ *
+ */
+int traceAnalyze(char *sName, int nVerbose)
+{
+	FILE				*fp;
+	struct traceHeader	header;
+	struct traceRecord	rec;
+	struct traceOp		stack[OP_DEPTH];		// open operations
+	int					nDepth = 0;
+	struct traceOp		top[TRACE_TOP];			// slowest operations
+	int					nTop = 0;
+	struct traceOp		*op;
+
+	long long	now = 0;
+	long long	cycleStart = 0;
+	long long	phaseTime[PHASES];
+	int			nPhase = PH_OTHER;
+
+	t_byte		control = CNTRL_INIT;
+	t_byte		data = DATA_INIT;
+	t_byte		loAddr = 0;
+	t_byte		hiAddr = CS_BIT;
+	t_byte		readData = DATA_INIT;
+
+	long		nRecords = 0;
+	long		nWriteCycles = 0;
+	long		nReadCycles = 0;
+	long		nLoLoads = 0;
+	long		nHiLoads = 0;
+	long		nCsAsserts = 0;
+	long		nOps[OP_TYPES];
+	long long	opTime[OP_TYPES];
+	long long	opMax[OP_TYPES];
+	long		nPolls = 0;
+	int			nMaxPolls = 0;
+	long		nWriteErrors = 0;
+
+	int			nOp;
+	int			i;
+	time_t		startSec;
+
+	if ( (fp = traceLoad(sName, &header)) == NULL )
+		return 1;
+
+	memset(phaseTime, 0, sizeof(phaseTime));
+	memset(nOps, 0, sizeof(nOps));
+	memset(opTime, 0, sizeof(opTime));
+	memset(opMax, 0, sizeof(opMax));
+
+	if ( nVerbose )
+		printf("    time(us)  cycle  address  data  /CS  width(ns)\n");
+
+	while ( fread(&rec, sizeof(struct traceRecord), 1, fp) == 1 )
+	{
+		nRecords++;
+		now += rec.delta;
+		phaseTime[nPhase] += rec.delta;					// interval belongs to the phase before this record
+
+		switch ( rec.type )
+		{
+			case TRACE_DATA:
+				data = rec.value;
+				break;
+
+			case TRACE_CONTROL:
+				if ( (control & STROBE) && !(rec.value & STROBE) )		// strobe active
+				{
+					switch ( FUNC(rec.value) )
+					{
+						case F_LOADD:
+							loAddr = data;
+							nLoLoads++;
+							break;
+
+						case F_HIADD:
+							if ( (hiAddr & CS_BIT) && !(data & CS_BIT) )
+								nCsAsserts++;
+							hiAddr = data;
+							nHiLoads++;
+							break;
+
+						case F_WE:
+						case F_OE:
+							cycleStart = now;
+							break;
+					}
+				}
+				else if ( !(control & STROBE) && (rec.value & STROBE) )	// strobe inactive
+				{
+					if ( FUNC(control) == F_WE )
+						nWriteCycles++;
+					else if ( FUNC(control) == F_OE )
+						nReadCycles++;
+
+					if ( nVerbose && (FUNC(control) == F_WE || FUNC(control) == F_OE) )
+						printf("%12.3f  %-5s  0x%04x   0x%02x  %d    %lld\n", now / 1000.0,
+								(FUNC(control) == F_WE) ? "/WE" : "/OE",
+								((hiAddr & 0x7f) << 8) | loAddr,
+								(FUNC(control) == F_WE) ? data : readData,
+								(hiAddr & CS_BIT) ? 1 : 0, now - cycleStart);
+				}
+
+				control = rec.value;
+
+				if ( FUNC(control) == F_WE )
+					nPhase = PH_WRITE;
+				else if ( FUNC(control) == F_OE )
+					nPhase = (nDepth > 1 && IS_WRITE(stack[0].rec.type)) ? PH_POLL : PH_READ;
+				else if ( FUNC(control) == F_LOOP )
+					nPhase = PH_LOOP;
+				break;
+
+			case TRACE_RDATA:
+				readData = rec.value;
+				break;
+
+			case TRACE_STATUS:
+				nPhase = PH_LOOP;
+				break;
+
+			case TRACE_DELAY:
+				nPhase = PH_DELAY;
+				break;
+
+			case TRACE_SETADDR:
+				nPhase = PH_ADDRESS;
+				break;
+
+			case TRACE_READ:
+			case TRACE_WRITE:
+			case TRACE_FAST:
+			case TRACE_PAGE:
+				if ( rec.type == TRACE_READ && nDepth > 0 && nDepth <= OP_DEPTH && IS_WRITE(stack[nDepth - 1].rec.type) )
+					stack[nDepth - 1].nPolls++;
+				if ( nDepth < OP_DEPTH )
+				{
+					stack[nDepth].rec = rec;
+					stack[nDepth].start = now;
+					stack[nDepth].nPolls = 0;
+				}
+				nDepth++;
+				break;
+
+			case TRACE_END:
+				if ( nDepth == 0 )
+					break;
+				nDepth--;
+				if ( nDepth >= OP_DEPTH )
+					break;
+
+				op = &stack[nDepth];
+				op->result = rec.value;
+				op->duration = now - op->start;
+
+				nOp = OP_TYPE(op->rec.type);
+				nOps[nOp]++;
+				opTime[nOp] += op->duration;
+				if ( op->duration > opMax[nOp] )
+					opMax[nOp] = op->duration;
+
+				if ( nOp == OP_WRITE || nOp == OP_PAGE )
+				{
+					nPolls += op->nPolls;
+					if ( op->nPolls > nMaxPolls )
+						nMaxPolls = op->nPolls;
+					if ( op->result != WRITEOK )
+						nWriteErrors++;
+				}
+
+				if ( nDepth == 0 )							// rank top level operations only
+					traceSlow(top, &nTop, op);
+
+				nPhase = PH_OTHER;
+				break;
+		}
+	}
+
+	fclose(fp);
+
+	/*
+	 * report
+	 */
+	startSec = (time_t) (header.startTime / 1000000000LL);
+	printf("trace '%s': %ld records, %.3fms, recorded %s", sName, nRecords, now / 1000000.0, ctime(&startSec));
+	printf("bus cycles: %ld /WE, %ld /OE, %ld low address loads, %ld high address loads, %ld /CS asserts\n",
+			nWriteCycles, nReadCycles, nLoLoads, nHiLoads, nCsAsserts);
+
+	printf("phase time:\n");
+	for ( i = 0; i < PHASES; i++ )
+	{
+		if ( phaseTime[i] )
+			printf("\t%-14s %12.3fms  %5.1f%%\n", phaseName[i], phaseTime[i] / 1000000.0,
+					now ? (100.0 * phaseTime[i] / now) : 0.0);
+	}
+
+	printf("operations:\n");
+	for ( i = 0; i < OP_TYPES; i++ )
+	{
+		if ( nOps[i] )
+			printf("\t%-16s count %ld, avg %lldus, max %lldus\n", opName[i], nOps[i],
+					opTime[i] / nOps[i] / 1000, opMax[i] / 1000);
+	}
+	if ( nOps[OP_WRITE] || nOps[OP_PAGE] )
+		printf("\twriteByte()/writePage() reads avg %.1f, max %d, errors %ld\n",
+				(double) nPolls / (nOps[OP_WRITE] + nOps[OP_PAGE]), nMaxPolls, nWriteErrors);
+
+	if ( nTop )
+	{
+		printf("slowest operations:\n");
+		printf("\t    start(us)  operation         address  data  result  polls  time(us)\n");
+		for ( i = 0; i < nTop; i++ )
+			printf("\t%13.3f  %-16s  0x%04x   0x%02x  0x%02x    %5d  %lld\n", top[i].start / 1000.0,
+					opName[OP_TYPE(top[i].rec.type)], top[i].rec.address,
+					(top[i].rec.type == TRACE_READ) ? top[i].result : top[i].rec.value,
+					top[i].result, top[i].nPolls, top[i].duration / 1000);
+	}
+
+	return 0;
+}
+
+/*
+ * traceSlow()
+ *
+ * insert operation 'op' into the list of the
+ * TRACE_TOP slowest operations, sorted slowest first
+ *
+ */
+static void traceSlow(struct traceOp *top, int *nTop, struct traceOp *op)
+{
+	int		i;
+
+	if ( *nTop == TRACE_TOP && op->duration <= top[TRACE_TOP - 1].duration )
+		return;
+
+	for ( i = 0; i < *nTop; i++ )
+	{
+		if ( op->duration > top[i].duration )
+			break;
+	}
+
+	if ( *nTop < TRACE_TOP )
+		(*nTop)++;
+
+	memmove(&top[i + 1], &top[i], (*nTop - i - 1) * sizeof(struct traceOp));
+	top[i] = *op;
+}
+
+/*
+ * traceLoad()
+ *
+ * open trace file 'sName' for reading and check its header
+ * return file positioned on first record or NULL
+ *
+ */
+static FILE *traceLoad(char *sName, struct traceHeader *header)
+{
+	FILE	*fp;
+
+	if ( (fp = fopen(sName, "rb")) == NULL )
+	{
+		printf("traceLoad() could not open file '%s' (errno=%d)\n", sName, errno);
+		return NULL;
+	}
+
+	setvbuf(fp, NULL, _IOFBF, IO_BUFFER);
+
+	if ( fread(header, sizeof(struct traceHeader), 1, fp) != 1 ||
+		 header->magic != TRACE_MAGIC ||
+		 header->version != TRACE_VERSION ||
+		 header->recordSize != sizeof(struct traceRecord) )
+	{
+		printf("traceLoad() '%s' is not a trace file of this version\n", sName);
+		fclose(fp);
+		return NULL;
+	}
+
+	return fp;
+}
+
+/*
+ * -----------------------------------------
+ * ----------  replay functions  -----------
+ * -----------------------------------------
+ */
+
+/*
+ * traceReplay()
+ *
+ * replay trace file 'sName' against the emulated chip and
+ * list traced reads that differ from the emulated chip.
+ * a difference while either the traced or the emulated chip is
+ * DATA polling is a write cycle timing difference, otherwise the
+ * chip returned different data than was written to it.
+ * return '0' if the trace matches the emulated chip
+ *
+ */
+int traceReplay(char *sName)
+{
+	FILE				*fp;
+	struct traceHeader	header;
+	struct traceRecord	rec;
+	struct traceRecord	outer;					// top level operation
+	struct emu			*emu;
+
+	long long	now = 0;
+	int			nDepth = 0;
+	int			nBusy;
+	int			nLate;
+	int			nEmulated;
+	t_word		address;
+
+	long		nRecords = 0;
+	long		nCompared = 0;
+	long		nLearned = 0;
+	long		nTiming = 0;
+	long		nData = 0;
+	long		nLoop = 0;
+	long		nWriteErrors = 0;
+
+	if ( (emu = malloc(sizeof(struct emu))) == NULL )
+	{
+		printf("traceReplay() out of memory\n");
+		return 1;
+	}
+
+	if ( (fp = traceLoad(sName, &header)) == NULL )
+	{
+		free(emu);
+		return 1;
+	}
+
+	emuInit(emu, 0);
+	emu->writeNs = TRACE_WRITE_NS;
+	memset(&outer, 0, sizeof(struct traceRecord));
+
+	while ( fread(&rec, sizeof(struct traceRecord), 1, fp) == 1 )
+	{
+		nRecords++;
+		now += rec.delta;
+
+		switch ( rec.type )
+		{
+			case TRACE_DATA:
+				emuWriteData(emu, rec.value);
+				break;
+
+			case TRACE_CONTROL:
+				emuWriteControl(emu, rec.value, now);
+				break;
+
+			case TRACE_DIR:
+				emuDataDir(emu, rec.value);
+				break;
+
+			case TRACE_RDATA:
+				address = emuAddress(emu);
+				nBusy = emuBusy(emu, now);
+
+				if ( !nBusy && !emu->valid[address] )		// learn contents not written in trace
+				{
+					emu->mem[address] = rec.value;
+					emu->valid[address] = 1;
+					nLearned++;
+					break;
+				}
+
+				nEmulated = emuReadData(emu, now);
+				nCompared++;
+
+				if ( nEmulated == rec.value )
+					break;
+
+				nLate = ( IS_WRITE(outer.type) && address == outer.address &&	// traced chip still DATA polling
+						  ((rec.value ^ outer.value) & 0x80) );
+
+				if ( nBusy || nLate )
+					nTiming++;
+				else
+					nData++;
+
+				if ( (nTiming + nData) <= TRACE_ERRORS )
+					printf("\t%12.3fus  %s at 0x%04x: trace 0x%02x, emulated 0x%02x%s\n", now / 1000.0,
+							nBusy ? "chip ready early" : (nLate ? "chip busy late" : "data mismatch"),
+							address, rec.value, nEmulated,
+							IS_WRITE(outer.type) ? " in write" : "");
+				break;
+
+			case TRACE_STATUS:
+				if ( (emuReadStatus(emu) & 0x80) != (rec.value & 0x80) )
+				{
+					nLoop++;
+					if ( nLoop <= TRACE_ERRORS )
+						printf("\t%12.3fus  loop test status 0x%02x, emulated 0x%02x\n", now / 1000.0,
+								rec.value, emuReadStatus(emu));
+				}
+				break;
+
+			case TRACE_READ:
+			case TRACE_WRITE:
+			case TRACE_FAST:
+			case TRACE_PAGE:
+				if ( nDepth == 0 )
+					outer = rec;
+				nDepth++;
+				break;
+
+			case TRACE_END:
+				if ( nDepth > 0 )
+					nDepth--;
+				if ( nDepth == 0 )
+				{
+					if ( IS_WRITE(outer.type) && rec.value != WRITEOK )
+						nWriteErrors++;
+					memset(&outer, 0, sizeof(struct traceRecord));
+				}
+				break;
+		}
+	}
+
+	fclose(fp);
+
+	printf("replay '%s': %ld records, %.3fms\n", sName, nRecords, now / 1000000.0);
+	printf("\treads compared %ld, learned %ld\n", nCompared, nLearned);
+	printf("\twrite timing differences %ld, data mismatches %ld, loop test mismatches %ld\n", nTiming, nData, nLoop);
+	printf("\ttraced writeByte()/writePage() errors %ld\n", nWriteErrors);
+	printf("\temulated chip: %ld byte loads, %ld write cycles, %ld loads ignored while busy, %ld DATA polling reads\n",
+			emu->nLoads, emu->nCycles, emu->nBusyWrites, emu->nPolls);
+
+	free(emu);
+
+	return (nData || nLoop) ? 1 : 0;
+}
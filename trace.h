@@ -0,0 +1,85 @@
+/*
+ * trace.h
+ *
+ *      Purpose:
+ *
+ *      bus level trace recording, analysis and replay.
+ *      every parallel port access the programer library makes is recorded
+ *      with a nano-second time stamp into a compact binary trace file,
+ *      together with markers for setAddress(), readByte(), writeByte(),
+ *      fastByteWrite() and writePage() calls.
+ *
+ *      trace file: one 'struct traceHeader' followed by 'struct traceRecord'
+ *      records in host byte order. record time stamps are deltas from the
+ *      previous record, longer gaps are carried by TRACE_GAP records.
+ *
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "eeprom.h"
+
+/*
+ * definitions
+ */
+#define TRACE_MAGIC		0x52545045	// "EPTR"
+#define TRACE_VERSION	1
+
+#define TRACE_BUFFER	4096		// records buffered in memory between file writes
+#define TRACE_TOP		10			// slowest operations listed by the analyzer
+#define TRACE_ERRORS	20			// mismatches listed by replay
+
+#define TRACE_DATA		1			// port write data, 'value'
+#define TRACE_CONTROL	2			// port write control, 'value'
+#define TRACE_DIR		3			// port data direction, 'value' '1' read
+#define TRACE_RDATA		4			// port read data, 'value'
+#define TRACE_STATUS	5			// port read status, 'value'
+#define TRACE_DELAY		6			// delay of 'address' micro-seconds starts
+#define TRACE_SETADDR	7			// setAddress() of 'address', 'value' '1' asserts /CS
+#define TRACE_READ		8			// readByte() of 'address' starts
+#define TRACE_WRITE		9			// writeByte() of 'value' to 'address' starts
+#define TRACE_FAST		10			// fastByteWrite() of 'value' to 'address' starts
+#define TRACE_END		11			// read/write operation ends, 'value' byte read or write result
+#define TRACE_GAP		12			// time only record
+#define TRACE_PAGE		13			// writePage() starts, 'address' and 'value' of last byte loaded
+
+/*
+ * type definitions
+ */
+struct traceHeader
+{
+	unsigned int	magic;
+	unsigned short	version;
+	unsigned short	recordSize;
+	long long		startTime;					// wall clock time of trace start, nano-seconds since epoch
+};
+
+struct traceRecord
+{
+	unsigned int	delta;						// nano-seconds since previous record
+	t_byte			type;
+	t_byte			value;
+	t_word			address;
+};
+
+struct trace									// trace recorder
+{
+	FILE				*fp;
+	long long			lastTime;				// time stamp of last record
+	long				nRecords;
+	int					nCount;					// records in buffer
+	int					nError;					// file write failed, recording stopped
+	struct traceRecord	buffer[TRACE_BUFFER];
+};
+
+/*
+ * function prototypes
+ */
+struct trace	*traceOpen(char*);				// create trace file and start recording
+int		traceClose(struct trace*);				// flush and close trace file
+void	traceEvent(struct trace*, int, t_word, t_byte);	// record a trace event
+int		traceAnalyze(char*, int);				// reconstruct bus cycles and report timing
+int		traceReplay(char*);						// replay trace against emulated chip
+
+#endif /* __TRACE_H__ */
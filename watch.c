@@ -0,0 +1,322 @@
+/*
+ * watch.c
+ *
+ *      Purpose:
+ *
+ *      watch mode for the edit, build and flash loop of firmware development.
+ *
+ *      the image file is programmed once, then its directory is watched
+ *      with inotify so that files replaced by rename are seen as well.
+ *      after a write or rename of the file and WATCH_QUIET ms without
+ *      further events the file is loaded again. pages holding a byte that
+ *      differs from the image last programmed are written through the
+ *      planner, page writes verify their bytes and the written pages are
+ *      read back once more. an image that does not load, e.g. one caught
+ *      half written, is skipped until the next rebuild.
+ *      Ctrl-C ends the watch after the current rebuild is programmed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+
+/*
+ * local type definitions
+ */
+struct watch								// watch state
+{
+	struct eeprom	*ctx;
+	char			*sName;					// image file and its base address
+	t_word			base;
+	struct plan		last;					// image last programmed
+	struct plan		next;					// rebuilt image
+	struct plan		diff;					// its pages that changed
+	long			nBuilds;				// rebuilds programmed
+};
+
+/*
+ * local function prototypes
+ */
+static int	watchLoad(struct watch*, struct plan*);		// load image file into a plan
+static int	watchDiff(struct watch*);					// plan changed pages of the rebuilt image
+static int	watchWait(int, const char*);				// wait for a rebuild of the image file
+static void	watchStop(int);								// SIGINT handler
+
+/*
+ * local globals
+ */
+static volatile sig_atomic_t	nStop = 0;			// Ctrl-C seen
+
+/*
+ * watchRun()
+ *
+ * program image file 'sName' at 'base', then watch it and program
+ * the changed pages of every rebuild until Ctrl-C
+ * return '0' when the watch is ended, '1' if it could not start
+ * or a rebuild failed to program
+ *
+ */
+int watchRun(struct eeprom *ctx, char *sName, t_word base)
+{
+	struct watch		*w;
+	struct sigaction	action;
+	struct sigaction	saved;
+	char				sDir[TEXT_LEN];
+	const char			*sFile;
+	int					nDir;
+	int					fd;
+	int					nPages;
+	long				nDiffer;
+	long long			start;
+	int					nForce;
+	int					nResult;
+	int					nFailed = 0;			// a rebuild failed to program
+
+	if ( strcmp(sName, STDIO_NAME) == 0 )
+	{
+		printf("watchRun() cannot watch stdin\n");
+		return 1;
+	}
+
+	if ( (sFile = strrchr(sName, '/')) == NULL )				// watch the directory, builds often replace the file
+	{
+		strcpy(sDir, ".");
+		sFile = sName;
+	}
+	else
+	{
+		nDir = (sFile == sName) ? 1 : (int) (sFile - sName);	// '/' for a file in the root directory
+		snprintf(sDir, sizeof(sDir), "%.*s", nDir, sName);
+		sFile++;
+	}
+
+	if ( (w = calloc(1, sizeof(struct watch))) == NULL )
+	{
+		printf("watchRun() out of memory\n");
+		return 1;
+	}
+
+	w->ctx = ctx;
+	w->sName = sName;
+	w->base = base;
+
+	if ( (fd = inotify_init1(IN_CLOEXEC)) < 0 || inotify_add_watch(fd, sDir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 )
+	{
+		printf("watchRun() cannot watch '%s' (errno=%d)\n", sDir, errno);
+		if ( fd >= 0 )
+			close(fd);
+		free(w);
+		return 1;
+	}
+
+	/*
+	 * program the image as a normal write
+	 */
+	if ( watchLoad(w, &w->last) || writePlan(ctx, &w->last) )
+	{
+		close(fd);
+		free(w);
+		return 1;
+	}
+
+	if ( w->last.nCurrent )
+		printf("watchRun() eeprom already holds '%s'\n", sName);
+
+	memset(&action, 0, sizeof(action));							// no SA_RESTART, Ctrl-C ends poll()
+	action.sa_handler = watchStop;
+	sigemptyset(&action.sa_mask);
+	nStop = 0;
+	sigaction(SIGINT, &action, &saved);
+
+	printf("watchRun() watching '%s', Ctrl-C to end\n", sName);
+
+	while ( watchWait(fd, sFile) == 0 )
+	{
+		start = getTimeNs();
+
+		if ( watchLoad(w, &w->next) )
+		{
+			printf("watchRun() '%s' not loaded, waiting for the next build\n", sName);
+			continue;
+		}
+
+		if ( (nPages = watchDiff(w)) == 0 )
+		{
+			printf("watchRun() '%s' rebuilt, no page changed\n", sName);
+			continue;
+		}
+
+		nForce = ctx->nForce;									// pages are known to differ
+		ctx->nForce = 1;
+		nResult = writePlan(ctx, &w->diff);
+		ctx->nForce = nForce;
+
+		if ( nResult )
+			printf("watchRun() write failed (error %d), the next build is written in full\n", nResult);
+		else if ( (nDiffer = verifyPlan(ctx, &w->diff)) )
+			printf("watchRun() verify failed, %ld bytes differ, the next build is written in full\n", nDiffer);
+
+		if ( nResult || nDiffer )
+		{
+			planInit(&w->last);
+			nFailed = 1;
+			continue;
+		}
+
+		w->nBuilds++;
+		memcpy(&w->last, &w->next, sizeof(struct plan));
+
+		printf("watchRun() build %ld: %d pages, %ld bytes programmed and verified in %.0fms\n",
+				w->nBuilds, nPages, w->diff.nBytes, (getTimeNs() - start) / 1e6);
+	}
+
+	sigaction(SIGINT, &saved, NULL);
+	close(fd);
+
+	printf("watchRun() watch ended, %ld builds programmed%s\n", w->nBuilds, nFailed ? ", some builds failed" : "");
+	free(w);
+
+	return nFailed;
+}
+
+/*
+ * watchLoad()
+ *
+ * load the image file into 'plan' with the context write page fill
+ * return '0' on success or '1' on error
+ *
+ */
+static int watchLoad(struct watch *w, struct plan *plan)
+{
+	t_byte	*data;
+	int		nLength;
+	int		nResult;
+
+	if ( loadInput(w->sName, &data, &nLength, eepromMessage, w->ctx) )
+		return 1;
+
+	planInit(plan);
+	nResult = planImage(w->ctx, plan, data, nLength, w->base);
+	free(data);
+
+	if ( nResult )
+		return 1;
+
+	planBuild(plan, w->ctx->nFill);
+
+	return 0;
+}
+
+/*
+ * watchDiff()
+ *
+ * plan every byte of the rebuilt image in the pages that hold
+ * a byte not programmed before or different from it. bytes dropped
+ * from the image are left on the eeprom
+ * return number of changed pages
+ *
+ */
+static int watchDiff(struct watch *w)
+{
+	int		nPage;
+	int		i;
+	long	a;
+
+	planInit(&w->diff);
+
+	for ( nPage = 0; nPage < PAGES; nPage++ )
+	{
+		a = (long) nPage * PAGE_SIZE;
+
+		for ( i = 0; i < PAGE_SIZE; i++, a++ )
+		{
+			if ( w->next.used[a] && (!w->last.used[a] || w->next.data[a] != w->last.data[a]) )
+				break;
+		}
+
+		if ( i == PAGE_SIZE )
+			continue;
+
+		for ( a = (long) nPage * PAGE_SIZE; a < (long) (nPage + 1) * PAGE_SIZE; a++ )
+		{
+			if ( w->next.used[a] )
+			{
+				w->diff.data[a] = w->next.data[a];
+				w->diff.used[a] = 1;
+				w->diff.nBytes++;
+			}
+		}
+	}
+
+	planBuild(&w->diff, -1);
+
+	return w->diff.nPages;
+}
+
+/*
+ * watchWait()
+ *
+ * wait for a write or rename of file 'sFile' in the watched directory
+ * of inotify descriptor 'fd', then until no event came for WATCH_QUIET ms
+ * return '0' when the file was rebuilt or '1' on Ctrl-C or error
+ *
+ */
+static int watchWait(int fd, const char *sFile)
+{
+	char			buffer[WATCH_EVENTS] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event	*event;
+	struct pollfd	pfd;
+	ssize_t			nLength;
+	char			*p;
+	int				nChanged = 0;
+	int				nReady;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while ( !nStop )
+	{
+		if ( (nReady = poll(&pfd, 1, nChanged ? WATCH_QUIET : -1)) < 0 )
+		{
+			if ( errno == EINTR )
+				continue;
+			return 1;
+		}
+
+		if ( nReady == 0 )										// quiet after the last event
+			return 0;
+
+		if ( (nLength = read(fd, buffer, sizeof(buffer))) <= 0 )
+			return 1;
+
+		for ( p = buffer; p < buffer + nLength; p += sizeof(struct inotify_event) + event->len )
+		{
+			event = (struct inotify_event *) p;
+			if ( event->len && strcmp(event->name, sFile) == 0 )
+				nChanged = 1;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * watchStop()
+ *
+ * SIGINT handler, end the watch
+ *
+ */
+static void watchStop(int nSignal)
+{
+	(void) nSignal;
+
+	nStop = 1;
+}
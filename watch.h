@@ -0,0 +1,29 @@
+/*
+ * watch.h
+ *
+ *      Purpose:
+ *
+ *      watch mode: keep the programer port claimed and watch an image
+ *      file with inotify. each time the file is rebuilt it is compared
+ *      with the image last programmed, which is held in memory, and
+ *      only the pages that changed are programmed and verified.
+ *
+ */
+
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+#include "eeprom.h"
+
+/*
+ * definitions
+ */
+#define WATCH_QUIET		200			// milli-seconds without file events before a rebuild is loaded
+#define WATCH_EVENTS	4096		// inotify event buffer size
+
+/*
+ * function prototypes
+ */
+int		watchRun(struct eeprom*, char*, t_word);	// program image file, then changed pages on every rebuild
+
+#endif /* __WATCH_H__ */
@@ -0,0 +1,421 @@
+/*
+ * wear.c
+ *
+ *      Purpose:
+ *
+ *      per-page write cycle telemetry and wear map.
+ *
+ *      wear map file format, '#' starts a comment:
+ *
+ *      	serial	<chip serial>
+ *      	runs	<runs that wrote the chip>
+ *      	<page address> <cycles> <sum ns> <max ns> <first run mean ns> <last run mean ns>
+ *      		<retries> <verify fails> <time-outs> <last run> <last run fails> <slow runs>
+ *
+ *      only pages that were ever written are listed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "wear.h"
+#include "station.h"
+
+/*
+ * local function prototypes
+ */
+static long long	pageMean(struct wearPage*);		// mean write cycle time over all runs
+
+/*
+ * wearInit()
+ *
+ * clear wear map of chip 'sSerial'
+ *
+ */
+void wearInit(struct wear *wear, const char *sSerial)
+{
+	memset(wear, 0, sizeof(struct wear));
+	strncpy(wear->sSerial, sSerial, TEXT_LEN - 1);
+}
+
+/*
+ * wearRecord()
+ *
+ * record a write cycle of 'nNs' nano-seconds
+ * with result 'nResult' at eeprom 'address'
+ *
+ */
+void wearRecord(struct wear *wear, t_word address, long long nNs, int nResult)
+{
+	struct wearPage	*page = &wear->page[(address % EEPROM_SIZE) / PAGE_SIZE];
+
+	wear->hist[(nNs / WEAR_BUCKET < WEAR_HIST) ? nNs / WEAR_BUCKET : WEAR_HIST - 1]++;
+
+	page->nRunCycles++;
+	page->runNs += nNs;
+	if ( nNs > page->maxNs )
+		page->maxNs = nNs;
+
+	if ( nResult == WRITEVER )
+		page->nVerify++;
+	else if ( nResult == WRITETOV )
+		page->nTimeouts++;
+
+	if ( nResult != WRITEOK )
+		page->nRunFails++;
+}
+
+/*
+ * wearRetry()
+ *
+ * record a page write at 'address' retried in byte mode
+ *
+ */
+void wearRetry(struct wear *wear, t_word address)
+{
+	struct wearPage	*page = &wear->page[(address % EEPROM_SIZE) / PAGE_SIZE];
+
+	page->nRetries++;
+	page->nRunFails++;
+}
+
+/*
+ * wearMerge()
+ *
+ * add the write cycles, fails and cycle time histogram of map 'from',
+ * which has no runs folded in yet, to the current run of 'wear'
+ *
+ */
+void wearMerge(struct wear *wear, struct wear *from)
+{
+	struct wearPage	*page;
+	struct wearPage	*add;
+	int				i;
+
+	for ( i = 0; i < PAGES; i++ )
+	{
+		page = &wear->page[i];
+		add = &from->page[i];
+
+		page->nRunCycles += add->nRunCycles;
+		page->runNs += add->runNs;
+		if ( add->maxNs > page->maxNs )
+			page->maxNs = add->maxNs;
+		page->nRetries += add->nRetries;
+		page->nVerify += add->nVerify;
+		page->nTimeouts += add->nTimeouts;
+		page->nRunFails += add->nRunFails;
+	}
+
+	for ( i = 0; i < WEAR_HIST; i++ )
+		wear->hist[i] += from->hist[i];
+}
+
+/*
+ * wearRun()
+ *
+ * fold the write cycles recorded since the last call into the map.
+ * a page's first run mean is its base line for later runs.
+ * runs that wrote nothing are not counted
+ * return count of pages written in the run
+ *
+ */
+int wearRun(struct wear *wear)
+{
+	struct wearPage	*page;
+	int				i;
+	int				nWritten = 0;
+
+	for ( i = 0; i < PAGES; i++ )
+	{
+		if ( wear->page[i].nRunCycles || wear->page[i].nRunFails )
+			nWritten++;
+	}
+
+	if ( !nWritten )
+		return 0;
+
+	wear->nRuns++;
+
+	for ( i = 0; i < PAGES; i++ )
+	{
+		page = &wear->page[i];
+		if ( page->nRunCycles == 0 && page->nRunFails == 0 )
+			continue;
+
+		if ( page->nRunCycles )
+		{
+			page->lastNs = page->runNs / page->nRunCycles;
+			if ( page->baseNs == 0 )
+				page->baseNs = page->lastNs;
+
+			if ( (page->lastNs * 100) > (page->baseNs * WEAR_SLOW) )
+				page->nSlowRuns++;
+			else
+				page->nSlowRuns = 0;
+		}
+
+		page->nCycles += page->nRunCycles;
+		page->sumNs += page->runNs;
+		page->nLastRun = wear->nRuns;
+		page->nLastFails = page->nRunFails;
+
+		page->nRunCycles = 0;
+		page->runNs = 0;
+		page->nRunFails = 0;
+	}
+
+	return nWritten;
+}
+
+/*
+ * wearReport()
+ *
+ * print the last run's write cycle summary and list pages that
+ * failed in it, or whose mean cycle time was above WEAR_SLOW
+ * percent of their first run for WEAR_RUNS runs in a row.
+ * return count of slowing or failing pages
+ *
+ */
+int wearReport(struct wear *wear)
+{
+	struct wearPage	*page;
+	long			nPages = 0;
+	long long		sumNs = 0;
+	long long		slowNs = 0;
+	int				nSlowPage = 0;
+	int				nFlagged = 0;
+	int				i;
+
+	for ( i = 0; i < PAGES; i++ )
+	{
+		page = &wear->page[i];
+		if ( page->nLastRun != wear->nRuns || wear->nRuns == 0 )
+			continue;
+
+		if ( page->lastNs > slowNs )
+		{
+			slowNs = page->lastNs;
+			nSlowPage = i;
+		}
+
+		nPages += (page->lastNs > 0);
+		sumNs += page->lastNs;
+	}
+
+	if ( nPages == 0 )
+		return 0;
+
+	printf("wearReport() chip '%s' run %ld: %ld page(s) written, mean write cycle %.3fms, slowest page 0x%04x %.3fms\n",
+			wear->sSerial, wear->nRuns, nPages, (sumNs / nPages) / 1e6, nSlowPage * PAGE_SIZE, slowNs / 1e6);
+
+	for ( i = 0; i < PAGES; i++ )
+	{
+		page = &wear->page[i];
+		if ( page->nLastRun != wear->nRuns )
+			continue;
+
+		if ( page->nLastFails == 0 && page->nSlowRuns < WEAR_RUNS )
+			continue;
+
+		if ( nFlagged < WEAR_TOP )
+			printf("\tpage 0x%04x: %.3fms now, %.3fms first run, %ld slow run(s), %ld retries, %ld verify fails, %ld time-outs\n",
+					i * PAGE_SIZE, page->lastNs / 1e6, page->baseNs / 1e6, page->nSlowRuns, page->nRetries, page->nVerify, page->nTimeouts);
+		nFlagged++;
+	}
+
+	if ( nFlagged )
+		printf("wearReport() %d page(s) slowing or failing, chip may be worn\n", nFlagged);
+
+	return nFlagged;
+}
+
+/*
+ * wearPath()
+ *
+ * build wear map file name of chip 'sSerial' into 'sPath'
+ * return '0' on success, '1' if $HOME is not set, the serial holds other
+ * than letters, digits, '-', '_' and '.' or the name is too long
+ *
+ */
+int wearPath(char *sPath, int nLength, const char *sSerial)
+{
+	char		*sHome;
+
+	if ( stationName(sSerial) || (sHome = getenv("HOME")) == NULL )	// serial is part of a file name
+		return 1;
+
+	if ( snprintf(sPath, nLength, "%s/%s/%s%s", sHome, STATION_DIR, sSerial, WEAR_EXT) >= nLength )
+		return 1;
+
+	return 0;
+}
+
+/*
+ * wearLoad()
+ *
+ * read accumulated wear map 'sPath' into 'wear'
+ * return '0' on success, '1' if there is no readable map
+ *
+ */
+int wearLoad(struct wear *wear, char *sPath)
+{
+	FILE			*fp;
+	char			textLine[TEXT_LEN * 2];
+	struct wearPage	page;
+	unsigned long	address;
+
+	if ( (fp = fopen(sPath, "r")) == NULL )
+		return 1;
+
+	while ( fgets(textLine, sizeof(textLine), fp) )
+	{
+		if ( textLine[0] == '#' )
+			continue;
+
+		if ( sscanf(textLine, "runs %ld", &wear->nRuns) == 1 )
+			continue;
+
+		memset(&page, 0, sizeof(page));
+		if ( sscanf(textLine, "%lx %ld %lld %lld %lld %lld %ld %ld %ld %ld %ld %ld", &address,
+					&page.nCycles, &page.sumNs, &page.maxNs, &page.baseNs, &page.lastNs,
+					&page.nRetries, &page.nVerify, &page.nTimeouts, &page.nLastRun, &page.nLastFails, &page.nSlowRuns) == 12 &&
+			 address < EEPROM_SIZE )
+			wear->page[address / PAGE_SIZE] = page;
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+/*
+ * wearSave()
+ *
+ * write accumulated wear map 'wear' to 'sPath',
+ * creating the profile directory in $HOME if needed
+ * return '0' on success
+ *
+ */
+int wearSave(struct wear *wear, char *sPath)
+{
+	FILE			*fp;
+	char			sDir[TEXT_LEN * 2];
+	char			*sHome;
+	struct wearPage	*page;
+	int				i;
+
+	if ( (sHome = getenv("HOME")) != NULL )
+	{
+		snprintf(sDir, sizeof(sDir), "%s/%s", sHome, STATION_DIR);
+		mkdir(sDir, 0755);
+	}
+
+	if ( (fp = fopen(sPath, "w")) == NULL )
+	{
+		printf("wearSave() could not open file '%s' for writing (errno=%d)\n", sPath, errno);
+		return 1;
+	}
+
+	fprintf(fp, "# eepromprog wear map\n");
+	fprintf(fp, "serial\t%s\n", wear->sSerial);
+	fprintf(fp, "runs\t%ld\n", wear->nRuns);
+	fprintf(fp, "# page cycles sum_ns max_ns first_run_ns last_run_ns retries verify timeouts last_run last_fails slow_runs\n");
+
+	for ( i = 0; i < PAGES; i++ )
+	{
+		page = &wear->page[i];
+		if ( page->nLastRun == 0 )
+			continue;
+
+		fprintf(fp, "0x%04x\t%ld\t%lld\t%lld\t%lld\t%lld\t%ld\t%ld\t%ld\t%ld\t%ld\t%ld\n", i * PAGE_SIZE,
+				page->nCycles, page->sumNs, page->maxNs, page->baseNs, page->lastNs,
+				page->nRetries, page->nVerify, page->nTimeouts, page->nLastRun, page->nLastFails, page->nSlowRuns);
+	}
+
+	if ( fclose(fp) )
+	{
+		printf("wearSave() error writing file '%s' (errno=%d)\n", sPath, errno);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * wearExport()
+ *
+ * export wear map to 'sFile', JSON if the file name ends
+ * in '.json', otherwise CSV with a header line
+ * return '0' on success
+ *
+ */
+int wearExport(struct wear *wear, char *sFile)
+{
+	FILE			*fp;
+	struct wearPage	*page;
+	const char		*ext;
+	int				nJson;
+	int				nFirst = 1;
+	int				i;
+
+	ext = strrchr(sFile, '.');
+	nJson = (ext != NULL && strcmp(ext, ".json") == 0);
+
+	if ( (fp = fopen(sFile, "w")) == NULL )
+	{
+		printf("wearExport() could not open file '%s' for writing (errno=%d)\n", sFile, errno);
+		return 1;
+	}
+
+	if ( nJson )
+		fprintf(fp, "{\n  \"serial\": \"%s\",\n  \"runs\": %ld,\n  \"page_size\": %d,\n  \"pages\": [", wear->sSerial, wear->nRuns, PAGE_SIZE);
+	else
+		fprintf(fp, "address,cycles,mean_ns,max_ns,first_run_ns,last_run_ns,retries,verify_fails,timeouts,last_run,last_run_fails,slow_runs\n");
+
+	for ( i = 0; i < PAGES; i++ )
+	{
+		page = &wear->page[i];
+		if ( page->nLastRun == 0 )
+			continue;
+
+		if ( nJson )
+		{
+			fprintf(fp, "%s\n    {\"address\": %d, \"cycles\": %ld, \"mean_ns\": %lld, \"max_ns\": %lld, \"first_run_ns\": %lld, "
+					"\"last_run_ns\": %lld, \"retries\": %ld, \"verify_fails\": %ld, \"timeouts\": %ld, \"last_run\": %ld, \"last_run_fails\": %ld, \"slow_runs\": %ld}",
+					nFirst ? "" : ",", i * PAGE_SIZE, page->nCycles, pageMean(page), page->maxNs, page->baseNs,
+					page->lastNs, page->nRetries, page->nVerify, page->nTimeouts, page->nLastRun, page->nLastFails, page->nSlowRuns);
+			nFirst = 0;
+		}
+		else
+			fprintf(fp, "0x%04x,%ld,%lld,%lld,%lld,%lld,%ld,%ld,%ld,%ld,%ld,%ld\n", i * PAGE_SIZE,
+					page->nCycles, pageMean(page), page->maxNs, page->baseNs,
+					page->lastNs, page->nRetries, page->nVerify, page->nTimeouts, page->nLastRun, page->nLastFails, page->nSlowRuns);
+	}
+
+	if ( nJson )
+		fprintf(fp, "\n  ]\n}\n");
+
+	if ( fclose(fp) )
+	{
+		printf("wearExport() error writing file '%s' (errno=%d)\n", sFile, errno);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * pageMean()
+ *
+ * return mean write cycle time of 'page' over all runs
+ *
+ */
+static long long pageMean(struct wearPage *page)
+{
+	return page->nCycles ? (page->sumNs / page->nCycles) : 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * wear.h
+ *
+ *      Purpose:
+ *
+ *      per-page write cycle telemetry and wear map.
+ *      writePage() and writeByte() record how long each write cycle took
+ *      to complete DATA polling, and its result. writePlan() records page
+ *      writes retried in byte mode. a map is kept per chip serial in
+ *      ~/.eepromprog/<serial>.wear and accumulated across runs, each run's
+ *      mean cycle time per page is compared with the page's first run.
+ *
+ */
+
+#ifndef __WEAR_H__
+#define __WEAR_H__
+
+#include "eeprom.h"
+
+/*
+ * definitions
+ */
+#define WEAR_EXT		".wear"
+#define WEAR_SLOW		150			// a run is slow for a page when its mean exceeds this % of the first run mean
+#define WEAR_RUNS		2			// page is slowing after this many slow runs in a row, one slow run is host jitter
+#define WEAR_TOP		10			// slowing or failing pages listed by wearReport()
+#define WEAR_HIST		20			// write cycle time histogram buckets of this process,
+#define WEAR_BUCKET		500000		// nano-seconds each, the last one is open ended
+
+/*
+ * type definitions
+ */
+struct wearPage								// one eeprom page
+{
+	long			nCycles;				// write cycles over all runs
+	long long		sumNs;					// and their total, longest, first run mean and last run mean time
+	long long		maxNs;
+	long long		baseNs;
+	long long		lastNs;
+	long			nRetries;				// page writes retried in byte mode
+	long			nVerify;				// write cycles failing verify
+	long			nTimeouts;				// write cycles timing out DATA polling
+	long			nLastRun;				// last run that wrote the page
+	long			nLastFails;				// retries, verify fails and time-outs of that run
+	long			nSlowRuns;				// slow runs in a row up to the last run
+	long			nRunCycles;				// current run, folded in by wearRun()
+	long long		runNs;
+	long			nRunFails;
+};
+
+struct wear									// chip wear map
+{
+	char			sSerial[TEXT_LEN];		// user supplied chip serial
+	long			nRuns;					// runs that wrote the chip
+	struct wearPage	page[PAGES];
+	long			hist[WEAR_HIST];		// write cycle times of this process, not saved
+};
+
+/*
+ * function prototypes
+ */
+void	wearInit(struct wear*, const char*);	// clear wear map of chip serial
+void	wearRecord(struct wear*, t_word, long long, int);	// record a write cycle time and result
+void	wearRetry(struct wear*, t_word);		// record a page write retried in byte mode
+void	wearMerge(struct wear*, struct wear*);	// add the current run of a map to another map
+int		wearRun(struct wear*);				// fold current run into the map
+int		wearReport(struct wear*);			// print run summary, list slowing and failing pages
+int		wearPath(char*, int, const char*);	// wear map file name for a chip serial
+int		wearLoad(struct wear*, char*);		// read accumulated wear map
+int		wearSave(struct wear*, char*);		// write accumulated wear map
+int		wearExport(struct wear*, char*);	// export wear map as CSV, or JSON for a '.json' file
+
+#endif /* __WEAR_H__ */